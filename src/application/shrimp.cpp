@@ -109,9 +109,8 @@ int main(int argc, char** argv) {
 	fltk::LightButton::default_style->selection_color (hover_colour);
 
 	// check preferences for splash screen
-	general_options prefs;
-	prefs.load();
-	const bool show_splash = prefs.m_splash_screen;
+	const std::shared_ptr<const general_options> prefs = general_options::current();
+	const bool show_splash = prefs->m_splash_screen;
 
 	// open splash screen
 	fltk::Window* splash_window = 0;
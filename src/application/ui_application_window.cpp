@@ -46,6 +46,7 @@
 #include <fltk/events.h>
 #include <fltk/file_chooser.h>
 #include <fltk/filename.h>
+#include <fltk/run.h>
 
 #include <fltk/DoubleBufferWindow.h>
 
@@ -265,27 +266,26 @@ application_window::application_window(services* services_instance, opengl_view*
 			// help file generation
 
 		// load data from preferences
-		general_options prefs;
-		prefs.load();
-		m_renderers = prefs.get_renderer_list();
-		m_scenes = prefs.get_scene_list();
+		const std::shared_ptr<const general_options> prefs = general_options::current();
+		m_renderers = prefs->get_renderer_list();
+		m_scenes = prefs->get_scene_list();
 
 		// renderer chooser
 		m_renderer_chooser = new fltk::Choice (250, 22, 100, 24, "Renderer");
 		m_renderer_chooser->tooltip ("Choose an installed RenderMan engine");
-		set_renderer_chooser_value (prefs.m_renderer_code);
+		set_renderer_chooser_value (prefs->m_renderer_code);
 
 		// display chooser
 		m_renderer_display_chooser = new fltk::Choice (410, 22, 100, 24, "Display");
 		m_renderer_display_chooser->tooltip ("Select one of the renderer's displays");
 
 		// set preferences values
-		on_renderer_choice (this, (void*)prefs.m_renderer_code.c_str());
+		on_renderer_choice (this, (void*)prefs->m_renderer_code.c_str());
 
 		// scene chooser
 		m_scene_chooser = new fltk::Choice (570, 22, 100, 24, "Scene");
 		m_scene_chooser->tooltip ("Choose a 3D scene for preview");
-		set_scene_chooser_value (prefs.m_scene);
+		set_scene_chooser_value (prefs->m_scene);
 
 		// preview button
 		fltk::Button* preview_button = new fltk::Button (690, 22, 100, 24, "Render");
@@ -311,6 +311,11 @@ application_window::application_window(services* services_instance, opengl_view*
 		fit_button->callback ((fltk::Callback*)cb_button_fit_scene, this);
 		fit_button->tooltip ("Click to fit the block scene to the current view");
 
+		// preview progress
+		m_preview_status = new fltk::InvisibleBox (600, 570, 190, 24, "");
+		m_preview_status->box (fltk::NO_BOX);
+		m_preview_status->align (fltk::ALIGN_INSIDE | fltk::ALIGN_LEFT);
+
 		// OpenGL view
 				fltk::Group* main_view = new fltk::Group (2, 48, 796, 520);
 				main_view->begin();
@@ -326,11 +331,16 @@ application_window::application_window(services* services_instance, opengl_view*
 				resizable (main_view);
 
 	end();
+
+	// compile the shaders in the background while the scene is edited
+	fltk::add_timeout (0.25f, cb_idle_compilation, this);
 }
 
 application_window::~application_window()
 {
 	log() << aspect << "ui_application_window: destructor" << std::endl;
+	fltk::remove_timeout (cb_preview_status, this);
+	fltk::remove_timeout (cb_idle_compilation, this);
 	delete m_services;
 }
 
@@ -450,11 +460,10 @@ void application_window::on_menu_file_options (fltk::Widget*) {
 	d.pref_dialog();
 
 	// update the renderer, display and scene choosers according to the preferences
-	general_options prefs;
-	prefs.load();
-	const std::string renderer_code = prefs.m_renderer_code;
-	const std::string display_name = prefs.m_renderer_display;
-	const std::string scene = prefs.m_scene;
+	const std::shared_ptr<const general_options> prefs = general_options::current();
+	const std::string renderer_code = prefs->m_renderer_code;
+	const std::string display_name = prefs->m_renderer_display;
+	const std::string scene = prefs->m_scene;
 
 	set_renderer_chooser_value (renderer_code);
 	set_display_chooser_value (renderer_code, display_name);
@@ -599,9 +608,8 @@ void application_window::on_menu_help_about (fltk::Widget*, void*) {
 void application_window::on_menu_help_help (fltk::Widget*, void*) {
 
 // Open index.html file
-	general_options prefs;
-	prefs.load();
-	std::string help_reader = prefs.m_help_reader;
+	const std::shared_ptr<const general_options> prefs = general_options::current();
+	std::string help_reader = prefs->m_help_reader;
 
 //	system("firefox -url \"./doc/index.html\"&");
 	system(help_reader.c_str());
@@ -639,6 +647,67 @@ void application_window::on_preview()
 {
 	std::string tempdir = system_functions::get_tmp_directory();
 	m_services->show_preview (tempdir);
+
+	// the preview runs in the background, follow its progress
+	if (!fltk::has_timeout (cb_preview_status, this)) {
+		fltk::add_timeout (0.2f, cb_preview_status, this);
+	}
+	on_preview_status();
+}
+
+
+void application_window::on_preview_status()
+{
+	const preview_runner::status_t status = m_services->update_preview();
+
+	std::string text ("");
+	switch (status.state)
+	{
+		case preview_runner::RUNNING:
+			if (!status.jobs) {
+				// the preview thread is still writing the shaders
+				text = "writing shaders...";
+			} else {
+				text = "rendering... (" + string_cast (status.finished_jobs) + "/" + string_cast (status.jobs) + ")";
+			}
+		break;
+
+		case preview_runner::DONE:
+			text = "preview done";
+		break;
+
+		case preview_runner::FAILED:
+			text = "preview failed (see log)";
+		break;
+
+		case preview_runner::CANCELLED:
+			text = "preview cancelled";
+		break;
+
+		default:
+		break;
+	}
+
+	m_preview_status->copy_label (text.c_str());
+	m_preview_status->redraw();
+
+	// poll until the preview is over
+	if (status.state == preview_runner::RUNNING) {
+		if (!fltk::has_timeout (cb_preview_status, this)) {
+			fltk::repeat_timeout (0.2f, cb_preview_status, this);
+		}
+	} else {
+		fltk::remove_timeout (cb_preview_status, this);
+	}
+}
+
+
+void application_window::on_idle_compilation()
+{
+	// timeouts run between events, the compilation only starts once the scene stopped changing
+	m_services->update_speculative_compilation (system_functions::get_tmp_directory());
+
+	fltk::repeat_timeout (0.25f, cb_idle_compilation, this);
 }
 
 
@@ -77,6 +77,9 @@ private:
 	// scene chooser
 	fltk::Choice* m_scene_chooser;
 
+	// preview progress
+	fltk::InvisibleBox* m_preview_status;
+
 	// menu items
 	fltk::ToggleItem* m_menu_show_grid;
 	fltk::ToggleItem* m_menu_snap_to_grid;
@@ -112,6 +115,8 @@ private:
 	void on_button_fit_scene (fltk::Widget*);
 	void on_custom_block();
 	void on_preview();
+	void on_preview_status();
+	void on_idle_compilation();
 
 	void on_renderer_choice (fltk::Widget* W, void* Data);
 	void on_renderer_display_choice (fltk::Widget* W, void* Data);
@@ -165,6 +170,8 @@ private:
 	static void cb_zoom_slider (fltk::Slider* W, void* Data) { ((application_window*)Data)->on_zoom(W, Data); }
 	static void cb_custom_block (fltk::Widget* W, void* Data) { ((application_window*)Data)->on_custom_block(); }
 	static void cb_preview (fltk::Widget* W, void* Data) { ((application_window*)Data)->on_preview(); }
+	static void cb_preview_status (void* Data) { ((application_window*)Data)->on_preview_status(); }
+	static void cb_idle_compilation (void* Data) { ((application_window*)Data)->on_idle_compilation(); }
 
 	static void cb_renderer (fltk::Widget* W, void* Data) { application_pointer->on_renderer_choice (W, Data); }
 	static void cb_renderer_display (fltk::Widget* W, void* Data) { application_pointer->on_renderer_display_choice (W, Data); }
@@ -43,10 +43,12 @@ namespace preferences
 static bool answer;
 
 static fltk::LightButton* s_splash_screen;
+static fltk::LightButton* s_speculative_compilation;
 static fltk::Choice* s_renderer;
 static fltk::Output* s_renderer_code;
 static fltk::Input* s_compilation;
 static fltk::Input* s_shader_extension;
+static fltk::Input* s_compilation_jobs;
 static fltk::Input* s_rendering;
 static fltk::Choice* s_renderer_display;
 
@@ -145,6 +147,10 @@ public:
 			w->add (s_shader_extension);
 			s_shader_extension->tooltip ("compiled shader extension");
 
+			s_compilation_jobs = new fltk::Input (320,start + 90, 50,23,"compilation jobs");
+			w->add (s_compilation_jobs);
+			s_compilation_jobs->tooltip ("number of shaders compiled at the same time (0 for one per processor)");
+
 			s_rendering = new fltk::Input (120,start + 120, 250,23,"rendering");
 			w->add (s_rendering);
 			s_rendering->tooltip ("scene rendering command");
@@ -165,6 +171,10 @@ public:
 			s_scene->tooltip ("object(s) rendered in the output scene");
 			s_scene->value (shape_number);
 
+			s_speculative_compilation = new fltk::LightButton (250,start + 200, 130,25, "background compilation");
+			w->add (s_speculative_compilation);
+			s_speculative_compilation->tooltip ("compile the shaders while the scene is edited, so that previews start faster");
+
 			s_render_width = new fltk::Input (110,start + 230, 50,23,"render width");
 			w->add (s_render_width);
 			s_render_width->tooltip ("render test picture width in pixels");
@@ -229,6 +239,8 @@ public:
 		// set values
 		s_compilation->text (m_shader_compiler.c_str());
 		s_shader_extension->text (m_compiled_shader_extension.c_str());
+		std::string compilation_jobs = string_cast (m_compilation_jobs);
+		s_compilation_jobs->text (compilation_jobs.c_str());
 		s_renderer_code->text (m_renderer_code.c_str());
 		s_rendering->text (m_renderer.c_str());
 		set_display_chooser (m_renderer_code.c_str(), m_renderer_display);
@@ -254,6 +266,7 @@ public:
 		s_filter_width_t->text (filter_width_t.c_str());
 		s_help_reader->text(m_help_reader.c_str());
 		s_splash_screen->value (m_splash_screen);
+		s_speculative_compilation->value (m_speculative_compilation);
 
 		// show it
 		w->exec();
@@ -267,6 +280,7 @@ public:
 		m_renderer_code = m_hidden_renderer_code;
 		m_shader_compiler = trim (s_compilation->value());
 		m_compiled_shader_extension = trim (s_shader_extension->value());
+		m_compilation_jobs = from_string (trim (s_compilation_jobs->value()), 0u);
 		m_renderer = trim (s_rendering->value());
 		m_renderer_display = get_display_chooser_value (m_hidden_renderer_code);
 		m_pixel_filter = get_pixelfilter_chooser_value(m_hidden_renderer_code);
@@ -298,6 +312,7 @@ public:
 
 		m_help_reader = trim (s_help_reader->value());
 		m_splash_screen = s_splash_screen->value();
+		m_speculative_compilation = s_speculative_compilation->value();
 
 		save();
 
@@ -0,0 +1,262 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// prawn-batch: headless shader generation, for render farms
+//
+// Loads scene files and writes their shaders (.sl), K-3D slmeta files and preview RIB,
+// several scenes at a time; the shaders can also be compiled. It only uses the shading core,
+// without the user interface, and exits with a non-zero status when a scene failed.
+
+#include "../shading/scene.h"
+#include "../miscellaneous/logging.h"
+#include "../miscellaneous/misc_system_functions.h"
+#include "../miscellaneous/misc_thread_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#if defined _WIN32
+# include <direct.h>
+# define chdir _chdir
+#else
+# include <unistd.h>
+#endif
+
+
+namespace
+{
+
+// a scene to process and what came out of it
+struct scene_job_t
+{
+	std::string file;
+	std::string directory;
+
+	bool succeeded;
+	double seconds;
+	// messages logged while processing the scene
+	std::string log;
+};
+
+
+void usage (std::ostream& Stream)
+{
+	Stream << "usage: prawn-batch [options] scene.xml...\n"
+		<< "\n"
+		<< "Writes the shaders, K-3D slmeta files and preview RIB of each scene\n"
+		<< "into <output directory>/<scene file name without .xml>/.\n"
+		<< "\n"
+		<< "options:\n"
+		<< "  -o DIR   output directory (default: current directory)\n"
+		<< "  -j N     number of scenes processed at a time (default: one per hardware thread)\n"
+		<< "  -c       compile the shaders too, with the compiler set in the preferences\n"
+		<< "  -C DIR   Prawn's directory (blocks and data), the current directory by default\n"
+		<< "  -v       output the warnings of every scene (only the errors of failed scenes by default)\n"
+		<< "  -h       show this help\n";
+}
+
+
+bool make_directory (const std::string& Directory)
+{
+#if defined _WIN32
+	mkdir (Directory.c_str());
+#else
+	mkdir (Directory.c_str(), 0777);
+#endif
+
+	struct stat status;
+	return stat (Directory.c_str(), &status) == 0 && (status.st_mode & S_IFDIR);
+}
+
+
+// scene file name without its directory and extension
+std::string scene_name (const std::string& File)
+{
+	const std::string::size_type slash = File.find_last_of ("/\\");
+	std::string name = slash == std::string::npos ? File : File.substr (slash + 1);
+
+	const std::string::size_type dot = name.rfind ('.');
+	if (dot != std::string::npos && dot > 0) {
+		name.erase (dot);
+	}
+
+	return name;
+}
+
+
+void process_scene (scene& Scene, scene_job_t& Job, const bool Compile)
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	log_capture capture;
+
+	Job.succeeded = false;
+	if (!make_directory (Job.directory)) {
+		log() << error << "couldn't create directory '" << Job.directory << "'" << std::endl;
+	}
+	else if (Scene.load (Job.file)) {
+		Job.succeeded = Scene.export_scene (Job.directory, Compile);
+	}
+
+	// unknown blocks and failed connections are only logged, the exported scene would be incomplete
+	if (capture.errors() > 0) {
+		Job.succeeded = false;
+	}
+
+	Job.log = capture.str();
+	Job.seconds = std::chrono::duration<double> (std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+
+int main (int argc, char** argv)
+{
+	std::string output_directory (".");
+	std::string prawn_directory ("");
+	unsigned int workers = 0;
+	bool compile = false;
+	bool verbose = false;
+
+	std::vector<std::string> files;
+	for (int a = 1; a < argc; ++a) {
+
+		const std::string argument (argv[a]);
+		const bool has_value = a + 1 < argc;
+		if (argument == "-o" && has_value) {
+			output_directory = argv[++a];
+		} else if (argument == "-j" && has_value) {
+			workers = std::atoi (argv[++a]);
+		} else if (argument == "-C" && has_value) {
+			prawn_directory = argv[++a];
+		} else if (argument == "-c") {
+			compile = true;
+		} else if (argument == "-v") {
+			verbose = true;
+		} else if (argument == "-h" || argument == "--help") {
+			usage (std::cout);
+			return 0;
+		} else if (!argument.empty() && argument[0] == '-') {
+			std::cerr << "prawn-batch: unknown option '" << argument << "'\n";
+			usage (std::cerr);
+			return 2;
+		} else {
+			files.push_back (argument);
+		}
+	}
+
+	if (files.empty()) {
+		usage (std::cerr);
+		return 2;
+	}
+
+	// only errors, or warnings too, are kept
+	std::unique_ptr<std::streambuf> filter_level (new filter_by_level_buf (verbose ? WARNING : ERROR, log()));
+
+	// the paths are made absolute before moving to Prawn's directory
+	output_directory = system_functions::get_absolute_path (output_directory);
+	if (!make_directory (output_directory)) {
+		std::cerr << "prawn-batch: couldn't create output directory '" << output_directory << "'\n";
+		return 2;
+	}
+
+	std::vector<scene_job_t> jobs (files.size());
+	std::map<std::string, std::string> output_files;
+	for (std::vector<std::string>::size_type f = 0; f < files.size(); ++f) {
+
+		jobs[f].file = system_functions::get_absolute_path (files[f]);
+		jobs[f].directory = output_directory + '/' + scene_name (files[f]);
+		jobs[f].succeeded = false;
+		jobs[f].seconds = 0;
+
+		// two scenes can't share an output directory
+		const std::map<std::string, std::string>::const_iterator other = output_files.find (jobs[f].directory);
+		if (other != output_files.end()) {
+			std::cerr << "prawn-batch: '" << files[f] << "' and '" << other->second << "' would both be written to " << jobs[f].directory << "\n";
+			return 2;
+		}
+		output_files[jobs[f].directory] = files[f];
+	}
+
+	if (!prawn_directory.empty() && chdir (prawn_directory.c_str()) != 0) {
+		std::cerr << "prawn-batch: couldn't change to directory '" << prawn_directory << "'\n";
+		return 2;
+	}
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// each worker processes scenes with its own scene object; they're created up front,
+	// one after the other, so that the block library cache is updated once
+	if (!workers) {
+		workers = thread_pool::hardware_threads();
+	}
+	if (workers > jobs.size()) {
+		workers = jobs.size();
+	}
+
+	std::vector<std::unique_ptr<scene> > scenes;
+	for (unsigned int w = 0; w < workers; ++w) {
+		scenes.push_back (std::unique_ptr<scene> (new scene()));
+	}
+
+	std::atomic<std::vector<scene_job_t>::size_type> next_job (0);
+	{
+		thread_pool pool (workers);
+		for (unsigned int w = 0; w < workers; ++w) {
+
+			scene* worker_scene = scenes[w].get();
+			pool.push ([worker_scene, &jobs, &next_job, compile] {
+
+				for (std::vector<scene_job_t>::size_type j = next_job++; j < jobs.size(); j = next_job++) {
+					process_scene (*worker_scene, jobs[j], compile);
+				}
+			});
+		}
+		pool.wait();
+	}
+
+	// report, in the order the scenes were given
+	unsigned long failures = 0;
+	for (std::vector<scene_job_t>::const_iterator job = jobs.begin(); job != jobs.end(); ++job) {
+
+		if (!job->succeeded) {
+			++failures;
+		}
+
+		std::cout << (job->succeeded ? "ok     " : "FAILED ") << std::fixed << std::setprecision (3) << std::setw (8) << job->seconds << "s  " << job->file << "\n";
+		if (!job->succeeded || verbose) {
+			std::cout << job->log;
+		}
+	}
+
+	const double seconds = std::chrono::duration<double> (std::chrono::steady_clock::now() - start).count();
+	std::cout << jobs.size() << " scene(s), " << failures << " failed, " << std::fixed << std::setprecision (3) << seconds << "s with " << workers << " worker(s)" << std::endl;
+
+	return failures ? 1 : 0;
+}
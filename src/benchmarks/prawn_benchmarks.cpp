@@ -0,0 +1,998 @@
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// prawn-benchmarks: timings of the shading core, written as JSON
+//
+// Times the block library load, scene loading and saving, shader code generation on the
+// shipped examples and on synthetic networks (up to 100k blocks), and a few functions called
+// for every block or value. Each benchmark runs a fixed number of times and reports its
+// minimum, median and mean. Some checks of the generated code run along, the exit status
+// is non-zero when one fails.
+//
+// The preferences and the block library cache are kept in a work directory instead of
+// ~/.shrimp, so that results don't depend on the user's settings.
+
+#include "../shading/code_template.h"
+#include "../shading/preferences.h"
+#include "../shading/scene.h"
+#include "../miscellaneous/logging.h"
+#include "../miscellaneous/misc_string_functions.h"
+#include "../miscellaneous/misc_system_functions.h"
+#include "../miscellaneous/misc_thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#if defined _WIN32
+# include <direct.h>
+# define chdir _chdir
+#else
+# include <unistd.h>
+#endif
+
+
+namespace
+{
+
+// timings of a benchmark, one per repetition
+struct benchmark_t
+{
+	std::string name;
+	// number of items (scenes, blocks, calls...) processed by a repetition
+	unsigned long items;
+	std::vector<double> seconds;
+};
+
+// a verification of the generated code
+struct check_t
+{
+	std::string name;
+	bool passed;
+	std::string detail;
+};
+
+
+class benchmark_suite
+{
+public:
+	benchmark_suite (const unsigned int Repetitions, const std::string& Filter) :
+		m_repetitions (Repetitions),
+		m_filter (Filter) {
+	}
+
+	unsigned int repetitions() const { return m_repetitions; }
+
+	// whether a benchmark or check was asked for (its name starts with the filter)
+	bool selected (const std::string& Name) const {
+		return Name.compare (0, m_filter.size(), m_filter) == 0;
+	}
+
+	// whether some benchmarks of a group were asked for, given their name prefix
+	bool selected_group (const std::string& Prefix) const {
+		return selected (Prefix) || m_filter.compare (0, Prefix.size(), Prefix) == 0;
+	}
+
+	// time one call
+	static double time (const std::function<void()>& Function) {
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		Function();
+		return std::chrono::duration<double> (std::chrono::steady_clock::now() - start).count();
+	}
+
+	// add a repetition's timing to a benchmark
+	void add_sample (const std::string& Name, const unsigned long Items, const double Seconds) {
+
+		if (!selected (Name)) {
+			return;
+		}
+
+		for (std::vector<benchmark_t>::iterator b = m_benchmarks.begin(); b != m_benchmarks.end(); ++b) {
+			if (b->name == Name) {
+				b->seconds.push_back (Seconds);
+				return;
+			}
+		}
+
+		benchmark_t benchmark;
+		benchmark.name = Name;
+		benchmark.items = Items;
+		benchmark.seconds.push_back (Seconds);
+		m_benchmarks.push_back (benchmark);
+
+		std::cerr << Name << std::endl;
+	}
+
+	// run a benchmark: Setup isn't timed, it's called before each repetition of Measured
+	void run (const std::string& Name, const unsigned long Items, const std::function<void()>& Setup, const std::function<void()>& Measured) {
+
+		if (!selected (Name)) {
+			return;
+		}
+
+		for (unsigned int r = 0; r < m_repetitions; ++r) {
+			Setup();
+			add_sample (Name, Items, time (Measured));
+		}
+	}
+
+	void run (const std::string& Name, const unsigned long Items, const std::function<void()>& Measured) {
+		run (Name, Items, [] {}, Measured);
+	}
+
+	void check (const std::string& Name, const bool Passed, const std::string& Detail = "") {
+
+		if (!selected (Name)) {
+			return;
+		}
+
+		check_t check;
+		check.name = Name;
+		check.passed = Passed;
+		check.detail = Detail;
+		m_checks.push_back (check);
+
+		if (!Passed) {
+			std::cerr << "check failed: " << Name << (Detail.empty() ? "" : ": ") << Detail << std::endl;
+		}
+	}
+
+	unsigned long failed_checks() const {
+		unsigned long failures = 0;
+		for (std::vector<check_t>::const_iterator c = m_checks.begin(); c != m_checks.end(); ++c) {
+			if (!c->passed) {
+				++failures;
+			}
+		}
+
+		return failures;
+	}
+
+	void write_json (std::ostream& Stream) const;
+
+private:
+	const unsigned int m_repetitions;
+	const std::string m_filter;
+
+	std::vector<benchmark_t> m_benchmarks;
+	std::vector<check_t> m_checks;
+};
+
+
+std::string json_string (const std::string& Text)
+{
+	std::ostringstream json;
+	json << '"';
+	for (std::string::const_iterator c = Text.begin(); c != Text.end(); ++c) {
+		switch (*c) {
+			case '"': json << "\\\""; break;
+			case '\\': json << "\\\\"; break;
+			case '\n': json << "\\n"; break;
+			case '\r': json << "\\r"; break;
+			case '\t': json << "\\t"; break;
+			default:
+				if (static_cast<unsigned char> (*c) < 0x20) {
+					json << "\\u" << std::hex << std::setw (4) << std::setfill ('0') << static_cast<int> (*c) << std::dec << std::setfill (' ');
+				} else {
+					json << *c;
+				}
+		}
+	}
+	json << '"';
+
+	return json.str();
+}
+
+
+void benchmark_suite::write_json (std::ostream& Stream) const
+{
+	char date[32] = "";
+	const std::time_t now = std::time (0);
+	std::strftime (date, sizeof (date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime (&now));
+
+	Stream << "{\n"
+		<< "  \"suite\": \"prawn-benchmarks\",\n"
+		<< "  \"date\": " << json_string (date) << ",\n"
+		<< "  \"repetitions\": " << m_repetitions << ",\n"
+		<< "  \"hardware_threads\": " << thread_pool::hardware_threads() << ",\n"
+		<< "  \"benchmarks\": [";
+
+	Stream << std::setprecision (9);
+	for (std::vector<benchmark_t>::const_iterator b = m_benchmarks.begin(); b != m_benchmarks.end(); ++b) {
+
+		std::vector<double> seconds (b->seconds);
+		std::sort (seconds.begin(), seconds.end());
+
+		const std::vector<double>::size_type middle = seconds.size() / 2;
+		const double median = seconds.size() % 2 ? seconds[middle] : (seconds[middle - 1] + seconds[middle]) / 2;
+		double total = 0;
+		for (std::vector<double>::const_iterator s = seconds.begin(); s != seconds.end(); ++s) {
+			total += *s;
+		}
+
+		Stream << (b == m_benchmarks.begin() ? "\n" : ",\n")
+			<< "    {\"name\": " << json_string (b->name)
+			<< ", \"items\": " << b->items
+			<< ", \"repetitions\": " << seconds.size()
+			<< ", \"min_s\": " << seconds.front()
+			<< ", \"median_s\": " << median
+			<< ", \"mean_s\": " << total / seconds.size()
+			<< ", \"max_s\": " << seconds.back()
+			<< ", \"items_per_s\": " << (median > 0 ? b->items / median : 0)
+			<< "}";
+	}
+
+	Stream << "\n  ],\n"
+		<< "  \"checks\": [";
+
+	for (std::vector<check_t>::const_iterator c = m_checks.begin(); c != m_checks.end(); ++c) {
+
+		Stream << (c == m_checks.begin() ? "\n" : ",\n")
+			<< "    {\"name\": " << json_string (c->name)
+			<< ", \"passed\": " << (c->passed ? "true" : "false")
+			<< ", \"detail\": " << json_string (c->detail)
+			<< "}";
+	}
+
+	Stream << "\n  ]\n"
+		<< "}\n";
+}
+
+
+void usage (std::ostream& Stream)
+{
+	Stream << "usage: prawn-benchmarks [options]\n"
+		<< "\n"
+		<< "Times the shading core and writes the results as JSON.\n"
+		<< "\n"
+		<< "options:\n"
+		<< "  -o FILE  JSON output file (default: standard output)\n"
+		<< "  -r N     repetitions of each benchmark (default: 5)\n"
+		<< "  -n N     blocks in the largest synthetic network (default: 100000)\n"
+		<< "  -f NAME  only run the benchmarks and checks whose name starts with NAME\n"
+		<< "  -w DIR   work directory, replaces ~/.shrimp (default: ./benchmark_work)\n"
+		<< "  -C DIR   Prawn's directory (blocks, data and examples), the current directory by default\n"
+		<< "  -x SCENE DIR  only export SCENE to DIR, then exit (used to compare exports between processes)\n"
+		<< "  -h       show this help\n";
+}
+
+
+bool make_directory (const std::string& Directory)
+{
+#if defined _WIN32
+	mkdir (Directory.c_str());
+#else
+	mkdir (Directory.c_str(), 0777);
+#endif
+
+	return system_functions::is_directory (Directory);
+}
+
+
+std::string read_file (const std::string& File)
+{
+	std::ifstream file (File.c_str(), std::ios::in | std::ios::binary);
+	std::ostringstream content;
+	content << file.rdbuf();
+
+	return content.str();
+}
+
+
+// content of the files written in a directory, by name
+std::string directory_content (const std::string& Directory)
+{
+	std::vector<std::string> files;
+	system_functions::list_directory (Directory, files);
+
+	std::string content;
+	for (std::vector<std::string>::const_iterator f = files.begin(); f != files.end(); ++f) {
+		content += *f + '\n' + read_file (Directory + '/' + *f) + '\n';
+	}
+
+	return content;
+}
+
+
+std::vector<shader_block*> blocks_by_name (scene& Scene)
+{
+	const shrimp::shader_blocks_t blocks = Scene.get_scene_blocks();
+	std::vector<shader_block*> sorted (blocks.begin(), blocks.end());
+	std::sort (sorted.begin(), sorted.end(), [] (const shader_block* A, const shader_block* B) { return A->name() < B->name(); });
+
+	return sorted;
+}
+
+
+// the edits a user makes between two previews: a value change and a renamed block
+void edit_scene (scene& Scene)
+{
+	const std::vector<shader_block*> blocks = blocks_by_name (Scene);
+
+	bool value_changed = false;
+	for (std::vector<shader_block*>::const_iterator b = blocks.begin(); b != blocks.end() && !value_changed; ++b) {
+		for (shader_block::properties_t::const_iterator i = (*b)->m_inputs.begin(); i != (*b)->m_inputs.end(); ++i) {
+
+			if (i->get_type() == "float" && !Scene.is_connected (*b, *i)) {
+				(*b)->set_input_value (i->m_name, "0.123");
+				value_changed = true;
+				break;
+			}
+		}
+	}
+
+	for (std::vector<shader_block*>::const_iterator b = blocks.begin(); b != blocks.end(); ++b) {
+		if (!(*b)->m_root_block && !(*b)->m_outputs.empty()) {
+			Scene.set_block_name (*b, (*b)->name() + "Edited");
+			break;
+		}
+	}
+}
+
+
+// a chain of Multiply blocks, the first one connected to the root block's colour (or another root input)
+std::vector<shader_block*> build_chain (scene& Scene, const unsigned long Length, const std::string& RootInput = "Ci")
+{
+	std::vector<shader_block*> chain;
+	for (unsigned long b = 0; b < Length; ++b) {
+		chain.push_back (Scene.add_predefined_block ("Multiply"));
+	}
+
+	for (unsigned long b = 0; b + 1 < Length; ++b) {
+		Scene.connect (shrimp::io_t (chain[b]->name(), "A"), shrimp::io_t (chain[b + 1]->name(), "value"));
+	}
+	Scene.connect (shrimp::io_t (Scene.get_root_block()->name(), RootInput), shrimp::io_t (chain[0]->name(), "value"));
+
+	return chain;
+}
+
+
+// an Add block summing Texture blocks (many multi-inputs, and local declarations from the texture code)
+shader_block* build_fan_in (scene& Scene, const unsigned long Width)
+{
+	shader_block* sum = Scene.add_predefined_block ("Add");
+	for (unsigned long b = 0; b < Width; ++b) {
+
+		shader_block* texture = Scene.add_predefined_block ("Texture");
+		Scene.connect (shrimp::io_t (sum->name(), b ? "B" : "A"), shrimp::io_t (texture->name(), "value"));
+	}
+	Scene.connect (shrimp::io_t (Scene.get_root_block()->name(), "Ci"), shrimp::io_t (sum->name(), "value"));
+
+	return sum;
+}
+
+
+// a block indexing each of its inputs (floats and colours): every indexed input is copied to
+// a local variable, declared with the type of its input
+shader_block* build_many_locals (scene& Scene, const unsigned long Inputs)
+{
+	shader_block* block = Scene.add_custom_block ("Locals");
+	block->add_output ("value", "float", "", "varying", "sum of the inputs' first components", false);
+
+	std::string code ("$(value) = 0");
+	for (unsigned long i = 0; i < Inputs; ++i) {
+
+		const std::string input = "in_" + string_cast (i);
+		block->add_input (input, i % 2 ? "color" : "float", "", "varying", "", "1", "", false);
+		code += " + $(" + input + ")[0]";
+	}
+	block->set_code (code + ";");
+
+	Scene.connect (shrimp::io_t (Scene.get_root_block()->name(), "Oi"), shrimp::io_t (block->name(), "value"));
+
+	return block;
+}
+
+
+void benchmark_library (benchmark_suite& Suite)
+{
+	const std::string cache_file = system_functions::get_shrimp_user_directory() + "/block_cache.bin";
+
+	std::unique_ptr<scene> library;
+	Suite.run ("library_load/parse", 1, [&] { library.reset(); std::remove (cache_file.c_str()); }, [&] { library.reset (new scene()); });
+	Suite.run ("library_load/cached", 1, [&] { library.reset(); }, [&] { library.reset (new scene()); });
+
+	// library blocks are parsed when they're first added to the scene (they come from the cache here)
+	Suite.run ("library_load/first_blocks", 2, [&] { library.reset (new scene()); }, [&] {
+		library->add_predefined_block ("Multiply");
+		library->add_predefined_block ("Texture");
+	});
+}
+
+
+void benchmark_examples (benchmark_suite& Suite, const std::vector<std::string>& Examples, const std::string& WorkDirectory, const std::string& Program)
+{
+	if (!Suite.selected_group ("examples/") || Examples.empty()) {
+		return;
+	}
+
+	// one scene per example, the block library is loaded once for each
+	std::vector<std::unique_ptr<scene> > scenes;
+	for (std::vector<std::string>::size_type e = 0; e < Examples.size(); ++e) {
+		scenes.push_back (std::unique_ptr<scene> (new scene()));
+	}
+
+	const unsigned long count = Examples.size();
+	const auto load_all = [&] {
+		for (std::vector<std::string>::size_type e = 0; e < Examples.size(); ++e) {
+			scenes[e]->load (Examples[e]);
+		}
+	};
+
+	Suite.run ("examples/load", count, load_all);
+
+	const std::string saved_file = WorkDirectory + "/saved_scene.xml";
+	Suite.run ("examples/save_as", count, [&] {
+		for (std::vector<std::unique_ptr<scene> >::iterator s = scenes.begin(); s != scenes.end(); ++s) {
+			(*s)->save_as (saved_file);
+		}
+	});
+
+	// shader code of freshly loaded scenes, then again without any change (the block code is reused)
+	std::vector<std::string> code (Examples.size());
+	Suite.run ("examples/shader_code", count, load_all, [&] {
+		for (std::vector<std::string>::size_type e = 0; e < Examples.size(); ++e) {
+			code[e] = scenes[e]->get_shader_code();
+		}
+	});
+	Suite.run ("examples/shader_code_unchanged", count, [&] {
+		for (std::vector<std::string>::size_type e = 0; e < Examples.size(); ++e) {
+			code[e] = scenes[e]->get_shader_code();
+		}
+	});
+	Suite.run ("examples/shader_code_after_edit", count, [&] {
+		load_all();
+		for (std::vector<std::unique_ptr<scene> >::iterator s = scenes.begin(); s != scenes.end(); ++s) {
+			(*s)->get_shader_code();
+			edit_scene (**s);
+		}
+	}, [&] {
+		for (std::vector<std::string>::size_type e = 0; e < Examples.size(); ++e) {
+			code[e] = scenes[e]->get_shader_code();
+		}
+	});
+
+	// the code generated after edits is the code of a scene loaded with the same edits
+	if (Suite.selected ("examples/edited_code_matches_fresh_scene")) {
+
+		std::string mismatches;
+		for (std::vector<std::string>::size_type e = 0; e < Examples.size(); ++e) {
+
+			scenes[e]->load (Examples[e]);
+			scenes[e]->get_shader_code();
+			edit_scene (*scenes[e]);
+			const std::string edited = scenes[e]->get_shader_code();
+
+			scene fresh;
+			fresh.load (Examples[e]);
+			edit_scene (fresh);
+			if (edited != fresh.get_shader_code()) {
+				mismatches += (mismatches.empty() ? "" : " ") + Examples[e];
+			}
+		}
+
+		Suite.check ("examples/edited_code_matches_fresh_scene", mismatches.empty(), mismatches);
+	}
+
+	// what prawn-batch does for each scene: write the shaders, slmeta and RIB files
+	const std::string export_directory = WorkDirectory + "/export";
+	make_directory (export_directory);
+	std::vector<std::string> directories;
+	for (std::vector<std::string>::size_type e = 0; e < Examples.size(); ++e) {
+
+		std::ostringstream directory;
+		directory << export_directory << '/' << e;
+		make_directory (directory.str());
+		directories.push_back (directory.str());
+	}
+
+	Suite.run ("examples/export", count, [&] {
+		for (std::vector<std::string>::size_type e = 0; e < Examples.size(); ++e) {
+			scenes[e]->load (Examples[e]);
+			scenes[e]->export_scene (directories[e]);
+		}
+	});
+
+	// exported files are the same byte for byte when exported again by another process
+	// (blocks are allocated at other addresses, in another order)
+	if (Suite.selected ("examples/export_is_reproducible")) {
+
+		std::string differences;
+		for (std::vector<std::string>::size_type e = 0; e < Examples.size(); ++e) {
+
+			scenes[e]->load (Examples[e]);
+			scenes[e]->export_scene (directories[e]);
+			const std::string first = directory_content (directories[e]);
+
+			const std::string command = "\"" + Program + "\" -w \"" + WorkDirectory + "\" -x \"" + Examples[e] + "\" \"" + directories[e] + "\"";
+			if (std::system (command.c_str()) != 0 || first != directory_content (directories[e])) {
+				differences += (differences.empty() ? "" : " ") + Examples[e];
+			}
+		}
+
+		Suite.check ("examples/export_is_reproducible", differences.empty(), differences);
+	}
+
+	// block hit-testing on the scene's block geometry (with the view's 0.5 minimum block height): a grid of points over each scene
+	const unsigned long grid = 32;
+	Suite.run ("examples/pick_block", count * grid * grid, [&] {
+		for (std::vector<std::unique_ptr<scene> >::iterator s = scenes.begin(); s != scenes.end(); ++s) {
+
+			double left = 0, right = 0, bottom = 0, top = 0;
+			const shrimp::shader_blocks_t blocks = (*s)->get_scene_blocks();
+			for (shrimp::shader_blocks_t::const_iterator b = blocks.begin(); b != blocks.end(); ++b) {
+				left = std::min (left, (*b)->m_position_x);
+				right = std::max (right, (*b)->m_position_x + (*b)->m_width);
+				bottom = std::min (bottom, (*b)->m_position_y - (*b)->m_height);
+				top = std::max (top, (*b)->m_position_y);
+			}
+
+			for (unsigned long x = 0; x < grid; ++x) {
+				for (unsigned long y = 0; y < grid; ++y) {
+					(*s)->get_block_at (left + (right - left) * x / grid, bottom + (top - bottom) * y / grid, 0.5);
+				}
+			}
+		}
+	});
+}
+
+
+void benchmark_networks (benchmark_suite& Suite, const unsigned long LargestNetwork, const std::string& WorkDirectory)
+{
+	// chains of 1k, 10k and 100k blocks: building, code generation (recursion-free walk),
+	// and code generation again after a value change (only the changed block is expanded again)
+	for (unsigned long length = 1000; length <= LargestNetwork; length *= 10) {
+
+		std::ostringstream prefix;
+		prefix << "chain_" << length << '/';
+		if (!Suite.selected_group (prefix.str())) {
+			continue;
+		}
+
+		for (unsigned int r = 0; r < Suite.repetitions(); ++r) {
+
+			std::unique_ptr<scene> network (new scene());
+
+			std::vector<shader_block*> chain;
+			Suite.add_sample (prefix.str() + "build", length, benchmark_suite::time ([&] { chain = build_chain (*network, length); }));
+
+			std::string code;
+			Suite.add_sample (prefix.str() + "shader_code", length, benchmark_suite::time ([&] { code = network->get_shader_code(); }));
+			if (!r) {
+				Suite.check (prefix.str() + "shader_code_complete", code.find (chain.back()->sl_name()) != std::string::npos);
+			}
+
+			chain[length / 2]->set_input_value ("B", "2");
+			Suite.add_sample (prefix.str() + "shader_code_after_edit", length, benchmark_suite::time ([&] { code = network->get_shader_code(); }));
+
+			if (!r && length == 1000) {
+				scene fresh;
+				std::vector<shader_block*> fresh_chain = build_chain (fresh, length);
+				fresh_chain[length / 2]->set_input_value ("B", "2");
+				Suite.check (prefix.str() + "edited_code_matches_fresh_scene", code == fresh.get_shader_code());
+			}
+
+			Suite.add_sample (prefix.str() + "destroy", length, benchmark_suite::time ([&] { network.reset(); }));
+		}
+	}
+
+	// the deepest chain, walked by each traversal (a recursive walk would overflow the stack),
+	// then closed into a cycle: the walk reports it instead of looping
+	if (Suite.selected_group ("deep_chain/") && LargestNetwork) {
+
+		scene network;
+		std::vector<shader_block*> chain = build_chain (network, LargestNetwork);
+
+		shrimp::shader_blocks_t upward;
+		network.upward_blocks (chain.front(), upward);
+		Suite.check ("deep_chain/upward_blocks", upward.size() == chain.size());
+
+		const std::string code = network.get_shader_code();
+		Suite.check ("deep_chain/shader_code_complete", code.find (chain.front()->sl_name() + "_value") != std::string::npos
+			&& code.find (chain.back()->sl_name() + "_value") != std::string::npos);
+
+		if (Suite.selected ("deep_chain/cycle_reported")) {
+
+			network.connect (shrimp::io_t (chain.back()->name(), "A"), shrimp::io_t (chain.front()->name(), "value"));
+
+			log_capture messages;
+			network.get_shader_code();
+			Suite.check ("deep_chain/cycle_reported", messages.errors() > 0);
+		}
+	}
+
+	// a chain of 10k blocks for each shader (surface, displacement, light and atmosphere): the four
+	// shaders built one after the other, then concurrently (the block code is up to date, the
+	// builds only walk the network and write the shaders)
+	const unsigned long shader_chain = std::min (LargestNetwork, 10000ul);
+	std::ostringstream shaders_prefix;
+	shaders_prefix << "shaders_4x" << shader_chain << '/';
+	if (Suite.selected_group (shaders_prefix.str())) {
+
+		scene network;
+		const char* root_inputs[] = { "Ci", "P", "Cl", "Cv" };
+		std::vector<std::string> chain_ends;
+		for (unsigned int i = 0; i < 4; ++i) {
+			chain_ends.push_back (build_chain (network, shader_chain, root_inputs[i]).back()->sl_name());
+		}
+		network.get_shader_code();
+
+		Suite.run (shaders_prefix.str() + "serial", 4 * shader_chain, [&] { network.get_shader_code (1); });
+		Suite.run (shaders_prefix.str() + "concurrent", 4 * shader_chain, [&] { network.get_shader_code(); });
+
+		// the four shaders hold their whole chain, and are the same when built by one thread as by four
+		if (Suite.selected (shaders_prefix.str() + "concurrent_matches_serial")) {
+
+			const std::string serial_code = network.get_shader_code (1);
+			bool complete = true;
+			for (std::vector<std::string>::const_iterator end = chain_ends.begin(); end != chain_ends.end(); ++end) {
+				complete = complete && serial_code.find (*end + "_value") != std::string::npos;
+			}
+			Suite.check (shaders_prefix.str() + "concurrent_matches_serial", complete && serial_code == network.get_shader_code());
+		}
+	}
+
+	// an Add block fed by 1k and 10k Texture blocks: multi-inputs and many local declarations
+	for (unsigned long width = 1000; width <= LargestNetwork && width <= 10000; width *= 10) {
+
+		std::ostringstream prefix;
+		prefix << "fan_in_" << width << '/';
+		if (!Suite.selected_group (prefix.str())) {
+			continue;
+		}
+
+		for (unsigned int r = 0; r < Suite.repetitions(); ++r) {
+
+			scene network;
+
+			shader_block* sum = 0;
+			Suite.add_sample (prefix.str() + "build", width, benchmark_suite::time ([&] { sum = build_fan_in (network, width); }));
+
+			std::string code;
+			Suite.add_sample (prefix.str() + "shader_code", width, benchmark_suite::time ([&] { code = network.get_shader_code(); }));
+
+			// input lookups by name, on the block with the multi-inputs
+			std::vector<std::string> inputs;
+			for (shader_block::properties_t::const_iterator i = sum->m_inputs.begin(); i != sum->m_inputs.end(); ++i) {
+				inputs.push_back (i->m_name);
+			}
+
+			unsigned long found = 0;
+			Suite.add_sample (prefix.str() + "input_lookup", inputs.size(), benchmark_suite::time ([&] {
+				for (std::vector<std::string>::const_iterator i = inputs.begin(); i != inputs.end(); ++i) {
+					found += sum->is_input (*i) && !sum->get_input_type (*i).empty();
+				}
+			}));
+
+			// the same lookups scanning the inputs, as the accessors did before the name index
+			unsigned long scanned = 0;
+			Suite.add_sample (prefix.str() + "input_lookup_scan", inputs.size(), benchmark_suite::time ([&] {
+				for (std::vector<std::string>::const_iterator i = inputs.begin(); i != inputs.end(); ++i) {
+					for (shader_block::properties_t::const_iterator input = sum->m_inputs.begin(); input != sum->m_inputs.end(); ++input) {
+						if (input->m_name == *i) {
+							scanned += !input->get_type().empty();
+							break;
+						}
+					}
+				}
+			}));
+
+			if (!r) {
+				Suite.check (prefix.str() + "multi_inputs", found == inputs.size() && scanned == inputs.size() && inputs.size() == width);
+
+				// the inputs keep their declaration order: A, B, then B's multi-inputs as they were added
+				bool ordered = inputs.size() > 1 && inputs[0] == "A" && inputs[1] == "B";
+				for (std::vector<std::string>::size_type i = 2; i < inputs.size() && ordered; ++i) {
+					ordered = inputs[i] == "B_" + string_cast (i);
+				}
+				Suite.check (prefix.str() + "inputs_in_declaration_order", ordered);
+			}
+		}
+	}
+
+	// a block with 1k and 10k local declarations: their types are resolved once per local
+	for (unsigned long count = 1000; count <= LargestNetwork && count <= 10000; count *= 10) {
+
+		std::ostringstream prefix;
+		prefix << "locals_" << count << '/';
+		if (!Suite.selected_group (prefix.str())) {
+			continue;
+		}
+
+		for (unsigned int r = 0; r < Suite.repetitions(); ++r) {
+
+			scene network;
+			build_many_locals (network, count);
+
+			std::string code;
+			Suite.add_sample (prefix.str() + "shader_code", count, benchmark_suite::time ([&] { code = network.get_shader_code(); }));
+
+			// each local is declared once, with its input's type
+			if (!r) {
+				bool typed = code.find ("$(") == std::string::npos;
+				for (unsigned long i = 0; i < count && typed; ++i) {
+
+					const std::string declaration = std::string (i % 2 ? "color" : "float") + " valued_variable_in_" + string_cast (i) + ";";
+					const std::string::size_type position = code.find (declaration);
+					typed = position != std::string::npos && code.find (declaration, position + 1) == std::string::npos;
+				}
+				Suite.check (prefix.str() + "locals_typed", typed);
+			}
+		}
+	}
+
+	// a value change of a shader parameter is passed through RIB (the compiled shader stays the same)
+	if (Suite.selected ("rib/parameter_value")) {
+
+		scene network;
+		std::vector<shader_block*> chain = build_chain (network, 2);
+		chain[1]->set_shader_parameter ("B", true);
+		chain[1]->set_input_value ("B", "0.375");
+
+		const std::string directory = WorkDirectory + "/parameters";
+		make_directory (directory);
+		network.export_scene (directory);
+
+		const std::string rib = read_file (directory + "/preview.rib");
+		Suite.check ("rib/parameter_value", rib.find ("0.375") != std::string::npos);
+	}
+
+	// a point parameter keeps its value in the shader: through RIB, it would be transformed
+	// from the space current at the Surface call, and the preview would differ from the export
+	if (Suite.selected ("rib/point_parameter")) {
+
+		scene network;
+		std::vector<shader_block*> chain = build_chain (network, 2);
+		chain[1]->set_input_type ("B", "point");
+		chain[1]->set_shader_parameter ("B", true);
+		chain[1]->set_input_value ("B", "point (1, 2, 3)");
+
+		const std::string directory = WorkDirectory + "/point_parameter";
+		make_directory (directory);
+		network.export_scene (directory);
+
+		const std::string declaration = "point " + chain[1]->sl_name() + "_B";
+		const std::string rib = read_file (directory + "/preview.rib");
+		const std::string shader = read_file (directory + "/preview_surface.sl");
+		Suite.check ("rib/point_parameter", rib.find (declaration) == std::string::npos
+			&& shader.find (declaration + " = point (1, 2, 3)") != std::string::npos);
+	}
+}
+
+
+void benchmark_functions (benchmark_suite& Suite)
+{
+	// parameter values as written in shaders and in RIB
+	std::vector<property> values;
+	const char* samples[][2] = {
+		{ "float", "0.5" },
+		{ "color", "color (0.1, 0.2, 0.3)" },
+		{ "color", "0.8" },
+		{ "point", "point (1, 2, 3)" },
+		{ "vector", "0 0 1" },
+		{ "normal", "normal (0, 1, 0)" },
+		{ "matrix", "matrix (1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1)" },
+		{ "string", "\"texture.tx\"" },
+	};
+	for (size_t s = 0; s < sizeof (samples) / sizeof (samples[0]); ++s) {
+
+		property value ("value");
+		value.add_possible_types (samples[s][0]);
+		value.set_type (samples[s][0]);
+		value.set_value (samples[s][1]);
+		values.push_back (value);
+	}
+
+	const unsigned long calls = 100000;
+	std::string output;
+	Suite.run ("functions/value_as_sl_string", calls, [&] {
+		for (unsigned long c = 0; c < calls; ++c) {
+			output = values[c % values.size()].value_as_sl_string();
+		}
+	});
+	Suite.run ("functions/value_as_rib_values", calls, [&] {
+		for (unsigned long c = 0; c < calls; ++c) {
+			values[c % values.size()].value_as_rib_values (output);
+		}
+	});
+
+	// tag substitution in block code: one replace_variable pass per tag, and a code template
+	std::string code;
+	for (unsigned int l = 0; l < 1000; ++l) {
+		code += "\t$(value) = $(A) * $(B) + $(value:type) (0);\n";
+	}
+
+	code_template::values_t tags;
+	tags["value"] = "Multiply_value";
+	tags["A"] = "Multiply_A";
+	tags["B"] = "Multiply_B";
+	tags["value:type"] = "color";
+
+	const unsigned long expansions = 100;
+	std::string replaced;
+	Suite.run ("functions/replace_variable", expansions, [&] {
+		for (unsigned long e = 0; e < expansions; ++e) {
+			replaced = code;
+			for (code_template::values_t::const_iterator t = tags.begin(); t != tags.end(); ++t) {
+				replace_variable (replaced, "$(" + t->first + ")", t->second);
+			}
+		}
+	});
+
+	std::shared_ptr<const code_template> expander = code_template::get (shared_string (code));
+	std::string expanded;
+	Suite.run ("functions/code_template_expand", expansions, [&] {
+		for (unsigned long e = 0; e < expansions; ++e) {
+			expanded.clear();
+			expander->expand (tags, expanded);
+		}
+	});
+	Suite.check ("functions/code_template_matches_replace_variable", replaced.empty() || expanded == replaced);
+
+	// preferences: the shared snapshot and a full load
+	const unsigned long reads = 1000;
+	std::shared_ptr<const general_options> snapshot;
+	Suite.run ("preferences/current", reads, [&] {
+		for (unsigned long r = 0; r < reads; ++r) {
+			snapshot = general_options::current();
+		}
+	});
+	Suite.run ("preferences/load", reads / 10, [&] {
+		for (unsigned long r = 0; r < reads / 10; ++r) {
+			general_options options;
+			options.load();
+		}
+	});
+
+	if (Suite.selected_group ("preferences/snapshot")) {
+
+		const std::shared_ptr<const general_options> first = general_options::current();
+		const bool shared = general_options::current() == first;
+
+		general_options options;
+		options.load();
+		options.save();
+		const bool reloaded = general_options::current() != first;
+
+		Suite.check ("preferences/snapshot_shared", shared);
+		Suite.check ("preferences/snapshot_reloaded_after_save", reloaded);
+	}
+}
+
+}
+
+
+int main (int argc, char** argv)
+{
+	unsigned int repetitions = 5;
+	unsigned long largest_network = 100000;
+	std::string output_file ("");
+	std::string filter ("");
+	std::string work_directory ("benchmark_work");
+	std::string prawn_directory ("");
+	std::string export_scene ("");
+	std::string export_directory ("");
+
+	for (int a = 1; a < argc; ++a) {
+
+		const std::string argument (argv[a]);
+		const bool has_value = a + 1 < argc;
+		if (argument == "-o" && has_value) {
+			output_file = argv[++a];
+		} else if (argument == "-r" && has_value) {
+			repetitions = std::max (1, std::atoi (argv[++a]));
+		} else if (argument == "-n" && has_value) {
+			largest_network = std::strtoul (argv[++a], 0, 10);
+		} else if (argument == "-f" && has_value) {
+			filter = argv[++a];
+		} else if (argument == "-w" && has_value) {
+			work_directory = argv[++a];
+		} else if (argument == "-C" && has_value) {
+			prawn_directory = argv[++a];
+		} else if (argument == "-x" && a + 2 < argc) {
+			export_scene = argv[++a];
+			export_directory = argv[++a];
+		} else if (argument == "-h" || argument == "--help") {
+			usage (std::cout);
+			return 0;
+		} else {
+			std::cerr << "prawn-benchmarks: unknown option '" << argument << "'\n";
+			usage (std::cerr);
+			return 2;
+		}
+	}
+
+	// only errors are output
+	std::unique_ptr<std::streambuf> filter_level (new filter_by_level_buf (ERROR, log()));
+
+	// the paths are made absolute before moving to Prawn's directory
+	work_directory = system_functions::get_absolute_path (work_directory);
+	if (!output_file.empty()) {
+		output_file = system_functions::get_absolute_path (output_file);
+	}
+
+	// this program, run again to export scenes (it's looked for in the PATH when given without a directory)
+	std::string program (argv[0]);
+	if (program.find_first_of ("/\\") != std::string::npos) {
+		program = system_functions::get_absolute_path (program);
+	}
+
+	if (!make_directory (work_directory)) {
+		std::cerr << "prawn-benchmarks: couldn't create work directory '" << work_directory << "'\n";
+		return 2;
+	}
+
+	if (!prawn_directory.empty() && chdir (prawn_directory.c_str()) != 0) {
+		std::cerr << "prawn-benchmarks: couldn't change to directory '" << prawn_directory << "'\n";
+		return 2;
+	}
+
+	// preferences and block cache go to <work directory>/.shrimp
+#if defined _WIN32
+	_putenv_s ("USERPROFILE", work_directory.c_str());
+#else
+	setenv ("HOME", work_directory.c_str(), 1);
+#endif
+
+	if (!export_scene.empty()) {
+
+		scene exported;
+		return exported.load (export_scene) && exported.export_scene (export_directory) ? 0 : 1;
+	}
+
+	std::vector<std::string> examples;
+	system_functions::list_directory ("examples", examples);
+	std::vector<std::string> example_files;
+	for (std::vector<std::string>::const_iterator e = examples.begin(); e != examples.end(); ++e) {
+		if (system_functions::file_extension (*e) == ".xml") {
+			example_files.push_back (system_functions::get_absolute_path ("examples/" + *e));
+		}
+	}
+
+	benchmark_suite suite (repetitions, filter);
+	benchmark_library (suite);
+	benchmark_examples (suite, example_files, work_directory, program);
+	benchmark_networks (suite, largest_network, work_directory);
+	benchmark_functions (suite);
+
+	if (output_file.empty()) {
+		suite.write_json (std::cout);
+	} else {
+		std::ofstream file (output_file.c_str());
+		suite.write_json (file);
+		if (!file.good()) {
+			std::cerr << "prawn-benchmarks: couldn't write '" << output_file << "'\n";
+			return 2;
+		}
+	}
+
+	return suite.failed_checks() ? 1 : 0;
+}
@@ -37,12 +37,56 @@ long& log_level(std::ostream& Stream) {
 	return Stream.iword (log_level_index());
 }
 
+int error_count_index() {
+
+	static int index = std::ios::xalloc();
+	return index;
+}
+
+// number of errors logged to a stream (filtered or not)
+long& error_count(std::ostream& Stream) {
+
+	return Stream.iword (error_count_index());
+}
+
+int message_start_index() {
+
+	static int index = std::ios::xalloc();
+	return index;
+}
+
+// set by log(), until the message's first character is captured
+long& message_start(std::ostream& Stream) {
+
+	return Stream.iword (message_start_index());
+}
+
+// stream of the current thread's log_capture, if any
+thread_local std::ostream* captured_log_stream = 0;
+
 } // namespace detail
 
 std::ostream& log() {
 
-	detail::log_level (std::cerr) = 0;
-	return std::cerr;
+	std::ostream& stream = detail::captured_log_stream ? *detail::captured_log_stream : std::cerr;
+
+	detail::log_level (stream) = 0;
+	detail::message_start (stream) = 1;
+	return stream;
+}
+
+void replay_log (const log_messages_t& Messages) {
+
+	for (log_messages_t::const_iterator message = Messages.begin(); message != Messages.end(); ++message) {
+
+		// the text already holds the level's prefix
+		std::ostream& stream = log();
+		detail::log_level (stream) = message->level;
+		if (message->level == ERROR)
+			++detail::error_count (stream);
+
+		stream << message->text;
+	}
 }
 
 std::ostream& aspect (std::ostream& Stream) {
@@ -62,6 +106,7 @@ std::ostream& debug (std::ostream& Stream) {
 std::ostream& error (std::ostream& Stream) {
 
 	detail::log_level (Stream) = ERROR;
+	++detail::error_count (Stream);
 	Stream << " Error : ";
 	return Stream;
 }
@@ -109,4 +154,57 @@ int filter_by_level_buf::sync() {
 	return 0;
 }
 
+// log_capture
+log_capture::log_capture() :
+		m_stream (this),
+		m_minimum_level (ASPECT),
+		m_previous_stream (detail::captured_log_stream)
+{
+	// apply the same level as the main log
+	if (filter_by_level_buf* filter = dynamic_cast<filter_by_level_buf*> (std::cerr.rdbuf()))
+		m_minimum_level = filter->minimum_level();
+
+	detail::captured_log_stream = &m_stream;
+}
+
+log_capture::~log_capture() {
+
+	detail::captured_log_stream = m_previous_stream;
+}
+
+std::string log_capture::str() const {
+
+	std::string text;
+	for (log_messages_t::const_iterator message = m_messages.begin(); message != m_messages.end(); ++message)
+		text += message->text;
+
+	return text;
+}
 
+long log_capture::errors() {
+
+	return detail::error_count (m_stream);
+}
+
+int log_capture::overflow (int c) {
+
+	if (c == traits_type::eof())
+		return traits_type::not_eof (c);
+
+	const long level = detail::log_level (m_stream);
+	if (level > m_minimum_level)
+		return c;
+
+	// a message starts with each log() call, and when the level changes
+	long& message_start = detail::message_start (m_stream);
+	if (message_start || m_messages.empty() || m_messages.back().level != level) {
+
+		log_message_t message;
+		message.level = level;
+		m_messages.push_back (message);
+		message_start = 0;
+	}
+
+	m_messages.back().text += static_cast<char> (c);
+	return c;
+}
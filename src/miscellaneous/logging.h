@@ -23,6 +23,8 @@
 #define _logging_h_
 
 #include <ostream>
+#include <string>
+#include <vector>
 
 // available log levels
 typedef enum
@@ -50,6 +52,8 @@ public:
 	filter_by_level_buf(const log_level_t MinimumLevel, std::ostream& Stream);
 	~filter_by_level_buf();
 
+	log_level_t minimum_level() const { return m_minimum_level; }
+
 protected:
 	int overflow(int);
 	int sync();
@@ -60,5 +64,43 @@ private:
 	const log_level_t m_minimum_level;
 };
 
+// a message logged by a log() call, with its level (0 without one)
+struct log_message_t
+{
+	long level;
+	std::string text;
+};
+typedef std::vector<log_message_t> log_messages_t;
+
+// output messages to the current thread's log with their levels, as if they were logged again
+void replay_log (const log_messages_t& Messages);
+
+// While alive, redirects the current thread's log() messages into a buffer
+// (filtered like the main log), so that a worker thread's messages can be
+// output later on, in a deterministic order
+class log_capture :
+	private std::streambuf
+{
+public:
+	log_capture();
+	~log_capture();
+
+	// return the messages logged so far
+	const log_messages_t& messages() const { return m_messages; }
+	// return the text of the messages logged so far
+	std::string str() const;
+	// return the number of errors logged so far (including filtered-out ones)
+	long errors();
+
+protected:
+	int overflow(int);
+
+private:
+	std::ostream m_stream;
+	log_level_t m_minimum_level;
+	log_messages_t m_messages;
+	std::ostream* m_previous_stream;
+};
+
 #endif // _logging_h_
 
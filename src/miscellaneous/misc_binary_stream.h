@@ -0,0 +1,154 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _misc_binary_stream_h_
+#define _misc_binary_stream_h_
+
+#include <cstring>
+#include <string>
+
+#include <stdint.h>
+
+namespace binary
+{
+
+// appends values to a buffer (native byte order)
+class writer
+{
+public:
+	writer (std::string& Buffer) :
+		m_buffer (Buffer) {
+	}
+
+	void write_uint32 (const uint32_t Value) {
+
+		m_buffer.append (reinterpret_cast<const char*> (&Value), sizeof (Value));
+	}
+
+	void write_uint64 (const uint64_t Value) {
+
+		m_buffer.append (reinterpret_cast<const char*> (&Value), sizeof (Value));
+	}
+
+	void write_double (const double Value) {
+
+		m_buffer.append (reinterpret_cast<const char*> (&Value), sizeof (Value));
+	}
+
+	void write_bool (const bool Value) {
+
+		m_buffer += Value ? '\1' : '\0';
+	}
+
+	void write_string (const std::string& Value) {
+
+		write_uint32 (Value.size());
+		m_buffer += Value;
+	}
+
+	void write_raw (const char* Data, const size_t Size) {
+
+		m_buffer.append (Data, Size);
+	}
+
+private:
+	std::string& m_buffer;
+};
+
+// reads values back from a memory block, fails instead of reading past its end
+class reader
+{
+public:
+	reader (const char* Data, const size_t Size) :
+		m_data (Data),
+		m_size (Size),
+		m_position (0) {
+	}
+
+	bool read_uint32 (uint32_t& Value) {
+
+		return read_raw (&Value, sizeof (Value));
+	}
+
+	bool read_uint64 (uint64_t& Value) {
+
+		return read_raw (&Value, sizeof (Value));
+	}
+
+	bool read_double (double& Value) {
+
+		return read_raw (&Value, sizeof (Value));
+	}
+
+	bool read_bool (bool& Value) {
+
+		char c = 0;
+		if (!read_raw (&c, 1))
+			return false;
+
+		Value = (c != 0);
+		return true;
+	}
+
+	bool read_string (std::string& Value) {
+
+		uint32_t size = 0;
+		if (!read_uint32 (size) || size > m_size - m_position)
+			return false;
+
+		Value.assign (m_data + m_position, size);
+		m_position += size;
+		return true;
+	}
+
+	// skip a block of bytes, returning its start
+	const char* skip (const size_t Size) {
+
+		if (Size > m_size - m_position)
+			return 0;
+
+		const char* start = m_data + m_position;
+		m_position += Size;
+		return start;
+	}
+
+	bool at_end() const { return m_position == m_size; }
+
+private:
+	bool read_raw (void* Value, const size_t Size) {
+
+		if (Size > m_size - m_position)
+			return false;
+
+		std::memcpy (Value, m_data + m_position, Size);
+		m_position += Size;
+		return true;
+	}
+
+	const char* m_data;
+	const size_t m_size;
+	size_t m_position;
+};
+
+} // namespace binary
+
+#endif // _misc_binary_stream_h_
+
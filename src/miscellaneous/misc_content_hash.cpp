@@ -0,0 +1,157 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "misc_content_hash.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace
+{
+
+const uint32_t round_constants[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+inline uint32_t rotate_right (const uint32_t Value, const int Bits) {
+
+	return (Value >> Bits) | (Value << (32 - Bits));
+}
+
+}
+
+
+content_hash::content_hash() :
+	m_block_size (0),
+	m_size (0)
+{
+	m_state[0] = 0x6a09e667;
+	m_state[1] = 0xbb67ae85;
+	m_state[2] = 0x3c6ef372;
+	m_state[3] = 0xa54ff53a;
+	m_state[4] = 0x510e527f;
+	m_state[5] = 0x9b05688c;
+	m_state[6] = 0x1f83d9ab;
+	m_state[7] = 0x5be0cd19;
+}
+
+
+void content_hash::add_bytes (const unsigned char* Bytes, const size_t Size) {
+
+	m_size += Size;
+
+	size_t i = 0;
+	if (m_block_size) {
+
+		// complete the waiting block first
+		const size_t count = std::min (Size, sizeof (m_block) - m_block_size);
+		std::memcpy (m_block + m_block_size, Bytes, count);
+		m_block_size += count;
+		i = count;
+
+		if (m_block_size < sizeof (m_block)) {
+			return;
+		}
+
+		compress (m_block);
+		m_block_size = 0;
+	}
+
+	for (; i + sizeof (m_block) <= Size; i += sizeof (m_block)) {
+		compress (Bytes + i);
+	}
+
+	std::memcpy (m_block, Bytes + i, Size - i);
+	m_block_size = Size - i;
+}
+
+
+std::string content_hash::hex() const {
+
+	// pad a copy: more content can be added afterwards
+	content_hash padded (*this);
+
+	const uint64_t bits = m_size * 8;
+	unsigned char padding[72] = { 0x80 };
+	const size_t padding_size = (m_block_size < 56 ? 56 : 120) - m_block_size;
+	for (int b = 0; b < 8; ++b) {
+		padding[padding_size + b] = static_cast<unsigned char> (bits >> (56 - 8 * b));
+	}
+	padded.add_bytes (padding, padding_size + 8);
+
+	static const char digits[] = "0123456789abcdef";
+
+	std::string result;
+	for (int w = 0; w < 8; ++w) {
+		for (int shift = 28; shift >= 0; shift -= 4) {
+			result += digits[(padded.m_state[w] >> shift) & 0xf];
+		}
+	}
+
+	return result;
+}
+
+
+void content_hash::compress (const unsigned char* Block) {
+
+	uint32_t w[64];
+	for (int i = 0; i < 16; ++i) {
+		w[i] = (uint32_t (Block[i * 4]) << 24) | (uint32_t (Block[i * 4 + 1]) << 16) | (uint32_t (Block[i * 4 + 2]) << 8) | uint32_t (Block[i * 4 + 3]);
+	}
+	for (int i = 16; i < 64; ++i) {
+		const uint32_t s0 = rotate_right (w[i - 15], 7) ^ rotate_right (w[i - 15], 18) ^ (w[i - 15] >> 3);
+		const uint32_t s1 = rotate_right (w[i - 2], 17) ^ rotate_right (w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+	uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+	for (int i = 0; i < 64; ++i) {
+
+		const uint32_t t1 = h + (rotate_right (e, 6) ^ rotate_right (e, 11) ^ rotate_right (e, 25)) + ((e & f) ^ (~e & g)) + round_constants[i] + w[i];
+		const uint32_t t2 = (rotate_right (a, 2) ^ rotate_right (a, 13) ^ rotate_right (a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	m_state[0] += a;
+	m_state[1] += b;
+	m_state[2] += c;
+	m_state[3] += d;
+	m_state[4] += e;
+	m_state[5] += f;
+	m_state[6] += g;
+	m_state[7] += h;
+}
@@ -0,0 +1,62 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _misc_content_hash_h_
+#define _misc_content_hash_h_
+
+#include <string>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// SHA-256 hash of some content, it addresses cached compiled shaders
+// (it's stable across runs and platforms, unlike std::hash)
+class content_hash
+{
+public:
+	content_hash();
+
+	// add a text, prefixed by its size so that consecutive texts can't be confused
+	void add (const std::string& Text) {
+
+		const uint64_t size = Text.size();
+		add_bytes (reinterpret_cast<const unsigned char*> (&size), sizeof (size));
+		add_bytes (reinterpret_cast<const unsigned char*> (Text.data()), Text.size());
+	}
+
+	// add bytes as they are (a text added in several parts gives the same hash)
+	void add_bytes (const unsigned char* Bytes, const size_t Size);
+
+	// return the hash of the content added so far, in 64 hexadecimal digits
+	std::string hex() const;
+
+private:
+	uint32_t m_state[8];
+	// bytes waiting for a complete 64 byte block
+	unsigned char m_block[64];
+	size_t m_block_size;
+	uint64_t m_size;
+
+	void compress (const unsigned char* Block);
+};
+
+#endif // _misc_content_hash_h_
+
@@ -0,0 +1,195 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "misc_job_graph.h"
+#include "misc_thread_pool.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <mutex>
+
+
+job_graph::job_graph() :
+	m_cancelled (false),
+	m_finished_jobs (0)
+{
+}
+
+
+job_graph::job_id_t job_graph::add (const std::string& Name, const std::string& Command, const job_ids_t& Dependencies)
+{
+	const job_id_t id = m_jobs.size();
+
+	job_t job;
+	job.name = Name;
+	job.command = Command;
+	job.status = PENDING;
+	job.result.exit_code = -1;
+	job.result.signal = 0;
+	job.result.seconds = 0;
+
+	// a job can only wait for previous ones, so that the graph has no cycle
+	for (job_ids_t::const_iterator d = Dependencies.begin(); d != Dependencies.end(); ++d)
+	{
+		if (*d < id)
+		{
+			job.dependencies.push_back (*d);
+		}
+		else
+		{
+			log() << error << "job '" << Name << "' can't depend on job " << *d << std::endl;
+		}
+	}
+
+	m_jobs.push_back (job);
+
+	return id;
+}
+
+
+bool job_graph::run (const unsigned int Concurrency)
+{
+	if (m_jobs.empty())
+	{
+		return true;
+	}
+
+	m_finished_jobs = 0;
+
+	// jobs waiting for each job, and number of unfinished dependencies of each job
+	std::vector<job_ids_t> dependents (m_jobs.size());
+	std::vector<unsigned long> waiting (m_jobs.size(), 0);
+	for (job_id_t id = 0; id < m_jobs.size(); ++id)
+	{
+		m_jobs[id].status = PENDING;
+		for (job_ids_t::const_iterator d = m_jobs[id].dependencies.begin(); d != m_jobs[id].dependencies.end(); ++d)
+		{
+			dependents[*d].push_back (id);
+			++waiting[id];
+		}
+	}
+
+	const unsigned int threads = std::min<unsigned long> (Concurrency ? Concurrency : thread_pool::hardware_threads(), m_jobs.size());
+	thread_pool pool (threads);
+	std::mutex mutex;
+
+	// run a job (unless the graph was cancelled), then queue the jobs that were only waiting for it
+	std::function<void (job_id_t)> run_job = [&] (const job_id_t Id)
+	{
+		system_functions::command_result_t result;
+		result.exit_code = -1;
+		result.signal = 0;
+		result.seconds = 0;
+
+		const bool succeeded = !m_cancelled && system_functions::run_command (m_jobs[Id].command, result, &m_cancelled);
+
+		std::lock_guard<std::mutex> lock (mutex);
+		m_jobs[Id].result = result;
+		m_jobs[Id].status = succeeded ? SUCCEEDED : (m_cancelled ? CANCELLED : FAILED);
+		++m_finished_jobs;
+
+		for (job_ids_t::const_iterator d = dependents[Id].begin(); d != dependents[Id].end(); ++d)
+		{
+			if (--waiting[*d] == 0)
+			{
+				pool.push (std::bind (run_job, *d));
+			}
+		}
+	};
+
+	{
+		std::lock_guard<std::mutex> lock (mutex);
+		for (job_id_t id = 0; id < m_jobs.size(); ++id)
+		{
+			if (!waiting[id])
+			{
+				pool.push (std::bind (run_job, id));
+			}
+		}
+	}
+
+	pool.wait();
+
+	// report the jobs, in order
+	bool succeeded = true;
+	for (jobs_t::const_iterator job = m_jobs.begin(); job != m_jobs.end(); ++job)
+	{
+		const system_functions::command_result_t& result = job->result;
+		if (job->status == SUCCEEDED)
+		{
+			log() << aspect << "job '" << job->name << "' done in " << result.seconds << "s" << std::endl;
+		}
+		else if (job->status == CANCELLED)
+		{
+			log() << info << "job '" << job->name << "' cancelled" << std::endl;
+			succeeded = false;
+			continue;
+		}
+		else
+		{
+			log() << error << "job '" << job->name << "' failed after " << result.seconds << "s (";
+			if (result.signal)
+			{
+				log() << "killed by signal " << result.signal;
+			}
+			else
+			{
+				log() << "exit code " << result.exit_code;
+			}
+			log() << "): " << job->command << std::endl;
+			succeeded = false;
+		}
+
+		// the compiler or renderer messages
+		if (!result.output.empty())
+		{
+			log() << (job->status == SUCCEEDED ? aspect : error) << job->name << " output:\n" << result.output << std::endl;
+		}
+		if (!result.errors.empty())
+		{
+			log() << (job->status == SUCCEEDED ? warning : error) << job->name << " errors:\n" << result.errors << std::endl;
+		}
+	}
+
+	return succeeded;
+}
+
+
+void job_graph::write (std::ostream& Stream) const
+{
+	for (job_id_t id = 0; id < m_jobs.size(); ++id)
+	{
+		const job_t& job = m_jobs[id];
+
+		Stream << "# job " << id << " " << job.name;
+		if (!job.dependencies.empty())
+		{
+			Stream << " after";
+			for (job_ids_t::const_iterator d = job.dependencies.begin(); d != job.dependencies.end(); ++d)
+			{
+				Stream << " " << *d;
+			}
+		}
+		Stream << std::endl;
+
+		Stream << job.command << std::endl;
+	}
+}
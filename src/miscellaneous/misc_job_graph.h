@@ -0,0 +1,90 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _misc_job_graph_h_
+#define _misc_job_graph_h_
+
+#include "misc_system_functions.h"
+
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Shell commands to run, each one once the commands it depends on are done;
+// independent commands run concurrently
+class job_graph
+{
+public:
+	typedef unsigned long job_id_t;
+	typedef std::vector<job_id_t> job_ids_t;
+
+	typedef enum
+	{
+		PENDING,
+		SUCCEEDED,
+		FAILED,
+		CANCELLED
+	} status_t;
+
+	struct job_t
+	{
+		std::string name;
+		std::string command;
+		job_ids_t dependencies;
+
+		status_t status;
+		// exit status, outputs and run time
+		system_functions::command_result_t result;
+	};
+	typedef std::vector<job_t> jobs_t;
+
+	job_graph();
+
+	// add a command, its dependencies must have been added before
+	job_id_t add (const std::string& Name, const std::string& Command, const job_ids_t& Dependencies = job_ids_t());
+
+	// run the jobs, at most Concurrency at a time (0 means one per hardware thread),
+	// a job runs once its dependencies are done, even if they failed;
+	// failures are logged, returns true when all the jobs succeeded
+	bool run (const unsigned int Concurrency);
+
+	// kill the running jobs and skip the ones that didn't start yet (can be called from any thread)
+	void cancel() { m_cancelled = true; }
+	bool cancelled() const { return m_cancelled; }
+
+	// number of jobs that are over (can be called from any thread while the jobs run)
+	unsigned long finished_jobs() const { return m_finished_jobs; }
+
+	const jobs_t& jobs() const { return m_jobs; }
+
+	// write the jobs as a shell script: each command is preceded by a comment
+	// giving its id, name and dependencies ("# job 6 render after 0 1 2")
+	void write (std::ostream& Stream) const;
+
+private:
+	jobs_t m_jobs;
+
+	std::atomic<bool> m_cancelled;
+	std::atomic<unsigned long> m_finished_jobs;
+};
+
+#endif // _misc_job_graph_h_
@@ -0,0 +1,109 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "misc_shared_string.h"
+
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+
+namespace
+{
+
+// interned texts, by hash value
+typedef std::unordered_multimap<size_t, std::weak_ptr<const std::string> > interned_texts_t;
+
+interned_texts_t& interned_texts() {
+
+	static interned_texts_t texts;
+	return texts;
+}
+
+std::mutex& interned_texts_mutex() {
+
+	static std::mutex mutex;
+	return mutex;
+}
+
+// number of interned texts after the last cleanup
+size_t interned_text_count = 0;
+
+}
+
+
+shared_string shared_string::intern (const std::string& Text) {
+
+	if (Text.empty()) {
+		return shared_string();
+	}
+
+	const size_t hash = std::hash<std::string>() (Text);
+
+	std::lock_guard<std::mutex> lock (interned_texts_mutex());
+	interned_texts_t& texts = interned_texts();
+
+	// look for the text, dropping the freed ones on the way
+	std::pair<interned_texts_t::iterator, interned_texts_t::iterator> range = texts.equal_range (hash);
+	for (interned_texts_t::iterator text_i = range.first; text_i != range.second; ) {
+
+		text_t text = text_i->second.lock();
+		if (!text) {
+			text_i = texts.erase (text_i);
+			continue;
+		}
+
+		if (*text == Text) {
+			return shared_string (text);
+		}
+
+		++text_i;
+	}
+
+	// forget all the freed texts when the table has doubled since last time
+	if (texts.size() >= 2 * interned_text_count + 64) {
+
+		for (interned_texts_t::iterator text_i = texts.begin(); text_i != texts.end(); ) {
+
+			if (text_i->second.expired()) {
+				text_i = texts.erase (text_i);
+			}
+			else {
+				++text_i;
+			}
+		}
+
+		interned_text_count = texts.size();
+	}
+
+	text_t text = std::make_shared<const std::string> (Text);
+	texts.insert (std::make_pair (hash, std::weak_ptr<const std::string> (text)));
+
+	return shared_string (text);
+}
+
+
+const shared_string::text_t& shared_string::empty_text() {
+
+	static const text_t text = std::make_shared<const std::string>();
+	return text;
+}
+
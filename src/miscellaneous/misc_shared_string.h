@@ -0,0 +1,81 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _misc_shared_string_h_
+#define _misc_shared_string_h_
+
+#include <memory>
+#include <ostream>
+#include <string>
+
+// An immutable, reference-counted string: copies share the same text,
+// assigning a new value never changes the text seen by the other copies
+class shared_string
+{
+public:
+	shared_string() :
+		m_text (empty_text()) {
+	}
+
+	shared_string (const std::string& Text) :
+		m_text (std::make_shared<const std::string> (Text)) {
+	}
+
+	shared_string (const char* Text) :
+		m_text (std::make_shared<const std::string> (Text)) {
+	}
+
+	// return a string sharing its text with the other interned strings of the same value
+	// (the interned text is freed once no string uses it anymore)
+	static shared_string intern (const std::string& Text);
+
+	const std::string& str() const { return *m_text; }
+	operator const std::string&() const { return *m_text; }
+
+	const char* c_str() const { return m_text->c_str(); }
+	std::string::size_type size() const { return m_text->size(); }
+	bool empty() const { return m_text->empty(); }
+
+	bool operator== (const shared_string& Other) const { return m_text == Other.m_text || *m_text == *Other.m_text; }
+	bool operator!= (const shared_string& Other) const { return !(*this == Other); }
+
+	// whether two strings share the same text
+	bool shares_text_with (const shared_string& Other) const { return m_text == Other.m_text; }
+
+private:
+	typedef std::shared_ptr<const std::string> text_t;
+
+	shared_string (const text_t& Text) :
+		m_text (Text) {
+	}
+
+	static const text_t& empty_text();
+
+	text_t m_text;
+};
+
+inline std::ostream& operator<< (std::ostream& Stream, const shared_string& String) {
+
+	return Stream << String.str();
+}
+
+#endif // _misc_shared_string_h_
+
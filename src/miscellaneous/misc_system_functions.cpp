@@ -21,12 +21,30 @@
 
 #include "misc_system_functions.h"
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <sstream>
 
 #if defined _WIN32
+# include <direct.h>
+# include <io.h>
+# include <sys/stat.h>
 #else
+# include <cerrno>
+# include <dirent.h>
+# include <csignal>
+# include <fcntl.h>
+# include <poll.h>
+# include <spawn.h>
 # include <sys/stat.h>
+# include <sys/wait.h>
+# include <unistd.h>
+
+extern char** environ;
 #endif
 
 namespace system_functions
@@ -34,13 +52,9 @@ namespace system_functions
 
 const std::string get_shrimp_user_directory() {
 
-	// get user's home
-	char home[1024];
-	fltk::filename_absolute (home, 1024, "~");
-
-	// check for .shrimp directory, create it if not there
-	std::string shrimp = std::string (home) + ".shrimp";
-	if (!fltk::filename_isdir (shrimp.c_str())) {
+	// check for .shrimp directory in user's home, create it if not there
+	std::string shrimp = get_absolute_path ("~/.shrimp");
+	if (!is_directory (shrimp)) {
 
 #if defined _WIN32
 		mkdir (shrimp.c_str());
@@ -59,7 +73,7 @@ const std::string get_tmp_directory() {
 
 	// check for temp directory
 	std::string temp = shrimp + "/temp";
-	if (!fltk::filename_isdir(temp.c_str())) {
+	if (!is_directory (temp)) {
 
 #if defined _WIN32
 		mkdir(temp.c_str());
@@ -71,20 +85,480 @@ const std::string get_tmp_directory() {
 	return temp;
 }
 
+const std::string file_stamp (const std::string& Path) {
+
+	struct stat status;
+	if (stat (Path.c_str(), &status) != 0) {
+		return "";
+	}
+
+	// modification time and size (sub-second times aren't portable)
+	std::ostringstream stamp;
+	stamp << status.st_mtime << ':';
+#if defined __linux__
+	stamp << status.st_mtim.tv_nsec << ':';
+#endif
+	stamp << status.st_size;
+
+	return stamp.str();
+}
+
 bool execute_command (const std::string& Command) {
 
-	int status = system (Command.c_str());
+	command_result_t result;
+	return run_command (Command, result);
+}
+
+bool split_command (const std::string& Command, std::vector<std::string>& Arguments) {
+
+	Arguments.clear();
+
+	std::string argument;
+	bool in_argument = false;
+	char quote = 0;
+	for (std::string::size_type i = 0; i < Command.size(); ++i) {
+
+		const char c = Command[i];
+		if (quote == '\'') {
+
+			// everything is literal between single quotes
+			if (c == '\'') {
+				quote = 0;
+			} else {
+				argument += c;
+			}
+
+		} else if (c == '\\' && i + 1 < Command.size() && (!quote || std::strchr ("\"\\$`", Command[i + 1]))) {
+
+			argument += Command[++i];
+			in_argument = true;
+
+		} else if (quote == '"') {
+
+			if (c == '"') {
+				quote = 0;
+			} else if (c == '$' || c == '`') {
+				return false;
+			} else {
+				argument += c;
+			}
+
+		} else if (c == '\'' || c == '"') {
+
+			quote = c;
+			in_argument = true;
+
+		} else if (c == ' ' || c == '\t') {
+
+			if (in_argument) {
+				Arguments.push_back (argument);
+				argument.clear();
+				in_argument = false;
+			}
+
+		} else if (std::strchr ("|&;<>()$`*?[]{}\n", c) || ((c == '#' || c == '~') && !in_argument)) {
+
+			return false;
+
+		} else {
+
+			argument += c;
+			in_argument = true;
+		}
+	}
+
+	if (quote) {
+		// let the shell report the error
+		return false;
+	}
+
+	if (in_argument) {
+		Arguments.push_back (argument);
+	}
+
+	return true;
+}
+
+#if defined _WIN32
+
+bool run_command (const std::string& Command, command_result_t& Result, const std::atomic<bool>* Cancel) {
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	Result.exit_code = system (Command.c_str());
+	Result.signal = 0;
+	Result.output.clear();
+	Result.errors.clear();
+	Result.seconds = std::chrono::duration<double> (std::chrono::steady_clock::now() - start).count();
+
+	return Result.exit_code == 0;
+}
+
+#else
+
+// create a pipe whose ends aren't inherited by the processes spawned by other threads
+static bool open_pipe (int Pipe[2]) {
+
+# if defined __linux__
+	return pipe2 (Pipe, O_CLOEXEC) == 0;
+# else
+	if (pipe (Pipe) != 0) {
+		return false;
+	}
 
-	return status > 0;
+	fcntl (Pipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl (Pipe[1], F_SETFD, FD_CLOEXEC);
+	return true;
+# endif
 }
 
+bool run_command (const std::string& Command, command_result_t& Result, const std::atomic<bool>* Cancel) {
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	Result.exit_code = -1;
+	Result.signal = 0;
+	Result.output.clear();
+	Result.errors.clear();
+	Result.seconds = 0;
+
+	// run the command directly, unless it needs a shell
+	std::vector<std::string> arguments;
+	if (!split_command (Command, arguments)) {
+
+		arguments.clear();
+		arguments.push_back ("/bin/sh");
+		arguments.push_back ("-c");
+		arguments.push_back (Command);
+	}
+
+	if (arguments.empty()) {
+		Result.errors = "empty command";
+		return false;
+	}
+
+	std::vector<char*> argv;
+	for (std::vector<std::string>::iterator a = arguments.begin(); a != arguments.end(); ++a) {
+		argv.push_back (&(*a)[0]);
+	}
+	argv.push_back (0);
+
+	// capture the standard and error outputs
+	int output_pipe[2];
+	int error_pipe[2];
+	if (!open_pipe (output_pipe)) {
+		Result.errors = std::strerror (errno);
+		return false;
+	}
+	if (!open_pipe (error_pipe)) {
+		Result.errors = std::strerror (errno);
+		close (output_pipe[0]);
+		close (output_pipe[1]);
+		return false;
+	}
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init (&actions);
+	posix_spawn_file_actions_adddup2 (&actions, output_pipe[1], 1);
+	posix_spawn_file_actions_adddup2 (&actions, error_pipe[1], 2);
+
+	// in its own process group, so that cancelling also kills the processes it started
+	posix_spawnattr_t attributes;
+	posix_spawnattr_init (&attributes);
+	posix_spawnattr_setflags (&attributes, POSIX_SPAWN_SETPGROUP);
+	posix_spawnattr_setpgroup (&attributes, 0);
+
+	pid_t pid;
+	const int spawn_error = posix_spawnp (&pid, argv[0], &actions, &attributes, &argv[0], environ);
+	posix_spawn_file_actions_destroy (&actions);
+	posix_spawnattr_destroy (&attributes);
+
+	close (output_pipe[1]);
+	close (error_pipe[1]);
+
+	if (spawn_error) {
+
+		Result.errors = std::string ("couldn't run '") + argv[0] + "': " + std::strerror (spawn_error);
+		close (output_pipe[0]);
+		close (error_pipe[0]);
+		return false;
+	}
+
+	// read the outputs until the command exits, kill it when cancelled (also once it closed
+	// its outputs: it can keep running, e.g. a renderer sent to the background)
+	struct pollfd outputs[2];
+	outputs[0].fd = output_pipe[0];
+	outputs[0].events = POLLIN;
+	outputs[1].fd = error_pipe[0];
+	outputs[1].events = POLLIN;
+	std::string* const captured[2] = { &Result.output, &Result.errors };
+
+	int kill_signal = 0;
+	std::chrono::steady_clock::time_point kill_time;
+	int open_outputs = 2;
+	int status = 0;
+	bool exited = false;
+	bool reaped = false;
+	// reads after the command exited (a pipe holds a few of them)
+	int remaining_reads = 64;
+	while (open_outputs || !exited) {
+
+		// ask first, then force
+		if (!exited) {
+			if (Cancel && *Cancel && !kill_signal) {
+				kill (-pid, SIGTERM);
+				kill_signal = SIGTERM;
+				kill_time = std::chrono::steady_clock::now();
+			} else if (kill_signal == SIGTERM && std::chrono::steady_clock::now() - kill_time > std::chrono::seconds (2)) {
+				kill (-pid, SIGKILL);
+				kill_signal = SIGKILL;
+			}
+		}
+
+		// once the command exited, only what's already written is read: a process it started
+		// (e.g. a framebuffer viewer) can keep the outputs open; closed outputs are ignored
+		// by poll(), which then only waits
+		int ready = poll (outputs, 2, exited ? 0 : (open_outputs ? 100 : 10));
+		if (ready < 0 && errno != EINTR) {
+
+			// stop reading, keep waiting for the command
+			for (int o = 0; o < 2; ++o) {
+				if (outputs[o].fd >= 0) {
+					close (outputs[o].fd);
+					outputs[o].fd = -1;
+				}
+			}
+			open_outputs = 0;
+			ready = 0;
+		}
+		if (exited && (ready <= 0 || --remaining_reads < 0)) {
+			break;
+		}
+
+		for (int o = 0; o < 2 && ready > 0; ++o) {
+
+			if (outputs[o].fd < 0 || !(outputs[o].revents & (POLLIN | POLLHUP | POLLERR))) {
+				continue;
+			}
+
+			char buffer[4096];
+			const ssize_t size = read (outputs[o].fd, buffer, sizeof (buffer));
+			if (size > 0) {
+				captured[o]->append (buffer, size);
+			} else if (size == 0 || errno != EINTR) {
+				close (outputs[o].fd);
+				outputs[o].fd = -1;
+				--open_outputs;
+			}
+		}
+
+		if (!exited) {
+
+			const pid_t waited = waitpid (pid, &status, WNOHANG);
+			if (waited == pid) {
+				exited = true;
+				reaped = true;
+			} else if (waited < 0 && errno != EINTR) {
+				// can't be waited for (already reaped elsewhere)
+				exited = true;
+			}
+		}
+	}
+
+	for (int o = 0; o < 2; ++o) {
+		if (outputs[o].fd >= 0) {
+			close (outputs[o].fd);
+		}
+	}
+
+	if (reaped && WIFEXITED (status)) {
+		Result.exit_code = WEXITSTATUS (status);
+	} else if (reaped && WIFSIGNALED (status)) {
+		Result.signal = WTERMSIG (status);
+	}
+
+	Result.seconds = std::chrono::duration<double> (std::chrono::steady_clock::now() - start).count();
+
+	return Result.exit_code == 0;
+}
+
+#endif
+
 const std::string get_absolute_path (const std::string& Path) {
 
-	// get user's home
-	char home[1024];
-	fltk::filename_absolute (home, 1024, Path.c_str());
+	std::string path;
+	if (!Path.empty() && Path[0] == '~') {
+
+		// user's home
+#if defined _WIN32
+		const char* home = std::getenv ("USERPROFILE");
+#else
+		const char* home = std::getenv ("HOME");
+#endif
+		path = std::string (home ? home : "") + '/' + Path.substr (1);
+	}
+#if defined _WIN32
+	else if (!Path.empty() && (Path[0] == '/' || Path[0] == '\\' || (Path.size() > 1 && Path[1] == ':'))) {
+#else
+	else if (!Path.empty() && Path[0] == '/') {
+#endif
+		path = Path;
+	}
+	else {
+		char current[4096];
+		if (!getcwd (current, sizeof (current))) {
+			return Path;
+		}
+
+		path = std::string (current) + '/' + Path;
+	}
+
+	// remove the "." and ".." components (and repeated separators)
+	const bool trailing_separator = path[path.size() - 1] == '/';
+	std::string::size_type root = path.find ('/');
+	if (root == std::string::npos) {
+		root = path.size();
+	}
+
+	std::vector<std::string> components;
+	std::string::size_type start = root;
+	while (start < path.size()) {
+
+		std::string::size_type end = path.find ('/', start + 1);
+		if (end == std::string::npos) {
+			end = path.size();
+		}
+
+		const std::string component = path.substr (start + 1, end - start - 1);
+		if (component == "..") {
+			if (!components.empty()) {
+				components.pop_back();
+			}
+		} else if (!component.empty() && component != ".") {
+			components.push_back (component);
+		}
+
+		start = end;
+	}
+
+	std::string absolute = path.substr (0, root);
+	for (std::vector<std::string>::const_iterator c = components.begin(); c != components.end(); ++c) {
+		absolute += '/' + *c;
+	}
+	if (components.empty() || trailing_separator) {
+		absolute += '/';
+	}
+
+	return absolute;
+}
+
+bool is_directory (const std::string& Path) {
+
+	struct stat status;
+	return stat (Path.c_str(), &status) == 0 && (status.st_mode & S_IFDIR);
+}
+
+const std::string file_extension (const std::string& File) {
+
+	const std::string::size_type dot = File.rfind ('.');
+	const std::string::size_type separator = File.find_last_of ("/\\");
+	if (dot == std::string::npos || (separator != std::string::npos && dot < separator)) {
+		return "";
+	}
+
+	return File.substr (dot);
+}
+
+namespace
+{
+
+// compare names like FLTK's numericsort: digit sequences are compared by value ("block9" < "block10")
+bool numeric_less (const std::string& A, const std::string& B) {
+
+	const char* a = A.c_str();
+	const char* b = B.c_str();
+	while (true) {
+
+		if (std::isdigit (*a & 255) && std::isdigit (*b & 255)) {
+
+			while (*a == '0') ++a;
+			while (*b == '0') ++b;
+			while (std::isdigit (*a & 255) && *a == *b) {
+				++a;
+				++b;
+			}
+
+			const int difference = (std::isdigit (*a & 255) && std::isdigit (*b & 255)) ? *a - *b : 0;
+			int magnitude = 0;
+			while (std::isdigit (*a & 255)) {
+				++magnitude;
+				++a;
+			}
+			while (std::isdigit (*b & 255)) {
+				--magnitude;
+				++b;
+			}
+
+			// the number with more significant digits is greater
+			if (magnitude) {
+				return magnitude < 0;
+			}
+			if (difference) {
+				return difference < 0;
+			}
+
+		} else {
+
+			if (*a != *b) {
+				return (*a & 255) < (*b & 255);
+			}
+			if (!*a) {
+				return false;
+			}
+
+			++a;
+			++b;
+		}
+	}
+}
+
+} // namespace
+
+bool list_directory (const std::string& Directory, std::vector<std::string>& Entries) {
+
+	Entries.clear();
+
+#if defined _WIN32
+	_finddata_t entry;
+	const intptr_t handle = _findfirst ((Directory + "/*").c_str(), &entry);
+	if (handle == -1) {
+		return false;
+	}
+
+	do {
+		Entries.push_back (entry.name);
+	}
+	while (_findnext (handle, &entry) == 0);
+
+	_findclose (handle);
+#else
+	DIR* directory = opendir (Directory.c_str());
+	if (!directory) {
+		return false;
+	}
+
+	while (const dirent* entry = readdir (directory)) {
+		Entries.push_back (entry->d_name);
+	}
+
+	closedir (directory);
+#endif
+
+	// without the current and parent directories
+	Entries.erase (std::remove_if (Entries.begin(), Entries.end(), [] (const std::string& Name) { return Name == "." || Name == ".."; }), Entries.end());
+	std::sort (Entries.begin(), Entries.end(), numeric_less);
 
-	return std::string (home);
+	return true;
 }
 
 } // namespace system_functions
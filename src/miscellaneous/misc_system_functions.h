@@ -22,9 +22,9 @@
 #ifndef _misc_system_functions_h_
 #define _misc_system_functions_h_
 
-#include <fltk/filename.h>
-
+#include <atomic>
 #include <string>
+#include <vector>
 
 namespace system_functions
 {
@@ -35,12 +35,49 @@ const std::string get_shrimp_user_directory();
 // return user's temporary directory
 const std::string get_tmp_directory();
 
-// return absolute path from given one
+// return absolute path from given one ("~" stands for user's home, "." and ".." components are removed)
 const std::string get_absolute_path(const std::string& Path);
 
-// execute a command
+// whether a path is an existing directory
+bool is_directory(const std::string& Path);
+
+// return the extension of a file name, with its dot (empty if it has none)
+const std::string file_extension(const std::string& File);
+
+// list the entries of a directory (files and subdirectories, without "." and ".."),
+// sorted by name with numbers compared by value; returns false if it can't be read
+bool list_directory(const std::string& Directory, std::vector<std::string>& Entries);
+
+// return a stamp of a file or directory that changes when it's modified (empty if it doesn't exist)
+const std::string file_stamp(const std::string& Path);
+
+// execute a command, returns true if it succeeded
 bool execute_command(const std::string& Command);
 
+// what a command run by run_command() did
+struct command_result_t
+{
+	// exit code, -1 if the command couldn't be run or was killed
+	int exit_code;
+	// signal that killed the command, 0 if none
+	int signal;
+
+	// standard and error outputs
+	std::string output;
+	std::string errors;
+
+	// run time, in seconds
+	double seconds;
+};
+
+// split a command line into arguments (quotes and backslashes are handled like the shell does),
+// returns false when the command needs a shell (pipes, redirections, variables, wildcards...)
+bool split_command(const std::string& Command, std::vector<std::string>& Arguments);
+
+// run a command, without a shell when it doesn't need one, capturing its outputs;
+// the command is killed if Cancel becomes true. Returns true if it exited with code 0
+bool run_command(const std::string& Command, command_result_t& Result, const std::atomic<bool>* Cancel = 0);
+
 } // namespace system_functions
 
 #endif // _misc_system_functions_h_
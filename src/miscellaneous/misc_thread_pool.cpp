@@ -0,0 +1,112 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "misc_thread_pool.h"
+
+
+thread_pool::thread_pool (const unsigned int Threads) :
+	m_pending_jobs (0),
+	m_stop (false)
+{
+	const unsigned int thread_count = Threads ? Threads : hardware_threads();
+	for (unsigned int t = 0; t < thread_count; ++t)
+	{
+		m_threads.push_back (std::thread (&thread_pool::worker, this));
+	}
+}
+
+
+thread_pool::~thread_pool()
+{
+	wait();
+
+	{
+		std::lock_guard<std::mutex> lock (m_mutex);
+		m_stop = true;
+	}
+	m_job_available.notify_all();
+
+	for (std::vector<std::thread>::iterator t = m_threads.begin(); t != m_threads.end(); ++t)
+	{
+		t->join();
+	}
+}
+
+
+void thread_pool::push (const job_t& Job)
+{
+	{
+		std::lock_guard<std::mutex> lock (m_mutex);
+		m_jobs.push_back (Job);
+		++m_pending_jobs;
+	}
+
+	m_job_available.notify_one();
+}
+
+
+void thread_pool::wait()
+{
+	std::unique_lock<std::mutex> lock (m_mutex);
+	while (m_pending_jobs > 0)
+	{
+		m_jobs_done.wait (lock);
+	}
+}
+
+
+unsigned int thread_pool::hardware_threads()
+{
+	const unsigned int count = std::thread::hardware_concurrency();
+	return count ? count : 2;
+}
+
+
+void thread_pool::worker()
+{
+	std::unique_lock<std::mutex> lock (m_mutex);
+	while (true)
+	{
+		while (m_jobs.empty() && !m_stop)
+		{
+			m_job_available.wait (lock);
+		}
+
+		if (m_jobs.empty())
+		{
+			// stopped and nothing left to run
+			return;
+		}
+
+		job_t job = m_jobs.front();
+		m_jobs.pop_front();
+
+		lock.unlock();
+		job();
+		lock.lock();
+
+		if (--m_pending_jobs == 0)
+		{
+			m_jobs_done.notify_all();
+		}
+	}
+}
+
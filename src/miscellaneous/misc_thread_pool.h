@@ -0,0 +1,69 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _misc_thread_pool_h_
+#define _misc_thread_pool_h_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads running queued jobs
+class thread_pool
+{
+public:
+	typedef std::function<void()> job_t;
+
+	// start the workers (0 means one per hardware thread)
+	thread_pool (const unsigned int Threads = 0);
+	// wait for the queued jobs, then stop the workers
+	~thread_pool();
+
+	// queue a job
+	void push (const job_t& Job);
+
+	// block until all queued jobs have been run
+	void wait();
+
+	unsigned int size() const { return m_threads.size(); }
+
+	// default worker count
+	static unsigned int hardware_threads();
+
+private:
+	void worker();
+
+	std::vector<std::thread> m_threads;
+
+	std::mutex m_mutex;
+	std::condition_variable m_job_available;
+	std::condition_variable m_jobs_done;
+
+	std::deque<job_t> m_jobs;
+	unsigned long m_pending_jobs;
+	bool m_stop;
+};
+
+#endif // _misc_thread_pool_h_
+
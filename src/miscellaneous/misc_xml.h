@@ -22,6 +22,8 @@
 #ifndef _misc_xml_h_
 #define _misc_xml_h_
 
+#include "misc_string_functions.h"
+
 #include "tinyxml/tinystr.h"
 #include "tinyxml/tinyxml.h"
 
@@ -321,12 +321,7 @@ void opengl_view::box_selection(int window_width, int window_height)
 		{
 			//Height of the block
 			const double width = block->m_width;
-
-			const unsigned long max_properties = std::max (block->input_count(), (unsigned long)block->m_outputs.size()); // cast required by some unusual compilers (e.g. gcc version 4.1.3 20070929 (prerelease))
-
-			// set minimal block height
-			const double height1 = m_services->is_rolled (block) ? width : (width * (1.0 / 3.7) * static_cast<double> (max_properties));
-			const double height = (height1 < m_min_block_height) ? m_min_block_height : height1;
+			const double height = m_services->get_block_height (block, m_min_block_height);
 
 			//Above block
 			bool block_inside = false;
@@ -557,11 +552,11 @@ void opengl_view::draw_shader(int window_width, int window_height)
 
 	// draw connections
 	glColor3f (0.8, 0.4, 0.4);
-		shrimp::dag_t scene_dag = m_services->get_scene_dag();
+		const shrimp::dag_t& scene_dag = m_services->get_scene_dag();
 		for (shrimp::dag_t::const_iterator connection = scene_dag.begin(); connection != scene_dag.end(); ++connection) {
 
-			const shrimp::io_t to = connection->first;
-			const shrimp::io_t from = connection->second;
+			const shrimp::pad_t to = connection->first;
+			const shrimp::pad_t from = connection->second;
 
 			double to_x = 0;
 			double to_y = 0;
@@ -572,15 +567,15 @@ void opengl_view::draw_shader(int window_width, int window_height)
 			if (property_positions.end() == to_property) {
 
 				// if the property has a parent, get its position
-				const shader_block* block = m_services->get_block (to.first);
-				const std::string parent = block->get_input_parent (to.second);
+				const shader_block* block = m_services->get_block (to.block);
+				const std::string parent = block->get_input_parent (shrimp::name_string (to.pad));
 				if (!parent.empty()) {
 
 					// get the parent property's position
-					const positions_t::const_iterator parent_property = property_positions.find (shrimp::io_t (to.first, parent));
+					const positions_t::const_iterator parent_property = property_positions.find (shrimp::pad_t (to.block, shrimp::intern (parent)));
 					if (property_positions.end() == parent_property) {
 
-						log() << error << "parent property '" << parent << "' not found in block '" << to.first << "'" << std::endl;
+						log() << error << "parent property '" << parent << "' not found in block '" << block->name() << "'" << std::endl;
 					} else {
 						to_x = parent_property->second.position_x;
 						to_y = parent_property->second.position_y;
@@ -611,7 +606,7 @@ void opengl_view::draw_shader(int window_width, int window_height)
 
 					} else {
 
-						log() << error << "start property '" << to.first << "-" << to.second << "' not found." << std::endl;
+						log() << error << "start property '" << block->name() << "-" << shrimp::name_string (to.pad) << "' not found." << std::endl;
 						continue;
 					}
 
@@ -625,7 +620,7 @@ void opengl_view::draw_shader(int window_width, int window_height)
 			const positions_t::const_iterator from_property = property_positions.find (from);
 			if (property_positions.end() == from_property) {
 
-				const shader_block* block = m_services->get_block (from.first);
+				const shader_block* block = m_services->get_block (from.block);
 
 				// property not found, may be part of a group or rolled block
 				const int block_group = m_services->get_block_group (block);
@@ -650,7 +645,7 @@ void opengl_view::draw_shader(int window_width, int window_height)
 
 				} else {
 
-					log() << error << "end property '" << from.first << "-" << from.second << "' not found." << std::endl;
+					log() << error << "end property '" << block->name() << "-" << shrimp::name_string (from.pad) << "' not found." << std::endl;
 					continue;
 				}
 			}
@@ -693,7 +688,8 @@ void opengl_view::draw_shader(int window_width, int window_height)
 	// draw connection in progress
 	if (m_connection_start.first != "")
 	{
-		const positions_t::const_iterator start_property = property_positions.find (m_connection_start);
+		shrimp::pad_t start_pad;
+		const positions_t::const_iterator start_property = m_services->find_pad (m_connection_start, start_pad) ? property_positions.find (start_pad) : property_positions.end();
 		if (property_positions.end() == start_property) {
 
 			log() << error << "connection start property '" << m_connection_start.first << "-" << m_connection_start.second << "' not found." << std::endl;
@@ -993,11 +989,7 @@ void opengl_view::draw_block (shader_block* Block, const double X, const double
 void opengl_view::draw_block_body (shader_block* Block, const double X, const double Y)
 {
 	const double width = Block->m_width;
-	const unsigned long max_properties = std::max (Block->input_count(), static_cast<unsigned long>( Block->m_outputs.size() )); 
-
-	// set minimal block height
-	const double height1 = m_services->is_rolled (Block) ? width : (width * (1.0 / 3.7) * static_cast<double> (max_properties));
-	const double height = (height1 < m_min_block_height) ? m_min_block_height : height1;
+	const double height = m_services->get_block_height (Block, m_min_block_height);
 
 	const double alpha = 0.5;
 
@@ -1094,11 +1086,7 @@ void opengl_view::draw_block_body (shader_block* Block, const double X, const do
 void opengl_view::draw_rolled_block_body (shader_block* Block, const double X, const double Y) {
 
 	const double width = Block->m_width;
-	const unsigned long max_properties = std::max (Block->input_count(), static_cast<unsigned long>( Block->m_outputs.size() )); 
-
-	// set minimal block height
-	const double height1 = m_services->is_rolled (Block) ? width : (width * (1.0 /3.7) * static_cast<double> (max_properties));
-	const double height = (height1 < m_min_block_height) ? m_min_block_height : height1;
+	const double height = m_services->get_block_height (Block, m_min_block_height);
 
 	const double alpha = 0.5;
 
@@ -1150,6 +1138,7 @@ void opengl_view::draw_block_name (const shader_block* Block, const double X, co
 void opengl_view::draw_block_properties (const shader_block* Block, const double X, const double Y, positions_t& PropertyPositions, const bool Selection) {
 
 	const double width = Block->m_width;
+	const shrimp::block_handle_t block_handle = Block->handle();
 
 	// draw properties
 	const double property_size = 1.0/5.0;
@@ -1187,7 +1176,7 @@ void opengl_view::draw_block_properties (const shader_block* Block, const double
 		if (input->m_multi_operator_parent_name.empty())
 			draw_property (input->m_name, type, shader_param, start_x, start_y, property_size, input->is_multi_operator());
 
-		PropertyPositions.insert (std::make_pair (shrimp::io_t (Block->name(), input->m_name), position (start_x + property_size / 2, start_y - property_size / 2)));
+		PropertyPositions.insert (std::make_pair (shrimp::pad_t (block_handle, input->pad_name()), position (start_x + property_size / 2, start_y - property_size / 2)));
 
 		start_y -= property_size * (3.0/2.0);
 	}
@@ -1210,7 +1199,7 @@ void opengl_view::draw_block_properties (const shader_block* Block, const double
 			type = "selected";
 
 		draw_property (output->m_name, type, shader_param, start_x, start_y, property_size);
-		PropertyPositions.insert (std::make_pair (shrimp::io_t (Block->name(), output->m_name), position (start_x + property_size / 2, start_y - property_size / 2)));
+		PropertyPositions.insert (std::make_pair (shrimp::pad_t (block_handle, output->pad_name()), position (start_x + property_size / 2, start_y - property_size / 2)));
 
 		start_y -= property_size * (3.0/2.0);
 	}
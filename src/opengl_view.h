@@ -29,6 +29,8 @@
 
 #include <sigc++/signal.h>
 
+#include <unordered_map>
+
 class opengl_view
 {
 public:
@@ -101,7 +103,7 @@ private:
 		double position_x;
 		double position_y;
 	};
-	typedef std::map<shrimp::io_t, position> positions_t;
+	typedef std::unordered_map<shrimp::pad_t, position, shrimp::pad_hash> positions_t;
 
 	// handle block groups
 	typedef std::map<int, position> group_position_t;
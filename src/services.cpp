@@ -165,7 +165,7 @@ void services::copy_blocks(const std::string& Name, const int Group)
 	// copy author
 	new_block->m_author = BlockToCopy->m_author;
 	// copy usage
-	new_block->set_usage(BlockToCopy->m_usage);
+	new_block->m_usage = BlockToCopy->m_usage;
 
 	// copy properties
 	// input and output properties
@@ -200,7 +200,6 @@ void services::copy_blocks(const std::string& Name, const int Group)
 	// copy shader code
 		new_block->m_includes = BlockToCopy->m_includes;
 		new_block->m_code = BlockToCopy->m_code;
-		new_block->m_code_written = BlockToCopy->m_code_written;
 
 		const copy_block_t New (NewName, new_block);
 		const copy_block_t Org (Name,BlockToCopy);
@@ -229,8 +228,10 @@ void services::copy_connections()
 	// copy connections
 	for (shrimp::dag_t::const_iterator connection = m_scene->m_dag.begin(); connection != m_scene->m_dag.end(); ++connection)
 	{
-		const copy_block_t to = (std::make_pair (connection->first.first,get_block(connection->first.first)));
-		const copy_block_t from = (std::make_pair (connection->second.first,get_block(connection->second.first)));
+		const shrimp::io_t connection_to = m_scene->get_io (connection->first);
+		const shrimp::io_t connection_from = m_scene->get_io (connection->second);
+		const copy_block_t to = (std::make_pair (connection_to.first,get_block(connection_to.first)));
+		const copy_block_t from = (std::make_pair (connection_from.first,get_block(connection_from.first)));
 
 		// found connections to copy
 		shader_blocks_copy_t::const_iterator i = m_copy_selection.find(to);
@@ -239,7 +240,7 @@ void services::copy_connections()
 
 		if (!(check_block == check_block_end))
 		{
-			const shrimp::io_t to_copy = (std::make_pair (i->second.first,connection->first.second));
+			const shrimp::io_t to_copy = (std::make_pair (i->second.first,connection_to.second));
 
 			shader_blocks_copy_t::const_iterator j = m_copy_selection.find(from);
 
@@ -247,7 +248,7 @@ void services::copy_connections()
 			shader_block* check_block_end2 = m_copy_selection.end()->first.second;
 			if (!(check_block2 == check_block_end2))
 			{
-				const shrimp::io_t from_copy = (std::make_pair (j->second.first,connection->second.second));
+				const shrimp::io_t from_copy = (std::make_pair (j->second.first,connection_from.second));
 
 				// add connection to the m_dag_copy structure
 				m_scene->m_dag_copy.insert (std::make_pair (to_copy,from_copy));
@@ -276,7 +277,7 @@ void services::paste_blocks()
 	}
 
 	// pasted connection of pasted blocks
-	for (shrimp::dag_t::const_iterator connection = m_scene->m_dag_copy.begin(); connection != m_scene->m_dag_copy.end(); ++connection) {
+	for (shrimp::io_connections_t::const_iterator connection = m_scene->m_dag_copy.begin(); connection != m_scene->m_dag_copy.end(); ++connection) {
 		const shrimp::io_t to = connection->first;
 		const shrimp::io_t from = connection->second;
 		connect (to, from);
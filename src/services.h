@@ -51,15 +51,18 @@ public:
 	block_tree_node_t get_block_hierarchy();
 
 	shrimp::shader_blocks_t get_scene_blocks() { return m_scene->get_scene_blocks(); }
+	double get_block_height (const shader_block* Block, const double MinimumHeight) const { return m_scene->get_block_height (Block, MinimumHeight); }
 
 	std::string get_unique_block_name (const std::string& Name) const { return m_scene->get_unique_block_name (Name); }
 
 	shader_block* get_block (const std::string& Name) { return m_scene->get_block (Name); }
+	shader_block* get_block (const shrimp::block_handle_t Handle) { return m_scene->get_block (Handle); }
 	void set_block_name (shader_block* Block, const std::string& NewName) { m_scene->set_block_name (Block, NewName); }
 	void delete_block (const std::string& BlockName) { m_scene->delete_block (BlockName); }
 	shader_block* add_custom_block (const std::string& Name = "New block", const bool RootBlock = false) { return m_scene->add_custom_block (Name, RootBlock); }
 
-	shrimp::dag_t get_scene_dag() { return m_scene->m_dag; }
+	const shrimp::dag_t& get_scene_dag() { return m_scene->m_dag; }
+	bool find_pad (const shrimp::io_t& IO, shrimp::pad_t& Pad) const { return m_scene->find_pad (IO, Pad); }
 
 	shader_block* get_parent (const std::string& BlockName, const std::string& Input, std::string& ParentOutput) const { return m_scene->get_parent (BlockName, Input, ParentOutput); }
 
@@ -70,6 +73,8 @@ public:
 
 	std::string show_code() { return m_scene->get_shader_code(); }
 	void show_preview (const std::string& TempDir) { m_scene->show_preview (TempDir); }
+	preview_runner::status_t update_preview() { return m_scene->update_preview(); }
+	void update_speculative_compilation (const std::string& TempDir) { m_scene->update_speculative_compilation (TempDir); }
 	void export_scene (const std::string& Directory) { m_scene->export_scene (Directory); }
 
 	//////////// Selection
@@ -0,0 +1,276 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "block_cache.h"
+#include "shader_block.h"
+
+#include "../miscellaneous/logging.h"
+#include "../miscellaneous/misc_binary_stream.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#include <sys/stat.h>
+#if defined _WIN32
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <unistd.h>
+#endif
+
+
+namespace
+{
+
+// cache file header
+const char cache_magic[8] = { 'P', 'R', 'A', 'W', 'N', 'B', 'C', '\0' };
+// to be incremented whenever the block record layout or the stamps change
+// (2: nanosecond modification times)
+const uint32_t cache_version = 2;
+// detects a cache written on a machine with another byte order
+const uint32_t cache_byte_order = 0x01020304;
+
+}
+
+
+block_cache::block_cache (const std::string& CacheFile) :
+	m_file (CacheFile),
+	m_data (0),
+	m_size (0),
+	m_modified (false)
+{
+#if defined _WIN32
+	std::ifstream file (m_file.c_str(), std::ios::in | std::ios::binary);
+	if (!file.good()) {
+		return;
+	}
+
+	m_buffer.assign (std::istreambuf_iterator<char> (file), std::istreambuf_iterator<char>());
+	m_data = m_buffer.data();
+	m_size = m_buffer.size();
+#else
+	const int file = open (m_file.c_str(), O_RDONLY);
+	if (file < 0) {
+		return;
+	}
+
+	struct stat file_status;
+	if (fstat (file, &file_status) == 0 && file_status.st_size > 0) {
+
+		void* data = mmap (0, file_status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (data != MAP_FAILED) {
+			m_data = static_cast<const char*> (data);
+			m_size = file_status.st_size;
+		}
+	}
+
+	close (file);
+#endif
+
+	if (m_data && !read_entries()) {
+
+		log() << info << "ignoring invalid block cache " << m_file << std::endl;
+		m_entries.clear();
+		unmap();
+	}
+}
+
+
+block_cache::~block_cache() {
+
+	unmap();
+}
+
+
+void block_cache::unmap() {
+
+#if defined _WIN32
+	m_buffer.clear();
+#else
+	if (m_data) {
+		munmap (const_cast<char*> (m_data), m_size);
+	}
+#endif
+
+	m_data = 0;
+	m_size = 0;
+}
+
+
+bool block_cache::read_entries() {
+
+	binary::reader reader (m_data, m_size);
+
+	const char* magic = reader.skip (sizeof (cache_magic));
+	if (!magic || std::memcmp (magic, cache_magic, sizeof (cache_magic)) != 0) {
+		return false;
+	}
+
+	uint32_t version = 0;
+	uint32_t byte_order = 0;
+	uint32_t count = 0;
+	if (!reader.read_uint32 (version) || version != cache_version
+		|| !reader.read_uint32 (byte_order) || byte_order != cache_byte_order
+		|| !reader.read_uint32 (count)) {
+		return false;
+	}
+
+	for (uint32_t e = 0; e < count; ++e) {
+
+		std::string path;
+		entry_t entry;
+		uint64_t record_size = 0;
+		if (!reader.read_string (path)
+			|| !reader.read_uint64 (entry.stamp.modification_time)
+			|| !reader.read_uint64 (entry.stamp.size)
+			|| !reader.read_uint64 (record_size)) {
+			return false;
+		}
+
+		entry.record = reader.skip (record_size);
+		entry.record_size = record_size;
+		if (!entry.record) {
+			return false;
+		}
+
+		m_entries[path] = entry;
+	}
+
+	return reader.at_end();
+}
+
+
+bool block_cache::get_stamp (const std::string& FilePath, stamp_t& Stamp) {
+
+	struct stat file_status;
+	if (stat (FilePath.c_str(), &file_status) != 0) {
+		return false;
+	}
+
+	// an edit within the same second that keeps the size must change the stamp
+	Stamp.modification_time = static_cast<uint64_t> (file_status.st_mtime) * 1000000000;
+#if defined __APPLE__
+	Stamp.modification_time += file_status.st_mtimespec.tv_nsec;
+#elif !defined _WIN32
+	Stamp.modification_time += file_status.st_mtim.tv_nsec;
+#endif
+	Stamp.size = file_status.st_size;
+	return true;
+}
+
+
+shader_block* block_cache::load_block (const std::string& FilePath, const stamp_t& Stamp) const {
+
+	entries_t::const_iterator entry = m_entries.find (FilePath);
+	if (entry == m_entries.end() || !(entry->second.stamp == Stamp)) {
+		return 0;
+	}
+
+	binary::reader reader (entry->second.record, entry->second.record_size);
+
+	shader_block* block = new shader_block (FilePath, "");
+	if (!block->read_binary (reader) || !reader.at_end()) {
+
+		log() << info << "invalid block cache record for " << FilePath << std::endl;
+		delete block;
+		return 0;
+	}
+
+	return block;
+}
+
+
+void block_cache::store_block (const std::string& FilePath, const stamp_t& Stamp, const shader_block& Block) {
+
+	std::string& record = m_new_records[FilePath];
+	record.clear();
+
+	binary::writer writer (record);
+	Block.write_binary (writer);
+
+	entry_t entry;
+	entry.stamp = Stamp;
+	entry.record = record.data();
+	entry.record_size = record.size();
+	m_kept_entries[FilePath] = entry;
+
+	m_modified = true;
+}
+
+
+void block_cache::keep_block (const std::string& FilePath) {
+
+	entries_t::const_iterator entry = m_entries.find (FilePath);
+	if (entry != m_entries.end()) {
+		m_kept_entries[FilePath] = entry->second;
+	}
+}
+
+
+bool block_cache::save() {
+
+	if (!m_modified && m_kept_entries.size() == m_entries.size()) {
+		// nothing changed
+		return true;
+	}
+
+	std::string content;
+	binary::writer writer (content);
+	writer.write_raw (cache_magic, sizeof (cache_magic));
+	writer.write_uint32 (cache_version);
+	writer.write_uint32 (cache_byte_order);
+	writer.write_uint32 (m_kept_entries.size());
+
+	for (entries_t::const_iterator entry = m_kept_entries.begin(); entry != m_kept_entries.end(); ++entry) {
+
+		writer.write_string (entry->first);
+		writer.write_uint64 (entry->second.stamp.modification_time);
+		writer.write_uint64 (entry->second.stamp.size);
+		writer.write_uint64 (entry->second.record_size);
+		writer.write_raw (entry->second.record, entry->second.record_size);
+	}
+
+	// write a new file then replace the old one, the mapped content stays valid
+	const std::string new_file = m_file + ".new";
+	std::ofstream file (new_file.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	file.write (content.data(), content.size());
+	file.close();
+	if (!file.good()) {
+
+		log() << error << "couldn't write block cache " << new_file << std::endl;
+		std::remove (new_file.c_str());
+		return false;
+	}
+
+#if defined _WIN32
+	std::remove (m_file.c_str());
+#endif
+	if (std::rename (new_file.c_str(), m_file.c_str()) != 0) {
+
+		log() << error << "couldn't replace block cache " << m_file << std::endl;
+		std::remove (new_file.c_str());
+		return false;
+	}
+
+	return true;
+}
+
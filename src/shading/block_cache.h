@@ -0,0 +1,97 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _block_cache_h_
+#define _block_cache_h_
+
+#include <map>
+#include <string>
+
+#include <stdint.h>
+
+class shader_block;
+
+// Persistent cache of the parsed block library:
+// blocks are stored in a binary file (memory-mapped when read back),
+// along with their XML file's modification time and size
+class block_cache
+{
+public:
+	// modification time (in nanoseconds, when the file system has them) and size of a block file
+	struct stamp_t
+	{
+		uint64_t modification_time;
+		uint64_t size;
+
+		bool operator== (const stamp_t& Other) const {
+			return modification_time == Other.modification_time && size == Other.size;
+		}
+	};
+
+	// map an existing cache file (an invalid or outdated one is ignored)
+	block_cache (const std::string& CacheFile);
+	~block_cache();
+
+	// get a file's stamp, returns false if the file can't be read
+	static bool get_stamp (const std::string& FilePath, stamp_t& Stamp);
+
+	// create the block cached for the given file, 0 when the file isn't cached
+	// or has changed since (can be called from several threads)
+	shader_block* load_block (const std::string& FilePath, const stamp_t& Stamp) const;
+
+	// record the blocks to keep: once saved, the cache only contains
+	// the blocks stored or kept since it was opened
+	void store_block (const std::string& FilePath, const stamp_t& Stamp, const shader_block& Block);
+	void keep_block (const std::string& FilePath);
+
+	// write the cache file, if its content changed
+	bool save();
+
+private:
+	std::string m_file;
+
+	// mapped cache file
+	const char* m_data;
+	size_t m_size;
+	std::string m_buffer;
+
+	// cache content, block records point into the mapped file or to new records
+	struct entry_t
+	{
+		stamp_t stamp;
+		const char* record;
+		size_t record_size;
+	};
+	typedef std::map<std::string, entry_t> entries_t;
+	entries_t m_entries;
+
+	// content of the next save
+	typedef std::map<std::string, std::string> records_t;
+	records_t m_new_records;
+	entries_t m_kept_entries;
+	bool m_modified;
+
+	bool read_entries();
+	void unmap();
+};
+
+#endif // _block_cache_h_
+
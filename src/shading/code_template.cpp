@@ -0,0 +1,145 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "code_template.h"
+#include "rib_root_block_parsing.h"
+
+#include <mutex>
+
+
+namespace
+{
+
+// templates by code text (interned texts have a single address), the template
+// holds its code so the address can't be reused while the template is alive
+typedef std::unordered_map<const std::string*, std::weak_ptr<const code_template> > templates_t;
+
+templates_t& templates() {
+
+	static templates_t templates;
+	return templates;
+}
+
+std::mutex& templates_mutex() {
+
+	static std::mutex mutex;
+	return mutex;
+}
+
+}
+
+
+std::shared_ptr<const code_template> code_template::get (const shared_string& Code) {
+
+	{
+		std::lock_guard<std::mutex> lock (templates_mutex());
+
+		templates_t::const_iterator cached = templates().find (&Code.str());
+		if (cached != templates().end()) {
+
+			std::shared_ptr<const code_template> code = cached->second.lock();
+			if (code) {
+				return code;
+			}
+		}
+	}
+
+	// make the template unlocked, blocks may be loaded by several threads
+	std::shared_ptr<const code_template> code (new code_template (Code));
+
+	std::lock_guard<std::mutex> lock (templates_mutex());
+
+	// keep the template made by another thread in the meantime, if any
+	std::weak_ptr<const code_template>& cached = templates()[&Code.str()];
+	std::shared_ptr<const code_template> existing = cached.lock();
+	if (existing) {
+		return existing;
+	}
+
+	cached = code;
+	return code;
+}
+
+
+code_template::code_template (const shared_string& Code) :
+	m_code (Code)
+{
+	// rewrite the array expressions RSL doesn't accept
+	const std::string code = rewrite_arrays (Code, m_local_declarations);
+
+	// split the code into literals and $(tag)s
+	std::string literal;
+	std::string::size_type position = 0;
+	while (position < code.size()) {
+
+		const std::string::size_type tag_start = code.find ("$(", position);
+		if (tag_start == std::string::npos) {
+			break;
+		}
+
+		// find the tag's end, a tag can't contain another one
+		std::string::size_type tag_end = tag_start + 2;
+		while (tag_end < code.size() && code[tag_end] != ')'
+			&& !(code[tag_end] == '$' && tag_end + 1 < code.size() && code[tag_end + 1] == '(')) {
+			++tag_end;
+		}
+
+		if (tag_end >= code.size() || code[tag_end] != ')') {
+
+			// not a tag, keep it as text
+			literal.append (code, position, tag_end - position);
+			position = tag_end;
+			continue;
+		}
+
+		literal.append (code, position, tag_start - position);
+		m_literals.push_back (literal);
+		literal.clear();
+
+		m_tags.push_back (code.substr (tag_start + 2, tag_end - tag_start - 2));
+		position = tag_end + 1;
+	}
+
+	if (position < code.size()) {
+		literal.append (code, position, std::string::npos);
+	}
+	m_literals.push_back (literal);
+}
+
+
+void code_template::expand (const values_t& Values, std::string& Output) const {
+
+	for (std::vector<std::string>::size_type t = 0; t < m_tags.size(); ++t) {
+
+		Output += m_literals[t];
+
+		const values_t::const_iterator value = Values.find (m_tags[t]);
+		if (value != Values.end()) {
+			Output += value->second;
+		}
+		else {
+			Output += "$(" + m_tags[t] + ")";
+		}
+	}
+
+	Output += m_literals.back();
+}
+
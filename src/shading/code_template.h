@@ -0,0 +1,67 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _code_template_h_
+#define _code_template_h_
+
+#include "../miscellaneous/misc_shared_string.h"
+
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A block's RSL code, prepared once for code generation: arrays are rewritten
+// (see rib_root_block_parsing.h) and the result is split into literal text and
+// $(...) tags, so that expanding it is a single pass over the code
+class code_template
+{
+public:
+	// return the template of the given code, shared by all blocks having the same (interned) code
+	static std::shared_ptr<const code_template> get (const shared_string& Code);
+
+	// the code the template was made from
+	const shared_string& code() const { return m_code; }
+
+	// local variable declarations required by the array rewriting
+	const std::set<std::string>& local_declarations() const { return m_local_declarations; }
+
+	// tag values, by tag content : "blockname", "input", "input:type"...
+	typedef std::unordered_map<std::string, std::string> values_t;
+
+	// append the code to Output, replacing the tags by their values
+	// (tags that have no value are output as is)
+	void expand (const values_t& Values, std::string& Output) const;
+
+private:
+	code_template (const shared_string& Code);
+
+	shared_string m_code;
+	std::set<std::string> m_local_declarations;
+
+	// literal text, and the tags found between literals (there's one literal more than tags)
+	std::vector<std::string> m_literals;
+	std::vector<std::string> m_tags;
+};
+
+#endif // _code_template_h_
+
@@ -0,0 +1,114 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "code_writer.h"
+
+#include "../miscellaneous/logging.h"
+
+#include <cstring>
+
+
+namespace
+{
+
+// output buffer of files, generated shaders and RIB files are often large
+const std::vector<char>::size_type file_buffer_size = 1 << 16;
+
+}
+
+
+code_writer::code_writer (const std::string& File) :
+	m_buffer (file_buffer_size),
+	m_output (m_file)
+{
+	// the buffer has to be set before opening the file
+	m_file.rdbuf()->pubsetbuf (&m_buffer[0], m_buffer.size());
+	m_file.open (File.c_str(), std::ios::out | std::ios::trunc);
+	if (!m_file.good()) {
+		log() << error << "couldn't open '" << File << "' for writing." << std::endl;
+	}
+}
+
+
+code_writer::code_writer (std::ostream& Output) :
+	m_output (Output)
+{
+}
+
+
+bool code_writer::good() const
+{
+	return m_output.good();
+}
+
+
+bool code_writer::close()
+{
+	if (m_file.is_open()) {
+		m_file.close();
+	}
+
+	return !m_output.fail();
+}
+
+
+code_writer& code_writer::operator<< (const std::string& Code)
+{
+	m_output.write (Code.data(), Code.size());
+	m_structure.add_bytes (reinterpret_cast<const unsigned char*> (Code.data()), Code.size());
+
+	return *this;
+}
+
+
+code_writer& code_writer::operator<< (const char* Code)
+{
+	const size_t size = std::strlen (Code);
+	m_output.write (Code, size);
+	m_structure.add_bytes (reinterpret_cast<const unsigned char*> (Code), size);
+
+	return *this;
+}
+
+
+code_writer& code_writer::operator<< (const char Code)
+{
+	m_output.put (Code);
+	m_structure.add_bytes (reinterpret_cast<const unsigned char*> (&Code), 1);
+
+	return *this;
+}
+
+
+void code_writer::value (const std::string& Value)
+{
+	m_output.write (Value.data(), Value.size());
+
+	// a marker stands for the value
+	const unsigned char marker = 0;
+	m_structure.add_bytes (&marker, 1);
+}
+
+
+std::string code_writer::structure_key() const
+{
+	return m_structure.hex();
+}
@@ -0,0 +1,76 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _code_writer_h_
+#define _code_writer_h_
+
+#include "../miscellaneous/misc_content_hash.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Streaming output of generated code (shaders, RIB files): the code is written
+// as it's produced instead of being assembled in a string first.
+// The writer also keeps the key of the code's structure, i.e. the code without
+// the values written with value() (see shader_cache::compilation_key())
+class code_writer
+{
+public:
+	// write to a stream
+	code_writer (std::ostream& Output);
+	// write to a file, through a large buffer
+	code_writer (const std::string& File);
+
+	// false when the output failed
+	bool good() const;
+	// flush and close the file written to (it's closed by the destructor otherwise)
+	bool close();
+
+	code_writer& operator<< (const std::string& Code);
+	code_writer& operator<< (const char* Code);
+	code_writer& operator<< (const char Code);
+
+	// numbers, formatted like a standard stream does
+	template<typename value_t>
+	code_writer& operator<< (const value_t& Value)
+	{
+		std::ostringstream text;
+		text << Value;
+		return *this << text.str();
+	}
+
+	// write a value that isn't part of the structure
+	void value (const std::string& Value);
+
+	// key of the code written so far, without the values
+	std::string structure_key() const;
+
+private:
+	std::vector<char> m_buffer;
+	std::ofstream m_file;
+	std::ostream& m_output;
+
+	content_hash m_structure;
+};
+
+#endif // _code_writer_h_
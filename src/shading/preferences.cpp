@@ -21,6 +21,24 @@
 
 #include "preferences.h"
 
+#include <atomic>
+#include <mutex>
+
+
+namespace
+{
+
+// preferences returned by general_options::current()
+std::mutex current_options_mutex;
+std::shared_ptr<const general_options> current_options;
+std::string current_options_stamp;
+
+// incremented by each save, so that the saved preferences are reloaded
+std::atomic<unsigned long> saved_options (0);
+unsigned long current_options_saved = 0;
+
+}
+
 
 general_options::general_options() :
 	m_preferences_file ("preferences.xml"),
@@ -83,6 +101,10 @@ bool general_options::load() {
 					const std::string name (a->Name());
 					if (name == "compiled_extension") {
 						m_compiled_shader_extension = trim (a->Value());
+					} else if (name == "jobs") {
+						m_compilation_jobs = from_string (trim (a->Value()), 0u);
+					} else if (name == "speculative") {
+						m_speculative_compilation = from_string (trim (a->Value()), true);
 					}
 				}
 
@@ -171,6 +193,8 @@ bool general_options::load() {
 		log() << aspect << "Loaded preferences :" << std::endl;
 		log() << aspect << "   shader compiler  : " << m_shader_compiler << std::endl;
 		log() << aspect << "   shader extension : " << m_compiled_shader_extension << std::endl;
+		log() << aspect << "   compilation jobs : " << m_compilation_jobs << std::endl;
+		log() << aspect << "   speculative      : " << m_speculative_compilation << std::endl;
 		log() << aspect << "   renderer         : " << m_renderer << std::endl;
 		log() << aspect << "   output width     : " << m_output_width << std::endl;
 		log() << aspect << "   output height    : " << m_output_height << std::endl;
@@ -200,6 +224,8 @@ bool general_options::save() {
 
 	xml::element compilation ("compilation_command");
 	compilation.push_attribute ("compiled_extension", m_compiled_shader_extension);
+	compilation.push_attribute ("jobs", string_cast (m_compilation_jobs));
+	compilation.push_attribute ("speculative", string_cast (m_speculative_compilation));
 	compilation.set_text (m_shader_compiler);
 	prefs.push_child (compilation);
 
@@ -234,6 +260,8 @@ bool general_options::save() {
 	xml::output_tree (prefs, out_file);
 	out_file.close();
 
+	++saved_options;
+
 	return true;
 }
 
@@ -242,6 +270,8 @@ void general_options::set_defaults() {
 
 	m_shader_compiler = "aqsl -I%i %s -o %o";
 	m_compiled_shader_extension = "slx";
+	m_compilation_jobs = 0;
+	m_speculative_compilation = true;
 	m_renderer_code = "aqsis";
 	m_renderer = "aqsis -DRENDERER=%r %s -shaders=%i";
 	m_renderer_display = "framebuffer";
@@ -264,18 +294,66 @@ std::string general_options::get_RIB_scene() {
 
 	load();
 
-	dirent** scene_files;
-	const int scene_count = fltk::filename_list (m_rib_scene_dir.c_str(), &scene_files);
+	return read_RIB_scene();
+}
+
+
+std::shared_ptr<const general_options> general_options::current() {
+
+	std::lock_guard<std::mutex> lock (current_options_mutex);
+
+	if (current_options && current_options_saved == saved_options && current_options->files_stamp() == current_options_stamp) {
+		return current_options;
+	}
+
+	// the stamp is taken before reading the files, a change while they're read triggers another reload
+	std::shared_ptr<general_options> options (new general_options());
+	const std::string stamp = options->files_stamp();
+	const unsigned long saved = saved_options;
+
+	options->load();
+	options->m_RIB_scene = options->read_RIB_scene();
+
+	current_options = options;
+	current_options_stamp = stamp;
+	current_options_saved = saved;
+
+	return current_options;
+}
+
+
+const std::string& general_options::RIB_scene() const {
+
+	return m_RIB_scene;
+}
+
+
+std::string general_options::files_stamp() const {
+
+	std::string stamp = system_functions::file_stamp (preferences_file());
+	stamp += '|' + system_functions::file_stamp (m_rib_renderer_file);
+	stamp += '|' + system_functions::file_stamp (m_rib_scene_dir);
+	for (scenes_t::const_iterator s = m_scenes.begin(); s != m_scenes.end(); ++s) {
+		stamp += '|' + system_functions::file_stamp (s->file);
+	}
+
+	return stamp;
+}
+
+
+std::string general_options::read_RIB_scene() {
+
+	std::vector<std::string> scene_files;
+	system_functions::list_directory (m_rib_scene_dir, scene_files);
 
 	std::string scene_path ("");
-	for (int f = 0; f < scene_count; ++f) {
+	for (std::vector<std::string>::const_iterator f = scene_files.begin(); f != scene_files.end(); ++f) {
 
-		const std::string file = std::string (scene_files[f]->d_name);
+		const std::string& file = *f;
 		const std::string file_path = m_rib_scene_dir + "/" + file;
-		if (!fltk::filename_isdir (file_path.c_str())) {
+		if (!system_functions::is_directory (file_path)) {
 
-			const char* extension = fltk::filename_ext (file.c_str());
-			if (std::string (extension) == ".rib") {
+			if (system_functions::file_extension (file) == ".rib") {
 
 				const std::string name (file.begin(), file.end() - 4);
 				if (name == m_scene) {
@@ -285,12 +363,8 @@ std::string general_options::get_RIB_scene() {
 				}
 			}
 		}
-
-		free (scene_files[f]);
 	}
 
-	free (scene_files);
-
 	// load and return the file
 	if (scene_path.size()) {
 
@@ -437,7 +511,7 @@ void general_options::load_renderer_list() {
 }
 
 
-general_options::renderers_t general_options::get_renderer_list() {
+general_options::renderers_t general_options::get_renderer_list() const {
 
 	return m_renderers;
 }
@@ -448,21 +522,16 @@ void general_options::load_scene_list()
 	m_scene.clear();
 
 	// load scene list
-	dirent** scene_files = 0;
-	const int scene_count = fltk::filename_list (m_rib_scene_dir.c_str(), &scene_files);
-
-	if (scene_count > 0)
+	std::vector<std::string> scene_files;
+	if (system_functions::list_directory (m_rib_scene_dir, scene_files))
 	{
-		typedef std::vector<std::string> names_t;
-		names_t scene_paths;
-		for (int f = 0; f < scene_count; ++f)
+		for (std::vector<std::string>::const_iterator f = scene_files.begin(); f != scene_files.end(); ++f)
 		{
-			const std::string file = std::string (scene_files[f]->d_name);
+			const std::string& file = *f;
 			const std::string file_path = rib_scene_dir() + "/" + file;
-			if (!fltk::filename_isdir (file_path.c_str()))
+			if (!system_functions::is_directory (file_path))
 			{
-				const char* extension = fltk::filename_ext (file.c_str());
-				if (std::string(extension) == ".rib")
+				if (system_functions::file_extension (file) == ".rib")
 				{
 					// save XML file
 					const std::string name (file.begin(), file.end() - 4);
@@ -476,16 +545,12 @@ void general_options::load_scene_list()
 					m_scenes.push_back (new_scene);
 				}
 			}
-
-			free (scene_files[f]);
 		}
-
-		free (scene_files);
 	}
 }
 
 
-general_options::scenes_t general_options::get_scene_list()
+general_options::scenes_t general_options::get_scene_list() const
 {
 	return m_scenes;
 }
@@ -533,7 +598,7 @@ void general_options::set_help (const std::string& Help_Reader){
 
 }
 
-const std::string general_options::preferences_file() {
+const std::string general_options::preferences_file() const {
 
 	std::string file = system_functions::get_shrimp_user_directory();
 	file += '/' + m_preferences_file;
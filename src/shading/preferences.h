@@ -28,6 +28,7 @@
 #include "../miscellaneous/misc_xml.h"
 
 #include <fstream>
+#include <memory>
 #include <string>
 
 // all renderers must be referenced here, they're used by FLTK's callbacks
@@ -83,6 +84,10 @@ public:
 	std::string m_renderer_code;
 	std::string m_shader_compiler;
 	std::string m_compiled_shader_extension;
+	// number of shaders compiled at the same time (0 means one per hardware thread)
+	unsigned int m_compilation_jobs;
+	// compile the shaders in the background while the scene is edited
+	bool m_speculative_compilation;
 	std::string m_renderer;
 	std::string m_renderer_display;
 	std::string m_pixel_filter;
@@ -111,10 +116,16 @@ public:
 	std::string get_RIB_scene();
 
 	void load_renderer_list();
-	renderers_t get_renderer_list();
+	renderers_t get_renderer_list() const;
 
 	void load_scene_list();
-	scenes_t get_scene_list();
+	scenes_t get_scene_list() const;
+
+	// loaded preferences shared by all readers, they're reloaded after a save() or when
+	// the preferences, renderer or scene files change (get a new one for each task instead of keeping it)
+	static std::shared_ptr<const general_options> current();
+	// the RIB scene template, read once with the preferences returned by current()
+	const std::string& RIB_scene() const;
 
 	void set_renderer (const std::string& RendererCode);
 	void set_display (const std::string& RendererDisplay);
@@ -123,7 +134,14 @@ public:
 	void set_help (const std::string& Help);
 
 private:
-	const std::string preferences_file();
+	const std::string preferences_file() const;
+
+	// read the RIB scene template (without loading the preferences)
+	std::string read_RIB_scene();
+	// stamp of the files the preferences are read from
+	std::string files_stamp() const;
+
+	std::string m_RIB_scene;
 };
 
 #endif // _preferences_h_
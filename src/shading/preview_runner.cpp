@@ -0,0 +1,137 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "preview_runner.h"
+
+#include "../miscellaneous/logging.h"
+
+
+preview_runner::preview_runner() :
+	m_cancelled (false),
+	m_state (IDLE)
+{
+}
+
+
+preview_runner::~preview_runner()
+{
+	cancel();
+
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+}
+
+
+void preview_runner::start (job_generator_t Generate, std::unique_ptr<shader_cache> Cache, const unsigned int Concurrency)
+{
+	// output the previous preview's messages
+	status();
+
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+
+	std::lock_guard<std::mutex> lock (m_mutex);
+	m_jobs.reset();
+	m_cancelled = false;
+	m_cache = std::move (Cache);
+	m_state = RUNNING;
+
+	m_thread = std::thread (&preview_runner::run, this, std::move (Generate), Concurrency);
+}
+
+
+void preview_runner::cancel()
+{
+	std::lock_guard<std::mutex> lock (m_mutex);
+	if (m_state == RUNNING)
+	{
+		if (m_jobs)
+		{
+			m_jobs->cancel();
+		}
+		else
+		{
+			m_cancelled = true;
+		}
+	}
+}
+
+
+bool preview_runner::running() const
+{
+	std::lock_guard<std::mutex> lock (m_mutex);
+	return m_state == RUNNING;
+}
+
+
+preview_runner::status_t preview_runner::status()
+{
+	status_t status;
+	log_messages_t messages;
+	{
+		std::lock_guard<std::mutex> lock (m_mutex);
+		status.state = m_state;
+		status.finished_jobs = m_jobs ? m_jobs->finished_jobs() : 0;
+		status.jobs = m_jobs ? m_jobs->jobs().size() : 0;
+
+		messages.swap (m_log);
+	}
+
+	replay_log (messages);
+
+	return status;
+}
+
+
+void preview_runner::run (job_generator_t Generate, const unsigned int Concurrency)
+{
+	// log() isn't shared between threads, messages are output by status()
+	log_capture messages;
+
+	// the scene files and the jobs are written here, the main thread only reads the progress
+	std::unique_ptr<job_graph> jobs (new job_graph());
+	Generate (*jobs, m_cache.get());
+
+	{
+		std::lock_guard<std::mutex> lock (m_mutex);
+		m_jobs = std::move (jobs);
+		if (m_cancelled)
+		{
+			m_jobs->cancel();
+		}
+	}
+
+	const bool succeeded = m_jobs->run (Concurrency);
+
+	if (m_cache)
+	{
+		m_cache->store_compiled_shaders (*m_jobs);
+		log() << info << "shader cache: " << m_cache->hits() << " hit(s), " << m_cache->misses() << " miss(es)" << std::endl;
+	}
+
+	std::lock_guard<std::mutex> lock (m_mutex);
+	m_state = m_jobs->cancelled() ? CANCELLED : (succeeded ? DONE : FAILED);
+	m_log = messages.messages();
+}
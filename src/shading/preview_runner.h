@@ -0,0 +1,94 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _preview_runner_h_
+#define _preview_runner_h_
+
+#include "shader_cache.h"
+
+#include "../miscellaneous/logging.h"
+#include "../miscellaneous/misc_job_graph.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Writes the files of a preview and runs its jobs (shader compilations, then rendering)
+// on a background thread, so that the interface stays responsive
+class preview_runner
+{
+public:
+	typedef enum
+	{
+		IDLE,
+		RUNNING,
+		DONE,
+		FAILED,
+		CANCELLED
+	} state_t;
+
+	struct status_t
+	{
+		state_t state;
+		unsigned long finished_jobs;
+		unsigned long jobs;
+	};
+
+	// writes the preview's files and fills its jobs, on the preview thread
+	typedef std::function<void (job_graph& Jobs, shader_cache* Cache)> job_generator_t;
+
+	preview_runner();
+	// cancel the running preview, and wait for it
+	~preview_runner();
+
+	// start generating the jobs then running them, the previous preview must be over (see running());
+	// the cache stores the shaders compiled by the jobs
+	void start (job_generator_t Generate, std::unique_ptr<shader_cache> Cache, const unsigned int Concurrency);
+
+	// stop the running preview: the jobs that didn't start are skipped
+	void cancel();
+
+	bool running() const;
+
+	// return the preview's progress, once it's over the messages it logged are output
+	// (to be called from the main thread)
+	status_t status();
+
+private:
+	std::thread m_thread;
+	mutable std::mutex m_mutex;
+
+	// null while the jobs are being generated
+	std::unique_ptr<job_graph> m_jobs;
+	// cancelled before the jobs were generated
+	bool m_cancelled;
+	std::unique_ptr<shader_cache> m_cache;
+
+	state_t m_state;
+	// messages logged by the preview thread, not output yet
+	log_messages_t m_log;
+
+	void run (job_generator_t Generate, const unsigned int Concurrency);
+};
+
+#endif // _preview_runner_h_
@@ -25,19 +25,104 @@
 
 #include "scene.h"
 #include "preferences.h"
-#include "rib_root_block_parsing.h"
 
 #include "../miscellaneous/logging.h"
+#include "../miscellaneous/misc_job_graph.h"
 #include "../miscellaneous/misc_string_functions.h"
+#include "../miscellaneous/misc_thread_pool.h"
 
+#include <algorithm>
 #include <fstream>
+#include <map>
+
+
+namespace
+{
+
+// property types by type tag: "$(p:type)" -> "float"
+typedef std::map<std::string, std::string> type_tags_t;
+
+void add_type_tags (const shader_block& Block, type_tags_t& Types)
+{
+	// inputs first, the first type found for a tag is the one used
+	for (shader_block::properties_t::const_iterator input = Block.m_inputs.begin(); input != Block.m_inputs.end(); ++input) {
+		Types.insert (std::make_pair ("$(" + input->m_name + ":type)", input->get_type_for_declaration()));
+	}
+	for (shader_block::properties_t::const_iterator output = Block.m_outputs.begin(); output != Block.m_outputs.end(); ++output) {
+		Types.insert (std::make_pair ("$(" + output->m_name + ":type)", output->get_type_for_declaration()));
+	}
+}
+
+// variable values of a template: "$(shaders)" -> "Surface ..."
+typedef std::map<std::string, std::string> template_variables_t;
+
+// write a template, replacing its variables in a single pass (unknown ones are kept)
+void write_template (code_writer& Output, const std::string& Template, const template_variables_t& Variables)
+{
+	std::string::size_type position = 0;
+	while (true) {
+
+		const std::string::size_type variable_start = Template.find ("$(", position);
+		const std::string::size_type variable_end = variable_start == std::string::npos ? std::string::npos : Template.find (')', variable_start);
+		if (variable_end == std::string::npos) {
+			break;
+		}
+
+		Output << Template.substr (position, variable_start - position);
+
+		const template_variables_t::const_iterator value = Variables.find (Template.substr (variable_start, variable_end + 1 - variable_start));
+		if (value != Variables.end()) {
+			Output << value->second;
+		} else {
+			Output << Template.substr (variable_start, variable_end + 1 - variable_start);
+		}
+
+		position = variable_end + 1;
+	}
+
+	Output << Template.substr (position);
+}
+
+// replace the type tags of a local variable declaration, in a single pass
+std::string resolve_types (const std::string& Declaration, const type_tags_t& Types)
+{
+	std::string resolved;
+	std::string::size_type position = 0;
+	while (true) {
+
+		const std::string::size_type tag_start = Declaration.find ("$(", position);
+		const std::string::size_type tag_end = tag_start == std::string::npos ? std::string::npos : Declaration.find (')', tag_start);
+		if (tag_end == std::string::npos) {
+			break;
+		}
+
+		resolved.append (Declaration, position, tag_start - position);
+
+		const type_tags_t::const_iterator type = Types.find (Declaration.substr (tag_start, tag_end + 1 - tag_start));
+		if (type != Types.end()) {
+			resolved += type->second;
+		} else {
+			resolved.append (Declaration, tag_start, tag_end + 1 - tag_start);
+		}
+
+		position = tag_end + 1;
+	}
+
+	resolved.append (Declaration, position, std::string::npos);
+	return resolved;
+}
+
+}
 
 
 rib_root_block::rib_root_block (const std::string& Name, scene* Scene) :
 	shader_block (Name, "", true),
 	root_type ("RIB"),
 	m_scene (Scene),
-	m_AOV (true)
+	m_AOV (true),
+	m_observed_revision (0),
+	m_speculated_revision (0),
+	m_speculating (false)
 {
 
 	// add inputs
@@ -57,16 +142,23 @@ rib_root_block::rib_root_block (const std::string& Name, scene* Scene) :
 }
 
 
-std::string rib_root_block::show_code()
+std::string rib_root_block::show_code (const unsigned int Threads)
 {
 	std::string shader_list ("");
 
-	const std::string surface = build_shader_file (SURFACE, "preview_surface");
-	const std::string displacement = build_shader_file (DISPLACEMENT, "preview_displacement");
-	const std::string light = build_shader_file (LIGHT, "preview_light");
-	const std::string volume = build_shader_file (VOLUME, "preview_volume");
+	shader_builds_t shaders;
+	add_shader_build (SURFACE, "preview_surface", shaders);
+	add_shader_build (DISPLACEMENT, "preview_displacement", shaders);
+	add_shader_build (LIGHT, "preview_light", shaders);
+	add_shader_build (VOLUME, "preview_volume", shaders);
 
-	shader_list += surface + "\n" + displacement + "\n" + light + "\n" + volume + "\n";
+	take_shader_sources (shaders);
+	build_shaders (shaders, false, Threads);
+
+	for (shader_builds_t::const_iterator shader = shaders.begin(); shader != shaders.end(); ++shader)
+	{
+		shader_list += shader->code + "\n";
+	}
 
 	return shader_list;
 }
@@ -74,19 +166,113 @@ std::string rib_root_block::show_code()
 
 void rib_root_block::show_preview (const std::string& SceneDirectory)
 {
-	command_list_t commands;
-	write_scene_and_shaders (SceneDirectory, commands);
+	// a newer preview supersedes the running one: it's started by update_preview()
+	// once the running one is cancelled (the files it uses can't be overwritten before);
+	// a speculative compilation of the current scene is left to finish, the preview uses its shaders
+	if (m_preview.running())
+	{
+		if (!m_speculating || m_speculated_revision != shader_block::current_revision())
+		{
+			m_preview.cancel();
+		}
+
+		m_pending_preview = SceneDirectory;
+		return;
+	}
+
+	start_preview (SceneDirectory, true);
+}
+
+
+preview_runner::status_t rib_root_block::update_preview()
+{
+	preview_runner::status_t status = m_preview.status();
+	if (status.state != preview_runner::RUNNING && !m_pending_preview.empty())
+	{
+		const std::string directory = m_pending_preview;
+		m_pending_preview.clear();
+
+		start_preview (directory, true);
+		status = m_preview.status();
+	}
+
+	// speculative compilations aren't previews
+	if (m_speculating && m_pending_preview.empty())
+	{
+		status.state = preview_runner::IDLE;
+	}
+
+	return status;
+}
+
+
+void rib_root_block::update_speculative_compilation (const std::string& SceneDirectory)
+{
+	const unsigned long revision = shader_block::current_revision();
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	// wait until the scene stops changing
+	if (revision != m_observed_revision)
+	{
+		m_observed_revision = revision;
+		m_observed_time = now;
+
+		// a running speculative compilation is out of date (unless a preview waits for it)
+		if (m_speculating && m_preview.running() && m_pending_preview.empty())
+		{
+			m_preview.cancel();
+		}
+
+		return;
+	}
+
+	if (revision == m_speculated_revision || now - m_observed_time < std::chrono::milliseconds (750))
+	{
+		return;
+	}
 
-	// output commands in a file for debugging purposes
-	const std::string command_file (SceneDirectory + '/' + "command_debug.txt");
-	write_command_list (commands, command_file);
+	// previews come first
+	if (m_preview.running() || !m_pending_preview.empty())
+	{
+		return;
+	}
 
-	// execute commands
-	for (command_list_t::const_iterator c = commands.begin(); c != commands.end(); ++c)
+	m_speculated_revision = revision;
+
+	const std::shared_ptr<const general_options> prefs = general_options::current();
+	if (!prefs->m_speculative_compilation)
 	{
-		system_functions::execute_command (*c);
+		return;
 	}
 
+	start_preview (SceneDirectory, false);
+}
+
+
+void rib_root_block::start_preview (const std::string& SceneDirectory, const bool Render)
+{
+	// unchanged shaders are taken from the cache instead of being compiled
+	std::unique_ptr<shader_cache> cache (new shader_cache (system_functions::get_shrimp_user_directory() + "/shader_cache"));
+
+	// only the snapshot is taken here, the interface isn't stalled by large networks
+	std::shared_ptr<scene_snapshot_t> snapshot (new scene_snapshot_t());
+	take_scene_snapshot (SceneDirectory, *snapshot);
+	m_speculating = !Render;
+
+	// write the shaders and the scene, compile the shaders concurrently, then render, in the background
+	const std::shared_ptr<const general_options> prefs = general_options::current();
+	m_preview.start ([this, snapshot, SceneDirectory, Render] (job_graph& Jobs, shader_cache* Cache) {
+
+		write_scene_and_shaders (SceneDirectory, *snapshot, Jobs, Cache, Render);
+
+		// output commands in a file for debugging purposes
+		if (Render)
+		{
+			const std::string command_file (SceneDirectory + '/' + "command_debug.txt");
+			write_command_list (Jobs, command_file);
+		}
+	}, std::move (cache), prefs->m_compilation_jobs);
+
 /*
 	int pid = fork();
 	if(pid == -1)
@@ -118,15 +304,35 @@ void rib_root_block::show_preview (const std::string& SceneDirectory)
 }
 
 
-void rib_root_block::export_scene (const std::string& SceneDirectory)
+bool rib_root_block::export_scene (const std::string& SceneDirectory, const bool Compile)
 {
-	// output scene, get commmand list
-	command_list_t commands;
-	write_scene_and_shaders (SceneDirectory, commands);
+	if (!Compile)
+	{
+		// output scene, get commmand list
+		scene_snapshot_t snapshot;
+		take_scene_snapshot (SceneDirectory, snapshot);
+		job_graph jobs;
+		write_scene_and_shaders (SceneDirectory, snapshot, jobs, 0);
+
+		// write command file (with the dependencies of each command)
+		const std::string command_file (SceneDirectory + '/' + "command_list.txt");
+		write_command_list (jobs, command_file);
+
+		return true;
+	}
+
+	// output scene and compile its shaders, one at a time (scenes are compiled concurrently by prawn-batch),
+	// exported shaders keep their parameter values as defaults
+	shader_cache cache (system_functions::get_shrimp_user_directory() + "/shader_cache");
+	scene_snapshot_t snapshot;
+	take_scene_snapshot (SceneDirectory, snapshot);
+	job_graph jobs;
+	write_scene_and_shaders (SceneDirectory, snapshot, jobs, &cache, false, false);
+
+	const bool compiled = jobs.run (1);
+	cache.store_compiled_shaders (jobs);
 
-	// write command file
-	const std::string command_file (SceneDirectory + '/' + "command_list.txt");
-	write_command_list (commands, command_file);
+	return compiled;
 }
 
 
@@ -170,7 +376,7 @@ bool rib_root_block::get_AOV()
 bool rib_root_block::has_connected_parent (const std::string& PadName)
 {
 	std::string foo;
-	if (m_scene->get_parent (name(), PadName, foo))
+	if (m_scene->get_parent (this, PadName, foo))
 	{
 		return true;
 	}
@@ -189,9 +395,9 @@ shrimp::shader_blocks_t rib_root_block::get_all_shader_blocks (const shader_t Sh
 		{
 			// get surface parents (Ci and Oi)
 			std::string Ci_output_name;
-			shader_block* Ci_parent = m_scene->get_parent (name(), "Ci", Ci_output_name);
+			shader_block* Ci_parent = m_scene->get_parent (this, "Ci", Ci_output_name);
 			std::string Oi_output_name;
-			shader_block* Oi_parent = m_scene->get_parent (name(), "Oi", Oi_output_name);
+			shader_block* Oi_parent = m_scene->get_parent (this, "Oi", Oi_output_name);
 
 			// make sure there's something to build
 			if (!Ci_parent && !Oi_parent)
@@ -211,9 +417,9 @@ shrimp::shader_blocks_t rib_root_block::get_all_shader_blocks (const shader_t Sh
 		{
 			// get displacement parents (N and P)
 			std::string N_output_name;
-			shader_block* N_parent = m_scene->get_parent (name(), "N", N_output_name);
+			shader_block* N_parent = m_scene->get_parent (this, "N", N_output_name);
 			std::string P_output_name;
-			shader_block* P_parent = m_scene->get_parent (name(), "P", P_output_name);
+			shader_block* P_parent = m_scene->get_parent (this, "P", P_output_name);
 
 			// make sure there's something to build
 			if (!N_parent && !P_parent)
@@ -233,9 +439,9 @@ shrimp::shader_blocks_t rib_root_block::get_all_shader_blocks (const shader_t Sh
 		{
 			// get light parents (Cl and Ol)
 			std::string Cl_output_name;
-			shader_block* Cl_parent = m_scene->get_parent (name(), "Cl", Cl_output_name);
+			shader_block* Cl_parent = m_scene->get_parent (this, "Cl", Cl_output_name);
 			std::string Ol_output_name;
-			shader_block* Ol_parent = m_scene->get_parent (name(), "Ol", Ol_output_name);
+			shader_block* Ol_parent = m_scene->get_parent (this, "Ol", Ol_output_name);
 
 			// make sure there's something to build
 			if (!Cl_parent && !Ol_parent)
@@ -255,9 +461,9 @@ shrimp::shader_blocks_t rib_root_block::get_all_shader_blocks (const shader_t Sh
 		{
 			// get atmosphere parents (Cv and Ov)
 			std::string Cv_output_name;
-			shader_block* Cv_parent = m_scene->get_parent (name(), "Cv", Cv_output_name);
+			shader_block* Cv_parent = m_scene->get_parent (this, "Cv", Cv_output_name);
 			std::string Ov_output_name;
-			shader_block* Ov_parent = m_scene->get_parent (name(), "Ov", Ov_output_name);
+			shader_block* Ov_parent = m_scene->get_parent (this, "Ov", Ov_output_name);
 
 			// make sure there's something to build
 			if (!Cv_parent && !Ov_parent)
@@ -281,124 +487,248 @@ shrimp::shader_blocks_t rib_root_block::get_all_shader_blocks (const shader_t Sh
 }
 
 
-std::string rib_root_block::build_shader_file (const shader_t ShaderType, const std::string& ShaderName)
+void rib_root_block::add_shader_build (const shader_t ShaderType, const std::string& ShaderName, shader_builds_t& Builds, const std::string& File)
 {
-	// get the list of blocks composing the shader
-	shrimp::shader_blocks_t shader_blocks = get_all_shader_blocks (ShaderType);
-	if (!shader_blocks.size())
-	{
-		return "";
-	}
+	shader_build_t build;
+	build.type = ShaderType;
+	build.name = ShaderName;
+	build.file = File;
 
-	// initialize code build process, get includes, parameters and locals (stored in sets to make sure they're unique)
-	std::set<std::string> includes;
-	std::string parameters;
-	std::set<std::string> locals;
-	std::string shader_outputs;
-	for (shrimp::shader_blocks_t::const_iterator block = shader_blocks.begin(); block != shader_blocks.end(); ++block)
+	Builds.push_back (build);
+}
+
+
+void rib_root_block::take_shader_sources (shader_builds_t& Builds)
+{
+	// bring the layouts and the code fragments up to date first, the builds share the fragments
+	update_shader_layouts (Builds);
+
+	for (shader_builds_t::iterator build = Builds.begin(); build != Builds.end(); ++build)
 	{
-		shader_block* sb = *block;
+		const shader_layout_t& layout = m_layouts[build->type];
 
-		sb->reset_code_written();
-		sb->get_includes (includes);
+		bool untyped_locals = false;
+		build->fragments.clear();
+		build->fragments.reserve (layout.ordered_blocks.size());
+		for (std::vector<shader_block*>::const_iterator block = layout.ordered_blocks.begin(); block != layout.ordered_blocks.end(); ++block)
+		{
+			build->fragments.push_back ((*block)->m_code_fragment);
+			untyped_locals = untyped_locals || (*block)->m_code_fragment->untyped_locals;
+		}
 
-		// get parameter values (inputs that are not connected)
-		for (shader_block::properties_t::const_iterator input = sb->m_inputs.begin(); input != sb->m_inputs.end(); ++input)
+		build->code_fragments.clear();
+		build->code_fragments.reserve (layout.code_blocks.size());
+		for (std::vector<shader_block*>::const_iterator block = layout.code_blocks.begin(); block != layout.code_blocks.end(); ++block)
 		{
-			if (m_scene->is_connected (shrimp::io_t (sb->name(), input->m_name)))
-				continue;
+			build->code_fragments.push_back ((*block)->m_code_fragment);
+		}
 
-			if (input->m_shader_parameter)
+		// the types of the blocks' properties are only needed by locals declared for other blocks' properties
+		build->property_types.clear();
+		if (untyped_locals)
+		{
+			for (std::vector<shader_block*>::const_iterator block = layout.ordered_blocks.begin(); block != layout.ordered_blocks.end(); ++block)
 			{
-				parameters += "\t\t" + sb->input_type (input->m_name) + " " +
-						sb->sl_name() + "_" + input->m_name + " = " + input->value_as_sl_string() + ";\n";
+				add_type_tags (**block, build->property_types);
 			}
 		}
 
-		// get output values (as local or output variables)
-		//TODO test that each name is unique
-		for (shader_block::properties_t::const_iterator output = sb->m_outputs.begin(); output != sb->m_outputs.end(); ++output)
+		build->root_code = build_root_code (build->type);
+		build->scene_name = m_scene->name();
+		build->scene_authors = m_scene->authors();
+		build->scene_description = m_scene->description();
+	}
+}
+
+
+void rib_root_block::build_shaders (shader_builds_t& Builds, const bool K3DMeta, const unsigned int Threads) const
+{
+	// the builds share the preferences snapshot
+	const std::shared_ptr<const general_options> prefs = general_options::current();
+	const general_options::renderers_t& renderers = prefs->m_renderers;
+
+	thread_pool pool (Threads ? Threads : Builds.size());
+	for (shader_builds_t::iterator build_i = Builds.begin(); build_i != Builds.end(); ++build_i)
+	{
+		shader_build_t* build = &(*build_i);
+		pool.push ([this, build, K3DMeta, &renderers] {
+
+			log_capture capture;
+
+			// the shader is written as it's built
+			if (build->file.empty())
+			{
+				std::ostringstream code;
+				code_writer output (code);
+				build_shader_file (*build, renderers, output, build->rib_parameters);
+				build->code = code.str();
+				build->structure_key = output.structure_key();
+			}
+			else
+			{
+				code_writer output (build->file);
+				build_shader_file (*build, renderers, output, build->rib_parameters);
+				build->structure_key = output.structure_key();
+			}
+			if (K3DMeta)
+			{
+				build->k3d_meta = build_k3d_meta_file (*build);
+			}
+
+			build->log = capture.messages();
+		});
+	}
+	pool.wait();
+
+	// output the messages in build order
+	for (shader_builds_t::const_iterator build = Builds.begin(); build != Builds.end(); ++build)
+	{
+		replay_log (build->log);
+	}
+}
+
+
+void rib_root_block::update_shader_layouts (const shader_builds_t& Builds)
+{
+	const unsigned long network_revision = m_scene->network_revision();
+
+	std::vector<shrimp::block_handle_t> changed_blocks;
+	m_scene->take_changed_blocks (changed_blocks);
+
+	// remake the layouts made before the network changed, and check all their blocks
+	std::set<shader_t> remade_layouts;
+	for (shader_builds_t::const_iterator build = Builds.begin(); build != Builds.end(); ++build)
+	{
+		shader_layout_t& layout = m_layouts[build->type];
+		if (layout.network_revision == network_revision || !remade_layouts.insert (build->type).second)
 		{
+			continue;
+		}
+
+		// a network with a cycle is checked again on each build (the cycle is reported)
+		layout.network_revision = build_shader_layout (build->type, layout) ? network_revision : 0;
 
-			if (!output->m_shader_output)
+		for (shrimp::shader_blocks_t::const_iterator block = layout.blocks.begin(); block != layout.blocks.end(); ++block)
+		{
+			update_code_fragment (*block);
+		}
+	}
+
+	// other blocks only change with the blocks listed in the journal, and their children
+	// (the blocks of outdated layouts are checked once their layout is remade)
+	std::vector<shader_block*> blocks;
+	for (std::vector<shrimp::block_handle_t>::const_iterator handle = changed_blocks.begin(); handle != changed_blocks.end(); ++handle)
+	{
+		shader_block* block = m_scene->get_block (*handle);
+		if (!block)
+		{
+			continue;
+		}
+
+		blocks.push_back (block);
+		for (shader_block::properties_t::const_iterator output = block->m_outputs.begin(); output != block->m_outputs.end(); ++output)
+		{
+			const shrimp::dag_t::pads_t& children = m_scene->get_children (m_scene->get_pad (block, *output));
+			for (shrimp::dag_t::pads_t::const_iterator child = children.begin(); child != children.end(); ++child)
 			{
-				std::string otype = sb->output_type (output->m_name);
-				std::string array_size = "";
-				if (otype == "array")
+				if (shader_block* child_block = m_scene->get_block (child->block))
 				{
-					otype = sb->get_output_type_extension (output->m_name);
-					array_size = "[" + string_cast (sb->get_output_type_extension_size (output->m_name)) + "]";
+					blocks.push_back (child_block);
 				}
-
-				locals.insert (otype + " " + sb->sl_name() + "_" + output->m_name + array_size);
 			}
-			else
+		}
+	}
+
+	for (std::vector<shader_block*>::const_iterator block = blocks.begin(); block != blocks.end(); ++block)
+	{
+		for (shader_layouts_t::const_iterator layout = m_layouts.begin(); layout != m_layouts.end(); ++layout)
+		{
+			if (layout->second.network_revision == network_revision && layout->second.blocks.count (*block))
 			{
-				shader_outputs += "\t\toutput ";
-				const std::string storage = sb->output_storage (output->m_name);
-				shader_outputs += storage + " ";
-				shader_outputs += sb->output_type (output->m_name) + " " + output->m_name;
-				shader_outputs += " = 0;\n";
+				// the blocks of the layouts remade above were checked
+				if (!remade_layouts.count (layout->first))
+				{
+					update_code_fragment (*block);
+				}
+				break;
 			}
 		}
 	}
+}
 
-	// shader header
-	std::string shader_header = "";
+
+bool rib_root_block::build_shader_layout (const shader_t ShaderType, shader_layout_t& Layout)
+{
+	Layout.blocks = get_all_shader_blocks (ShaderType);
+
+	// blocks in a reproducible order (the set is ordered by address)
+	Layout.ordered_blocks = order_blocks (Layout.blocks);
+
+	// the code is written from the root block's parents
+	const char* root_inputs[2] = { "", "" };
 	switch (ShaderType)
 	{
 		case SURFACE:
-			// Preset AOVs, shader arguments, so we initialize them
-			shader_header += "surface " + ShaderName
-				+ "(\n\tDEFAULT_AOV_OUTPUT_PARAMETERS\n";
+			root_inputs[0] = "Ci";
+			root_inputs[1] = "Oi";
 		break;
 
 		case DISPLACEMENT:
-			shader_header += "displacement " + ShaderName
-				+ "(\n\tDEFAULT_AOV_OUTPUT_PARAMETERS\n";
+			root_inputs[0] = "N";
+			root_inputs[1] = "P";
 		break;
 
 		case LIGHT:
-		/* NOTE: we could use light categories for nondiffuse and
-		 * nonspecular instead */
-			shader_header += "light " + ShaderName
-				+ "(\n"
-				+ "\t/* predefined light outputs */\n"
-				+ "\toutput uniform float __nondiffuse = 0;\n"
-				+ "\toutput uniform float __nonspecular = 0;\n"
-				+ "\toutput uniform string __category = \"\";\n"
-				+ "\toutput varying color __shadow = color(0);\n"
-				+ "\tDEFAULT_AOV_OUTPUT_PARAMETERS\n";
+			root_inputs[0] = "Cl";
+			root_inputs[1] = "Ol";
 		break;
 
 		case VOLUME:
-			shader_header += "volume " + ShaderName
-				+ "(\n\tDEFAULT_AOV_OUTPUT_PARAMETERS\n";
+			root_inputs[0] = "Cv";
+			root_inputs[1] = "Ov";
 		break;
 
 		default:
 			log() << error << "unhandled shader type.";
 	}
 
+	bool acyclic = true;
+	Layout.code_blocks.clear();
+	shrimp::shader_blocks_t written_blocks;
+	for (unsigned int i = 0; i < 2; ++i)
+	{
+		std::string output_name;
+		shader_block* parent = m_scene->get_parent (this, root_inputs[i], output_name);
 
-	// actual function code
-	std::string block_code;
+		// make sure the parent block is not output twice (if connected to both root block inputs)
+		if (parent && !written_blocks.count (parent))
+		{
+			acyclic = build_shader_code (parent, written_blocks, Layout.code_blocks) && acyclic;
+		}
+	}
+
+	return acyclic;
+}
+
+
+std::string rib_root_block::build_root_code (const shader_t ShaderType)
+{
+	std::string root_code;
 	switch (ShaderType)
 	{
 		case SURFACE:
 		{
 			// get surface parents (Ci and Oi)
 			std::string Ci_output_name;
-			shader_block* Ci_parent = m_scene->get_parent (name(), "Ci", Ci_output_name);
+			shader_block* Ci_parent = m_scene->get_parent (this, "Ci", Ci_output_name);
 			std::string Oi_output_name;
-			shader_block* Oi_parent = m_scene->get_parent (name(), "Oi", Oi_output_name);
+			shader_block* Oi_parent = m_scene->get_parent (this, "Oi", Oi_output_name);
 
 			// build code
 			std::string surface_code = "\tCi = $(Ci);\n\tOi = $(Oi);";
 
 			if (Ci_parent) {
 
-				build_shader_code (Ci_parent, block_code, locals);
 				replace_variable (surface_code, "$(Ci)", Ci_parent->sl_name() + "_" + Ci_output_name);
 			} else {
 				replace_variable (surface_code, "$(Ci)", get_input_value ("Ci"));
@@ -406,22 +736,18 @@ std::string rib_root_block::build_shader_file (const shader_t ShaderType, const
 
 			if (Oi_parent) {
 
-				// make sure the parent block is not output twice (if connected to both root block inputs)
-				if (!Oi_parent->m_code_written) {
-					build_shader_code (Oi_parent, block_code, locals);
-				}
 				replace_variable (surface_code, "$(Oi)", Oi_parent->sl_name() + "_" + Oi_output_name);
 			} else {
 				replace_variable (surface_code, "$(Oi)", get_input_value ("Oi"));
 			}
 
-			block_code += surface_code;
-			block_code += "\n";
+			root_code += surface_code;
+			root_code += "\n";
 			// call getshadows macro to store __shadow into aov_shadows
 			// add a comment to the code
-			block_code += "\t// call macro to accumulate __shadow into aov_shadows\n";
-			block_code += "\tgetshadows(P);\n";
-			block_code += "\n";
+			root_code += "\t// call macro to accumulate __shadow into aov_shadows\n";
+			root_code += "\tgetshadows(P);\n";
+			root_code += "\n";
 		}
 		break;
 
@@ -429,16 +755,15 @@ std::string rib_root_block::build_shader_file (const shader_t ShaderType, const
 		{
 			// get displacement parents (N and P)
 			std::string N_output_name;
-			shader_block* N_parent = m_scene->get_parent (name(), "N", N_output_name);
+			shader_block* N_parent = m_scene->get_parent (this, "N", N_output_name);
 			std::string P_output_name;
-			shader_block* P_parent = m_scene->get_parent (name(), "P", P_output_name);
+			shader_block* P_parent = m_scene->get_parent (this, "P", P_output_name);
 
 			// build code
 			std::string displacement_code = "\tN = $(N);\n\tP = $(P);";
 
 			if (N_parent) {
 
-				build_shader_code (N_parent, block_code, locals);
 				replace_variable (displacement_code, "$(N)", N_parent->sl_name() + "_" + N_output_name);
 			} else {
 				replace_variable (displacement_code, "$(N)", get_input_value ("N"));
@@ -446,17 +771,13 @@ std::string rib_root_block::build_shader_file (const shader_t ShaderType, const
 
 			if (P_parent) {
 
-				// make sure the parent block is not output twice (if connected to both root block inputs)
-				if (!P_parent->m_code_written) {
-					build_shader_code (P_parent, block_code, locals);
-				}
 				replace_variable (displacement_code, "$(P)", P_parent->sl_name() + "_" + P_output_name);
 			} else {
 				replace_variable (displacement_code, "$(P)", get_input_value ("P"));
 			}
 
-			block_code += displacement_code;
-			block_code += "\n";
+			root_code += displacement_code;
+			root_code += "\n";
 		}
 		break;
 
@@ -464,9 +785,9 @@ std::string rib_root_block::build_shader_file (const shader_t ShaderType, const
 		{
 			// get light parents (Cl and Ol)
 			std::string Cl_output_name;
-			shader_block* Cl_parent = m_scene->get_parent (name(), "Cl", Cl_output_name);
+			shader_block* Cl_parent = m_scene->get_parent (this, "Cl", Cl_output_name);
 			std::string Ol_output_name;
-			shader_block* Ol_parent = m_scene->get_parent (name(), "Ol", Ol_output_name);
+			shader_block* Ol_parent = m_scene->get_parent (this, "Ol", Ol_output_name);
 
 			// build code
 			// seems Ol is not accepted by PRMan, add workaround
@@ -479,7 +800,6 @@ std::string rib_root_block::build_shader_file (const shader_t ShaderType, const
 
 			if (Cl_parent) {
 
-				build_shader_code (Cl_parent, block_code, locals);
 				replace_variable (light_code, "$(Cl)", Cl_parent->sl_name() + "_" + Cl_output_name);
 			} else {
 				replace_variable (light_code, "$(Cl)", get_input_value ("Cl"));
@@ -487,17 +807,13 @@ std::string rib_root_block::build_shader_file (const shader_t ShaderType, const
 
 			if (Ol_parent) {
 
-				// make sure the parent block is not output twice (if connected to both root block inputs)
-				if (!Ol_parent->m_code_written) {
-					build_shader_code (Ol_parent, block_code, locals);
-				}
 				replace_variable (light_code, "$(Ol)", Ol_parent->sl_name() + "_" + Ol_output_name);
 			} else {
 				replace_variable (light_code, "$(Ol)", get_input_value ("Ol"));
 			}
 
-			block_code += light_code;
-			block_code += "\n";
+			root_code += light_code;
+			root_code += "\n";
 		}
 		break;
 
@@ -505,16 +821,15 @@ std::string rib_root_block::build_shader_file (const shader_t ShaderType, const
 		{
 			// get atmosphere parents (Cv and Ov)
 			std::string Cv_output_name;
-			shader_block* Cv_parent = m_scene->get_parent (name(), "Cv", Cv_output_name);
+			shader_block* Cv_parent = m_scene->get_parent (this, "Cv", Cv_output_name);
 			std::string Ov_output_name;
-			shader_block* Ov_parent = m_scene->get_parent (name(), "Ov", Ov_output_name);
+			shader_block* Ov_parent = m_scene->get_parent (this, "Ov", Ov_output_name);
 
 			// build code
 			std::string atmosphere_code = "\tCi = $(Cv);\n\tOi = $(Ov);";
 
 			if (Cv_parent) {
 
-				build_shader_code (Cv_parent, block_code, locals);
 				replace_variable (atmosphere_code, "$(Cv)", Cv_parent->sl_name() + "_" + Cv_output_name);
 			} else {
 				replace_variable (atmosphere_code, "$(Cv)", get_input_value ("Cv"));
@@ -522,17 +837,13 @@ std::string rib_root_block::build_shader_file (const shader_t ShaderType, const
 
 			if (Ov_parent) {
 
-				// make sure the parent block is not output twice (if connected to both root block inputs)
-				if (!Ov_parent->m_code_written) {
-					build_shader_code (Ov_parent, block_code, locals);
-				}
 				replace_variable (atmosphere_code, "$(Ov)", Ov_parent->sl_name() + "_" + Ov_output_name);
 			} else {
 				replace_variable (atmosphere_code, "$(Ov)", get_input_value ("Ov"));
 			}
 
-			block_code += atmosphere_code;
-			block_code += "\n";
+			root_code += atmosphere_code;
+			root_code += "\n";
 		}
 		break;
 
@@ -540,138 +851,404 @@ std::string rib_root_block::build_shader_file (const shader_t ShaderType, const
 			log() << error << "unhandled shader type.";
 	}
 
+	return root_code;
+}
+
+
+bool rib_root_block::build_shader_file (const shader_build_t& Build, const general_options::renderers_t& Renderers, code_writer& Output, std::string& RIBParameters) const
+{
+	RIBParameters.clear();
+
+	// blocks composing the shader
+	if (Build.fragments.empty())
+	{
+		return false;
+	}
+
+	// gather includes, parameters and locals from the blocks' code fragments (stored in sets to make sure they're unique)
+	std::set<std::string> includes;
+	std::vector<const shader_block::code_fragment::parameter*> parameters;
+	std::set<std::string> locals;
+	std::string shader_outputs;
+	for (std::vector<shader_build_t::fragment_t>::const_iterator f = Build.fragments.begin(); f != Build.fragments.end(); ++f)
+	{
+		const shader_block::code_fragment& fragment = **f;
+
+		includes.insert (fragment.includes.begin(), fragment.includes.end());
+
+		// constant values are also passed through RIB, so that they aren't part of the shader structure
+		for (std::vector<shader_block::code_fragment::parameter>::const_iterator parameter = fragment.parameters.begin(); parameter != fragment.parameters.end(); ++parameter)
+		{
+			if (parameter->rib_value)
+			{
+				RIBParameters += " \"" + parameter->declaration + "\" [" + parameter->rib_values + "]";
+			}
+
+			parameters.push_back (&(*parameter));
+		}
+
+		locals.insert (fragment.output_locals.begin(), fragment.output_locals.end());
+		shader_outputs += fragment.shader_outputs;
+	}
+
+	// shader header
+	std::string shader_header = "";
+	switch (Build.type)
+	{
+		case SURFACE:
+			// Preset AOVs, shader arguments, so we initialize them
+			shader_header += "surface " + Build.name
+				+ "(\n\tDEFAULT_AOV_OUTPUT_PARAMETERS\n";
+		break;
+
+		case DISPLACEMENT:
+			shader_header += "displacement " + Build.name
+				+ "(\n\tDEFAULT_AOV_OUTPUT_PARAMETERS\n";
+		break;
+
+		case LIGHT:
+		/* NOTE: we could use light categories for nondiffuse and
+		 * nonspecular instead */
+			shader_header += "light " + Build.name
+				+ "(\n"
+				+ "\t/* predefined light outputs */\n"
+				+ "\toutput uniform float __nondiffuse = 0;\n"
+				+ "\toutput uniform float __nonspecular = 0;\n"
+				+ "\toutput uniform string __category = \"\";\n"
+				+ "\toutput varying color __shadow = color(0);\n"
+				+ "\tDEFAULT_AOV_OUTPUT_PARAMETERS\n";
+		break;
+
+		case VOLUME:
+			shader_header += "volume " + Build.name
+				+ "(\n\tDEFAULT_AOV_OUTPUT_PARAMETERS\n";
+		break;
+
+		default:
+			log() << error << "unhandled shader type.";
+	}
+
+
+	// add local variables required by the blocks' code (see update_code_fragment())
+	for (std::vector<shader_build_t::fragment_t>::const_iterator fragment = Build.code_fragments.begin(); fragment != Build.code_fragments.end(); ++fragment)
+	{
+		locals.insert ((*fragment)->locals.begin(), (*fragment)->locals.end());
+	}
+
+	// resolve the types left in local declarations (blocks declaring variables
+	// for properties of other blocks), each declaration is processed once
+	std::set<std::string> resolved_locals;
+	for (std::set<std::string>::const_iterator local = locals.begin(); local != locals.end(); ++local) {
+
+		if (local->find ("$(") == std::string::npos) {
+			resolved_locals.insert (resolved_locals.end(), *local);
+			continue;
+		}
+
+		resolved_locals.insert (resolve_types (*local, Build.property_types));
+	}
+	locals.swap (resolved_locals);
+
 
 	// write code
-	std::string shader_code = "/* Shader generated by Prawn\n";
-	shader_code += " * Author(s): " + m_scene->authors() + "\n"
-		+ " * Scene name: " + m_scene->name() + "\n"
-		+ " * Scene description:\n"
-		+ "  " + m_scene->description()
-		+ "\n\n"
-		+ "*/\n\n";
+	Output << "/* Shader generated by Prawn\n"
+		<< " * Author(s): " << Build.scene_authors << "\n"
+		<< " * Scene name: " << Build.scene_name << "\n"
+		<< " * Scene description:\n"
+		<< "  " << Build.scene_description
+		<< "\n\n"
+		<< "*/\n\n";
 
 	// initialize Shrimp's renderer constants with integer values
-	general_options prefs;
-	prefs.load();
-	general_options::renderers_t m_renderers = prefs.get_renderer_list();
 	unsigned long renderer_number = 1001;
 
-	shader_code += "/* Renderer constants */\n";
-	for (general_options::renderers_t::iterator r_i = m_renderers.begin(); r_i != m_renderers.end(); ++r_i, ++renderer_number)
+	Output << "/* Renderer constants */\n";
+	for (general_options::renderers_t::const_iterator r_i = Renderers.begin(); r_i != Renderers.end(); ++r_i, ++renderer_number)
 	{
-		//shader_code += "#ifndef " + r_i->first + "\n";
-		shader_code += " #define " + r_i->first + " " + string_cast (renderer_number) + "\n";
-		//shader_code += "#endif\n";
+		//Output << "#ifndef " << r_i->first << "\n";
+		Output << " #define " << r_i->first << " " << renderer_number << "\n";
+		//Output << "#endif\n";
 	}
 
-	shader_code += "\n";
-	shader_code += "/* Shrimp headers */\n";
+	Output << "\n";
+	Output << "/* Shrimp headers */\n";
 
 	/* all blocks should be aware of the AOV macros, so instead of including
 	 * shrimp_aov.h in all blocks, we might as well make it a part of the
 	 * standard shader body. */
-	shader_code += "#include \"rsl_aov.h\"\n";
+	Output << "#include \"rsl_aov.h\"\n";
 	// add required headers
 	for (std::set<std::string>::const_iterator i = includes.begin(); i != includes.end(); ++i)
-		shader_code += "#include \"" + *i + "\"\n";
+		Output << "#include \"" << *i << "\"\n";
 
-	shader_code += "\n\n";
+	Output << "\n\n";
 
-	shader_code += shader_header;
+	Output << shader_header;
 
-	// add function's parameters
-	shader_code += parameters + "\t/* User set parameters */\n";
-	shader_code += shader_outputs;
-	shader_code += "\t)\n";
+	// add function's parameters (the values passed through RIB aren't part of the structure)
+	for (std::vector<const shader_block::code_fragment::parameter*>::const_iterator p = parameters.begin(); p != parameters.end(); ++p)
+	{
+		Output << "\t\t" << (*p)->declaration << " = ";
+		if ((*p)->rib_value)
+			Output.value ((*p)->value);
+		else
+			Output << (*p)->value;
+		Output << ";\n";
+	}
+	Output << "\t/* User set parameters */\n";
+	Output << shader_outputs;
+	Output << "\t)\n";
 
 	// open function and write locals
-	shader_code += "{\n";
-	shader_code += "\tINIT_AOV_PARAMETERS\n";
-	shader_code += "\n";
-	shader_code += "\t/* Local variables */\n";
+	Output << "{\n";
+	Output << "\tINIT_AOV_PARAMETERS\n";
+	Output << "\n";
+	Output << "\t/* Local variables */\n";
 	for (std::set<std::string>::const_iterator local = locals.begin(); local != locals.end(); ++local)
-		shader_code += "\t" + *local + ";\n";
+		Output << "\t" << *local << ";\n";
 
-	shader_code += "\n";
-	shader_code += "\t/* Blocks follow */\n";
+	Output << "\n";
+	Output << "\t/* Blocks follow */\n";
 
-	shader_code += block_code;
-	shader_code += "\n}\n";
+	for (std::vector<shader_build_t::fragment_t>::const_iterator fragment = Build.code_fragments.begin(); fragment != Build.code_fragments.end(); ++fragment)
+		Output << (*fragment)->code << "\n";
+	Output << Build.root_code;
+	Output << "\n}\n";
 
-	return shader_code;
+	return true;
 }
 
 
-void rib_root_block::build_shader_code (shader_block* Block, std::string& ShaderCode, std::set<std::string>& LocalVariables)
+void rib_root_block::get_code_parents (shader_block* Block, std::vector<shader_block*>& Parents)
 {
-	log() << aspect << "building code for block '" << Block->name() << "'" << std::endl;
+	for (shader_block::properties_t::const_iterator input = Block->m_inputs.begin(); input != Block->m_inputs.end(); ++input) {
 
-	// get block's code
-	std::string code = Block->get_code();
+		std::string parent_output;
+		shader_block* parent = m_scene->get_parent (Block, *input, parent_output);
+		if (!parent) {
+			continue;
+		}
 
-	// create array value variables for arrays (two passes for nested ones, could need more)
-	code = create_array_value_variables (code, LocalVariables);
-	code = create_array_value_variables (code, LocalVariables);
+		if (!input->is_multi_operator() and input->m_multi_operator_parent_name.empty()) {
 
-	// replace arrays assignations (which are not allowed in RSL)
-	code = replace_array_assignations (code, LocalVariables);
+			// "normal" input
+			if (!parent->is_shader_output (parent_output)) {
+				Parents.push_back (parent);
+			}
 
-	// replace block name
-	replace_variable (code, "$(blockname)", Block->sl_name());
+		} else if (input->is_multi_operator()) {
 
-	// replace variable types: $(p:type) -> float (in case p is a float)
-	for (shader_block::properties_t::const_iterator input = Block->m_inputs.begin(); input != Block->m_inputs.end(); ++input) {
+			// get list of child inputs
+			std::vector<std::string> children;
+			children.push_back (input->m_name);
+			Block->get_multi_input_child_list (input->m_name, children);
 
-		const std::string tag = "$(" + input->m_name + ":type)";
-		replace_variable (code, tag, input->get_type_for_declaration());
+			for (std::vector<std::string>::const_iterator c = children.begin(); c != children.end(); ++c) {
 
-		// replace variable types in the LocalVariables (quick and dirty)
-		std::set<std::string> locals2;
-		for (std::set<std::string>::iterator local = LocalVariables.begin(); local != LocalVariables.end(); ++local)
-		{
-			std::string new_local = *local;
-			replace_variable (new_local, tag, input->get_type_for_declaration());
-			locals2.insert(new_local);
+				std::string input_parent_output ("");
+				shader_block* input_parent = m_scene->get_parent (Block, *c, input_parent_output);
+				if (input_parent && !input_parent->is_shader_output (input_parent_output)) {
+					Parents.push_back (input_parent);
+				}
+			}
+
+		} else if (!input->m_multi_operator_parent_name.empty()) {
+			// not processed here, but with the multi-operator
 		}
-		LocalVariables = locals2;
 	}
-	for (shader_block::properties_t::const_iterator output = Block->m_outputs.begin(); output != Block->m_outputs.end(); ++output) {
+}
 
-		const std::string tag = "$(" + output->m_name + ":type)";
-		replace_variable (code, tag, output->get_type_for_declaration());
 
-		// replace variable types in the LocalVariables (quick and dirty)
-		std::set<std::string> locals2;
-		for (std::set<std::string>::iterator local = LocalVariables.begin(); local != LocalVariables.end(); ++local)
-		{
-			std::string new_local = *local;
-			replace_variable (new_local, tag, output->get_type_for_declaration());
-			locals2.insert(new_local);
+std::vector<shader_block*> rib_root_block::order_blocks (const shrimp::shader_blocks_t& Blocks)
+{
+	// topological order: a block comes after its parents, blocks that are ready at the same time are taken by name
+	typedef std::map<shader_block*, std::vector<shader_block*> > children_t;
+	children_t children;
+	std::map<shader_block*, unsigned long> parent_count;
+	std::map<std::string, shader_block*> ready;
+	for (shrimp::shader_blocks_t::const_iterator block = Blocks.begin(); block != Blocks.end(); ++block) {
+
+		std::vector<shader_block*> parents;
+		get_code_parents (*block, parents);
+
+		std::set<shader_block*> unique_parents;
+		for (std::vector<shader_block*>::const_iterator parent = parents.begin(); parent != parents.end(); ++parent) {
+			if (Blocks.count (*parent) && unique_parents.insert (*parent).second) {
+				children[*parent].push_back (*block);
+			}
+		}
+
+		parent_count[*block] = unique_parents.size();
+		if (unique_parents.empty()) {
+			ready.insert (std::make_pair ((*block)->name(), *block));
 		}
-		LocalVariables = locals2;
 	}
 
-	// process input parents
+	std::vector<shader_block*> ordered;
+	ordered.reserve (Blocks.size());
+	while (!ready.empty()) {
+
+		shader_block* block = ready.begin()->second;
+		ready.erase (ready.begin());
+		ordered.push_back (block);
+
+		const children_t::const_iterator block_children = children.find (block);
+		if (block_children == children.end()) {
+			continue;
+		}
+
+		for (std::vector<shader_block*>::const_iterator child = block_children->second.begin(); child != block_children->second.end(); ++child) {
+			if (--parent_count[*child] == 0) {
+				ready.insert (std::make_pair ((*child)->name(), *child));
+			}
+		}
+	}
+
+	// blocks left are part of a cycle (reported when the code is built), add them by name
+	if (ordered.size() < Blocks.size()) {
+
+		std::map<std::string, shader_block*> remaining;
+		for (std::map<shader_block*, unsigned long>::const_iterator block = parent_count.begin(); block != parent_count.end(); ++block) {
+			if (block->second) {
+				remaining.insert (std::make_pair (block->first->name(), block->first));
+			}
+		}
+
+		for (std::map<std::string, shader_block*>::const_iterator block = remaining.begin(); block != remaining.end(); ++block) {
+			ordered.push_back (block->second);
+		}
+	}
+
+	return ordered;
+}
+
+
+bool rib_root_block::build_shader_code (shader_block* Block, shrimp::shader_blocks_t& WrittenBlocks, std::vector<shader_block*>& CodeBlocks)
+{
+	// depth-first walk of the block's parents, with an explicit stack (networks can be very deep):
+	// a block is written once all its parents are
+	struct pending_block_t
+	{
+		shader_block* block;
+		std::vector<shader_block*> parents;
+		std::vector<shader_block*>::size_type next_parent;
+	};
+	std::vector<pending_block_t> pending (1);
+	pending.back().block = Block;
+	pending.back().next_parent = 0;
+	get_code_parents (Block, pending.back().parents);
+
+	// blocks on the stack, to detect cycles
+	shrimp::shader_blocks_t visiting;
+	visiting.insert (Block);
+	bool acyclic = true;
+
+	while (!pending.empty()) {
+
+		pending_block_t& current = pending.back();
+		if (current.next_parent < current.parents.size()) {
+
+			shader_block* parent = current.parents[current.next_parent++];
+			if (WrittenBlocks.count (parent)) {
+				continue;
+			}
+
+			if (visiting.count (parent)) {
+				log() << error << "cycle in the network: block '" << parent->name() << "' is one of its own parents" << std::endl;
+				acyclic = false;
+				continue;
+			}
+
+			visiting.insert (parent);
+			pending.push_back (pending_block_t());
+			pending.back().block = parent;
+			pending.back().next_parent = 0;
+			get_code_parents (parent, pending.back().parents);
+			continue;
+		}
+
+		// all parents are written, write the block
+		shader_block* block = current.block;
+		CodeBlocks.push_back (block);
+
+		WrittenBlocks.insert (block);
+		visiting.erase (block);
+		pending.pop_back();
+	}
+
+	return acyclic;
+}
+
+
+void rib_root_block::update_code_fragment (shader_block* Block)
+{
+	// get the latest revision of the block's parents
+	unsigned long parents_revision = 0;
+	for (shader_block::properties_t::const_iterator input = Block->m_inputs.begin(); input != Block->m_inputs.end(); ++input) {
+
+		std::string parent_output;
+		if (shader_block* parent = m_scene->get_parent (Block, *input, parent_output)) {
+			parents_revision = std::max (parents_revision, parent->revision());
+		}
+	}
+
+	// rebuild the block's code when it or one of its parents changed
+	const shader_block::code_fragment& fragment = *Block->m_code_fragment;
+	if (fragment.revision < Block->revision() || fragment.revision < parents_revision) {
+
+		build_code_fragment (Block);
+	}
+}
+
+
+void rib_root_block::build_code_fragment (shader_block* Block)
+{
+	log() << aspect << "building code for block '" << Block->name() << "'" << std::endl;
+
+	// a new fragment replaces the block's one (shaders being written may still use the previous one)
+	std::shared_ptr<shader_block::code_fragment> new_fragment (new shader_block::code_fragment());
+	shader_block::code_fragment& fragment = *new_fragment;
+	const code_template& code = Block->get_code_template();
+
+	// variable types: $(p:type) -> float (in case p is a float)
+	type_tags_t types;
+	add_type_tags (*Block, types);
+
+	// local variable declarations, with their types
+	for (std::set<std::string>::const_iterator local = code.local_declarations().begin(); local != code.local_declarations().end(); ++local) {
+
+		const std::string declaration = resolve_types (*local, types);
+		fragment.untyped_locals = fragment.untyped_locals || declaration.find ("$(") != std::string::npos;
+		fragment.locals.insert (declaration);
+	}
+
+	// tag values, the first value set for a tag is the one used
+	code_template::values_t values;
+
+	// block name
+	values.insert (std::make_pair ("blockname", Block->sl_name()));
+
+	// variable types
+	for (type_tags_t::const_iterator type = types.begin(); type != types.end(); ++type) {
+		values.insert (std::make_pair (type->first.substr (2, type->first.size() - 3), type->second));
+	}
+
+	// input values
 	for (shader_block::properties_t::const_iterator input = Block->m_inputs.begin(); input != Block->m_inputs.end(); ++input) {
 
 		std::string parent_output;
-		shader_block* parent = m_scene->get_parent (Block->name(), input->m_name, parent_output);
+		shader_block* parent = m_scene->get_parent (Block, *input, parent_output);
 
 		if (parent) {
 
 			if (!input->is_multi_operator() and input->m_multi_operator_parent_name.empty()) {
 
-				// process "normal" input
-				if (!parent->m_code_written && !parent->is_shader_output (parent_output)) {
-					build_shader_code (parent, ShaderCode, LocalVariables);
-				}
-
 				// replace the variable with parent's output variable name (except with shader outputs)
 				if (!parent->is_shader_output (parent_output)) {
-					replace_variable (code, "$(" + input->m_name + ")", parent->sl_name() + "_" + parent_output);
+					values.insert (std::make_pair (input->m_name, parent->sl_name() + "_" + parent_output));
 				} else {
 					// replace with the shader output name string
-					replace_variable (code, "$(" + input->m_name + ")", '"' + parent_output + '"');
+					values.insert (std::make_pair (input->m_name, '"' + parent_output + '"'));
 				}
 			} else if (input->is_multi_operator()) {
 
@@ -681,28 +1258,25 @@ void rib_root_block::build_shader_code (shader_block* Block, std::string& Shader
 				Block->get_multi_input_child_list (input->m_name, children);
 
 				// get values
-				std::vector<std::string> values;
+				std::vector<std::string> child_values;
 				for (std::vector<std::string>::const_iterator c = children.begin(); c != children.end(); ++c) {
 
 					std::string input_parent_output ("");
-					shader_block* input_parent = m_scene->get_parent (Block->name(), *c, input_parent_output);
-					if (!input_parent->m_code_written && !input_parent->is_shader_output (input_parent_output)) {
-						build_shader_code (input_parent, ShaderCode, LocalVariables);
-					}
+					shader_block* input_parent = m_scene->get_parent (Block, *c, input_parent_output);
 
 					// replace the variable with parent's output variable name (except with shader outputs)
 					if (!input_parent->is_shader_output (input_parent_output)) {
-						values.push_back (input_parent->sl_name() + "_" + input_parent_output);
+						child_values.push_back (input_parent->sl_name() + "_" + input_parent_output);
 					} else {
 						// replace with the shader output name string
-						values.push_back (input_parent_output);
+						child_values.push_back (input_parent_output);
 					}
 				}
 
 				// build the value string, using the operator
 				std::string single_value ("");
 				unsigned long value_number = 0;
-				for (std::vector<std::string>::const_iterator v = values.begin(); v != values.end(); ++v) {
+				for (std::vector<std::string>::const_iterator v = child_values.begin(); v != child_values.end(); ++v) {
 
 					++value_number;
 					if (value_number > 1) {
@@ -714,7 +1288,7 @@ void rib_root_block::build_shader_code (shader_block* Block, std::string& Shader
 				}
 
 				// replace the value
-				replace_variable (code, "$(" + input->m_name + ")", single_value);
+				values.insert (std::make_pair (input->m_name, single_value));
 
 			} else if (!input->m_multi_operator_parent_name.empty()) {
 				// not processed here, but with the multi-operator
@@ -723,10 +1297,10 @@ void rib_root_block::build_shader_code (shader_block* Block, std::string& Shader
 		else {
 			if (!input->m_shader_parameter) {
 				// directly replace with the value
-				replace_variable (code, "$(" + input->m_name + ")", Block->get_input_value_as_sl_string (input->m_name));
+				values.insert (std::make_pair (input->m_name, Block->get_input_value_as_sl_string (input->m_name)));
 			} else {
 				// replace with the variable name (the one defined by default as a shader parameter)
-				replace_variable (code, "$(" + input->m_name + ")", Block->sl_name() + "_" + input->m_name);
+				values.insert (std::make_pair (input->m_name, Block->sl_name() + "_" + input->m_name));
 			}
 		}
 	}
@@ -735,25 +1309,83 @@ void rib_root_block::build_shader_code (shader_block* Block, std::string& Shader
 
 		// rewrite the output names with unique ones (except with shader outputs)
 		if (!output->m_shader_output) {
-			replace_variable (code, "$(" + output->m_name + ")", Block->sl_name() + "_" + output->m_name);
+			values.insert (std::make_pair (output->m_name, Block->sl_name() + "_" + output->m_name));
 		} else {
-			replace_variable (code, "$(" + output->m_name + ")", output->m_name);
+			values.insert (std::make_pair (output->m_name, output->m_name));
+		}
+	}
+
+	// fill the tags in a single pass
+	code.expand (values, fragment.code);
+
+	// declarations
+	Block->get_includes (fragment.includes);
+
+	// parameter values (inputs that are not connected)
+	for (shader_block::properties_t::const_iterator input = Block->m_inputs.begin(); input != Block->m_inputs.end(); ++input) {
+
+		if (!input->m_shader_parameter || m_scene->is_connected (Block, *input)) {
+			continue;
 		}
+
+		shader_block::code_fragment::parameter parameter;
+		parameter.declaration = Block->input_type (input->m_name) + " " + Block->sl_name() + "_" + input->m_name;
+		parameter.value = input->value_as_sl_string();
+		parameter.rib_value = input->value_as_rib_values (parameter.rib_values);
+
+		fragment.parameters.push_back (parameter);
+
+		fragment.k3d_parameters += "\t\t\t<argument name=\"" + Block->sl_name() + "_" + input->m_name + "\""
+				+ " storage_class=\"" + input->get_storage() + "\""
+				+ " type=\"" + Block->input_type (input->m_name) + "\""
+				+ " extended_type=\"" + Block->input_type (input->m_name) + "\"" // TODO
+				+ " array_count=\"" + "1" + "\"" // TODO
+				+ " space=\"" + "\"" // TODO
+				+ " output=\"false\""
+				+ " default_value=\"" + parameter.value
+				+ "\"/>\n";
 	}
 
-	// save resulting code
-	ShaderCode += code;
-	ShaderCode += "\n";
+	// output values (as local or output variables)
+	//TODO test that each name is unique
+	for (shader_block::properties_t::const_iterator output = Block->m_outputs.begin(); output != Block->m_outputs.end(); ++output) {
+
+		if (!output->m_shader_output) {
+
+			std::string otype = Block->output_type (output->m_name);
+			std::string array_size = "";
+			if (otype == "array") {
+				otype = Block->get_output_type_extension (output->m_name);
+				array_size = "[" + string_cast (Block->get_output_type_extension_size (output->m_name)) + "]";
+			}
+
+			fragment.output_locals.push_back (otype + " " + Block->sl_name() + "_" + output->m_name + array_size);
+		} else {
+
+			fragment.shader_outputs += "\t\toutput " + Block->output_storage (output->m_name) + " ";
+			fragment.shader_outputs += Block->output_type (output->m_name) + " " + output->m_name;
+			fragment.shader_outputs += " = 0;\n";
+
+			fragment.k3d_outputs += "\t\t\t<argument name=\"" + Block->sl_name() + "_" + output->m_name + "\""
+					+ " storage_class=\"" + Block->output_storage (output->m_name) + "\""
+					+ " type=\"" + Block->output_type (output->m_name) + "\""
+					+ " extended_type=\"" + Block->output_type (output->m_name) + "\"" // TODO
+					+ " array_count=\"" + "1" + "\"" // TODO
+					+ " space=\"" + "\"" // TODO
+					+ " output=\"true\""
+					+ "\"/>\n";
+		}
+	}
 
-	Block->m_code_written = true;
+	fragment.revision = shader_block::current_revision();
+	Block->m_code_fragment = new_fragment;
 }
 
 
-std::string rib_root_block::build_k3d_meta_file (const shader_t ShaderType, const std::string& ShaderName) {
+std::string rib_root_block::build_k3d_meta_file (const shader_build_t& Build) const {
 
-	// get the list of blocks composing the shader
-	shrimp::shader_blocks_t shader_blocks = get_all_shader_blocks (ShaderType);
-	if (!shader_blocks.size())
+	// blocks composing the shader
+	if (!Build.fragments.size())
 	{
 		return "";
 	}
@@ -765,72 +1397,33 @@ std::string rib_root_block::build_k3d_meta_file (const shader_t ShaderType, cons
 	// get parameters and outputs
 	std::string parameters;
 	std::string shader_outputs;
-	for (shrimp::shader_blocks_t::const_iterator block = shader_blocks.begin(); block != shader_blocks.end(); ++block) {
-
-		shader_block* sb = *block;
-
-		sb->reset_code_written();
+	for (std::vector<shader_build_t::fragment_t>::const_iterator fragment = Build.fragments.begin(); fragment != Build.fragments.end(); ++fragment) {
 
-		// get parameter values (inputs that are not connected)
-		for (shader_block::properties_t::const_iterator input = sb->m_inputs.begin(); input != sb->m_inputs.end(); ++input) {
-
-			if (m_scene->is_connected (shrimp::io_t (sb->name(), input->m_name))) {
-				continue;
-			}
-
-			if (input->m_shader_parameter) {
-				parameters += "\t\t\t<argument name=\"" + sb->sl_name() + "_" + input->m_name + "\""
-						+ " storage_class=\"" + input->get_storage() + "\""
-						+ " type=\"" + sb->input_type (input->m_name) + "\""
-						+ " extended_type=\"" + sb->input_type (input->m_name) + "\"" // TODO
-						+ " array_count=\"" + "1" + "\"" // TODO
-						+ " space=\"" + "\"" // TODO
-						+ " output=\"false\""
-						+ " default_value=\"" + input->value_as_sl_string()
-						+ "\"/>\n";
-			}
-		}
-
-		// get output values
-		//TODO test that each name is unique
-		for (shader_block::properties_t::const_iterator output = sb->m_outputs.begin(); output != sb->m_outputs.end(); ++output) {
-
-			if (!output->m_shader_output) {
-				continue;
-			} else {
-				shader_outputs += "\t\t\t<argument name=\"" + sb->sl_name() + "_" + output->m_name + "\""
-						+ " storage_class=\"" + sb->output_storage (output->m_name) + "\""
-						+ " type=\"" + sb->output_type (output->m_name) + "\""
-						+ " extended_type=\"" + sb->output_type (output->m_name) + "\"" // TODO
-						+ " array_count=\"" + "1" + "\"" // TODO
-						+ " space=\"" + "\"" // TODO
-						+ " output=\"true\""
-						+ "\"/>\n";
-			}
-		}
+		parameters += (*fragment)->k3d_parameters;
+		shader_outputs += (*fragment)->k3d_outputs;
 	}
 
 	meta_file += "\t<shaders>\n";
 
 	// shader type
 	meta_file += "\t\t<shader type=\"";
-	switch (ShaderType) {
+	switch (Build.type) {
 
 		case SURFACE:
 			// Preset AOVs, shader arguments, so we initialize them
-			meta_file += "surface\" name=\"" + ShaderName + "\">\n";
+			meta_file += "surface\" name=\"" + Build.name + "\">\n";
 		break;
 
 		case DISPLACEMENT:
-			meta_file += "displacement\" name=\"" + ShaderName + "\">\n";
+			meta_file += "displacement\" name=\"" + Build.name + "\">\n";
 		break;
 
 		case LIGHT:
-			meta_file += "light\" name=\"" + ShaderName + "\">\n";
+			meta_file += "light\" name=\"" + Build.name + "\">\n";
 		break;
 
 		case VOLUME:
-			meta_file += "volume\" name=\"" + ShaderName + "\">\n";
+			meta_file += "volume\" name=\"" + Build.name + "\">\n";
 		break;
 
 		default:
@@ -853,13 +1446,11 @@ std::string rib_root_block::build_k3d_meta_file (const shader_t ShaderType, cons
 }
 
 
-bool rib_root_block::export_shader (const shader_t ShaderType, const std::string& ShaderName, const std::string& ShaderFile) {
-
-	const std::string surface = build_shader_file (ShaderType, ShaderName);
+bool rib_root_block::export_shader (const std::string& Shader, const std::string& ShaderFile) const {
 
 	std::ofstream file (ShaderFile.c_str());
 
-	file << surface;
+	file << Shader;
 
 	file.close();
 
@@ -867,13 +1458,11 @@ bool rib_root_block::export_shader (const shader_t ShaderType, const std::string
 }
 
 
-bool rib_root_block::export_k3d_slmeta (const shader_t ShaderType, const std::string& ShaderName, const std::string& ShaderFile) {
-
-	const std::string surface = build_k3d_meta_file (ShaderType, ShaderName);
+bool rib_root_block::export_k3d_slmeta (const std::string& MetaFile, const std::string& ShaderFile) const {
 
 	std::ofstream file ((ShaderFile + "meta").c_str());
 
-	file << surface;
+	file << MetaFile;
 
 	file.close();
 
@@ -881,31 +1470,42 @@ bool rib_root_block::export_k3d_slmeta (const shader_t ShaderType, const std::st
 }
 
 
-std::string rib_root_block::shader_compilation_command (const std::string& Shader, const std::string& ShaderPath, const std::string& DestinationName, const std::string& DestinationPath, const std::string& IncludePath) {
+std::string rib_root_block::shader_compilation_command (const std::string& Shader, const std::string& ShaderPath, const std::string& DestinationName, const std::string& DestinationPath, const std::string& IncludePath, shader_cache* Cache, const std::string& Identity) const {
 
-	general_options prefs;
-	prefs.load();
+	const std::shared_ptr<const general_options> prefs = general_options::current();
 
-	//std::string compiled_shader = change_file_extension(Shader, prefs.m_compiled_shader_extension);
-	std::string compiled_shader = DestinationName + '.' + prefs.m_compiled_shader_extension;
+	//std::string compiled_shader = change_file_extension(Shader, prefs->m_compiled_shader_extension);
+	std::string compiled_shader = DestinationName + '.' + prefs->m_compiled_shader_extension;
 
-	std::string command = prefs.m_shader_compiler;
-	replace_variable (command, "%r", prefs.m_renderer_code);
+	std::string command = prefs->m_shader_compiler;
+	replace_variable (command, "%r", prefs->m_renderer_code);
 	replace_variable (command, "%i", IncludePath);
 	replace_variable (command, "%s", ShaderPath + '/' + Shader);
 	replace_variable (command, "%o", DestinationPath + '/' + compiled_shader);
 
+	if (Cache) {
+
+		// the key doesn't depend on the destination, which is a temporary directory
+		std::string key_command = prefs->m_shader_compiler;
+		replace_variable (key_command, "%r", prefs->m_renderer_code);
+		replace_variable (key_command, "%i", IncludePath);
+
+		const std::string key = shader_cache::compilation_key (ShaderPath + '/' + Shader, IncludePath, prefs->m_renderer_code, key_command, Identity);
+		if (Cache->fetch (key, DestinationPath + '/' + compiled_shader)) {
+			return "";
+		}
+	}
+
 	log() << aspect << " Shader compilation command : " << command << std::endl;
 
 	return command;
 }
 
-std::string rib_root_block::scene_rendering_command (const std::string& RIBFile, const std::string& ShaderPath) {
+std::string rib_root_block::scene_rendering_command (const std::string& RIBFile, const std::string& ShaderPath) const {
 
-	general_options prefs;
-	prefs.load();
+	const std::shared_ptr<const general_options> prefs = general_options::current();
 
-	std::string command = prefs.m_renderer;
+	std::string command = prefs->m_renderer;
 	replace_variable(command, "%i", ShaderPath);
 	replace_variable(command, "%s", RIBFile);
 
@@ -915,17 +1515,22 @@ std::string rib_root_block::scene_rendering_command (const std::string& RIBFile,
 }
 
 
-void rib_root_block::write_RIB (const std::string& RIBFile, const std::string& TempDir, const std::string& SurfaceName, const std::string& DisplacementName, const std::string& LightName, const std::string& AtmosphereName, const std::string& ImagerName) {
+void rib_root_block::write_RIB (const std::string& RIBFile, const std::string& TempDir, const scene_snapshot_t& Snapshot, const std::string& SurfaceName, const std::string& DisplacementName, const std::string& LightName, const std::string& AtmosphereName, const std::string& ImagerName, const std::map<std::string, std::string>& ShaderParameters) const {
+
+	// parameter list of a shader statement
+	auto parameter_list = [&ShaderParameters] (const std::string& Shader) -> std::string {
+		const std::map<std::string, std::string>::const_iterator p = ShaderParameters.find (Shader);
+		return p == ShaderParameters.end() ? "" : p->second;
+	};
 
 	// open file
-	std::ofstream file (RIBFile.c_str());
+	code_writer file (RIBFile);
 
 	// options
-	general_options prefs;
-	prefs.load();
+	const std::shared_ptr<const general_options> prefs = general_options::current();
 
 	// get the scene template
-	std::string scene_template (prefs.get_RIB_scene());
+	const std::string& scene_template = prefs->RIB_scene();
 
 
 	// create the shader statements
@@ -937,7 +1542,7 @@ void rib_root_block::write_RIB (const std::string& RIBFile, const std::string& T
 
 	// light
 	if (!LightName.empty()) {
-		light_shaders += "\tLightSource \"" + LightName + "\" 0\n";
+		light_shaders += "\tLightSource \"" + LightName + "\" 0" + parameter_list (LightName) + "\n";
 	} else {
 
 		light_shaders += "LightSource \"ambientlight\" 0 \"intensity\" [1.0] \"lightcolor\" [1 1 1]\n";
@@ -948,21 +1553,20 @@ void rib_root_block::write_RIB (const std::string& RIBFile, const std::string& T
 	}
 
 	// imager
-	m_imager_statement = trim (m_imager_statement);
-	if (!m_imager_statement.empty()) {
+	if (!Snapshot.imager_statement.empty()) {
 
-		const std::string beginning = m_imager_statement.substr (0, 6);
+		const std::string beginning = Snapshot.imager_statement.substr (0, 6);
 		if (beginning == "Imager" || beginning == "imager") {
-			imager_shader += m_imager_statement + "\n";
+			imager_shader += Snapshot.imager_statement + "\n";
 		} else {
 
-			imager_shader += "Imager " + m_imager_statement + "\n";
+			imager_shader += "Imager " + Snapshot.imager_statement + "\n";
 		}
 	}
 
 	// atmosphere
 	if (!AtmosphereName.empty()) {
-		volume_shaders += "\tAtmosphere \"" + AtmosphereName + "\"\n";
+		volume_shaders += "\tAtmosphere \"" + AtmosphereName + "\"" + parameter_list (AtmosphereName) + "\n";
 	}
 
 
@@ -970,36 +1574,35 @@ void rib_root_block::write_RIB (const std::string& RIBFile, const std::string& T
 	if (SurfaceName.empty()) {
 		surface_shaders += "Surface \"matte\"\n";
 	} else {
-		surface_shaders += "Surface \"" + SurfaceName + "\"\n";
+		surface_shaders += "Surface \"" + SurfaceName + "\"" + parameter_list (SurfaceName) + "\n";
 	}
 
 	// displacement
 	if (!DisplacementName.empty()) {
-		displacement_shaders += "Displacement \"" + DisplacementName + "\"\n";
+		displacement_shaders += "Displacement \"" + DisplacementName + "\"" + parameter_list (DisplacementName) + "\n";
 		displacement_shaders += "\t\tAttribute \"displacementbound\" \"float sphere\" [0.5] \"string coordinatesystem\" [\"shader\"]\n";
 		//displacement_shaders += "Attribute \"render\" \"patch_multiplier\" 1.0\n";
 	}
 
 
-	// replace the shader values
-	replace_variable (scene_template, "$(imager_shader)", imager_shader);
-	replace_variable (scene_template, "$(surface_shaders)", surface_shaders);
-	replace_variable (scene_template, "$(displacement_shaders)", displacement_shaders);
-	replace_variable (scene_template, "$(volume_shaders)", volume_shaders);
-	replace_variable (scene_template, "$(light_shaders)", light_shaders);
-
-	std::string all_other_shaders = surface_shaders + "\n" + displacement_shaders + "\n" + volume_shaders + "\n" + light_shaders;
-	replace_variable (scene_template, "$(shaders)", all_other_shaders);
+	// shader values of the template (it's written with them at the end)
+	template_variables_t shader_variables;
+	shader_variables["$(imager_shader)"] = imager_shader;
+	shader_variables["$(surface_shaders)"] = surface_shaders;
+	shader_variables["$(displacement_shaders)"] = displacement_shaders;
+	shader_variables["$(volume_shaders)"] = volume_shaders;
+	shader_variables["$(light_shaders)"] = light_shaders;
+	shader_variables["$(shaders)"] = surface_shaders + "\n" + displacement_shaders + "\n" + volume_shaders + "\n" + light_shaders;
 
 	// prepare display (defaults to "framebuffer")
-	std::string display = prefs.m_renderer_display;
+	std::string display = prefs->m_renderer_display;
 	if (display.empty()) {
 		display = "framebuffer";
 	}
 
 	// prepare AOV preview (if connected)
 	std::string parent_name ("");
-	bool AOV = get_AOV() && has_connected_parent ("AOV");
+	bool AOV = Snapshot.AOV;
 
 	// write the RIB file
 	file << "# Shrimp preview scene\n";
@@ -1018,188 +1621,239 @@ void rib_root_block::write_RIB (const std::string& RIBFile, const std::string& T
 		// include these preset AOVs, but for a secondaries display option
 		// AOV presets
 		file << "# AOVs here\n";
-		file << "Display \"+" + TempDir + "/" + "aov_surfacecolor"
-			 + ".tif" + "\" \"file\" \"varying color aov_surfacecolor\" "
-			 + "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "aov_ambient" + ".tif"
-			+ "\" \"file\" \"varying color aov_ambient\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "aov_diffuse" + ".tif"
-			+ "\" \"file\" \"varying color aov_diffuse\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "aov_specular" + ".tif"
-			+ "\" \"file\" \"varying color aov_specular\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "aov_specularcolor" + ".tif"
-			+ "\" \"file\" \"varying color aov_specularcolor\" "
-			+ "\"quantize\" [0 255 0 255]\n";		
-		file << "Display \"+" + TempDir + "/" + "aov_reflection"
-			+ ".tif" + "\" \"file\" \"varying color aov_reflection\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "aov_refraction"
-			+ ".tif" + "\" \"file\" \"varying color aov_refraction\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "aov_rimlighting" + ".tif"
-			+ "\" \"file\" \"varying color aov_rimlighting\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "aov_scattering"
-			+ ".tif" + "\" \"file\" \"varying color aov_scattering\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "aov_translucence"
-			+ ".tif" + "\" \"file\" \"varying color aov_translucence\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "aov_shadows"
-			+ ".tif" + "\" \"file\" \"varying color aov_shadows\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "aov_occlusion"
-			+ ".tif" + "\" \"file\" \"varying float aov_occlusion\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "aov_opacity"
-			+ ".tif" + "\" \"file\" \"varying color aov_opacity\" "
-			+ "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "aov_surfacecolor"
+			<< ".tif" << "\" \"file\" \"varying color aov_surfacecolor\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "aov_ambient" << ".tif"
+			<< "\" \"file\" \"varying color aov_ambient\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "aov_diffuse" << ".tif"
+			<< "\" \"file\" \"varying color aov_diffuse\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "aov_specular" << ".tif"
+			<< "\" \"file\" \"varying color aov_specular\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "aov_specularcolor" << ".tif"
+			<< "\" \"file\" \"varying color aov_specularcolor\" "
+			<< "\"quantize\" [0 255 0 255]\n";		
+		file << "Display \"+" << TempDir << "/" << "aov_reflection"
+			<< ".tif" << "\" \"file\" \"varying color aov_reflection\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "aov_refraction"
+			<< ".tif" << "\" \"file\" \"varying color aov_refraction\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "aov_rimlighting" << ".tif"
+			<< "\" \"file\" \"varying color aov_rimlighting\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "aov_scattering"
+			<< ".tif" << "\" \"file\" \"varying color aov_scattering\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "aov_translucence"
+			<< ".tif" << "\" \"file\" \"varying color aov_translucence\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "aov_shadows"
+			<< ".tif" << "\" \"file\" \"varying color aov_shadows\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "aov_occlusion"
+			<< ".tif" << "\" \"file\" \"varying float aov_occlusion\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "aov_opacity"
+			<< ".tif" << "\" \"file\" \"varying color aov_opacity\" "
+			<< "\"quantize\" [0 255 0 255]\n";
 		// AOV set 2
-		file << "Display \"+" + TempDir + "/" + "_color"
-			 + ".tif" + "\" \"file\" \"varying color _color\" "
-			 + "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "_ambient" + ".tif"
-			+ "\" \"file\" \"varying color _ambient\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "_diffuse" + ".tif"
-			+ "\" \"file\" \"varying color _diffuse\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "_specular" + ".tif"
-			+ "\" \"file\" \"varying color _specular\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "_reflect"
-			+ ".tif" + "\" \"file\" \"varying color _reflect\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "_refract"
-			+ ".tif" + "\" \"file\" \"varying color _refract\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "_rimlighting" + ".tif"
-			+ "\" \"file\" \"varying color _rimlighting\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "_scattering"
-			+ ".tif" + "\" \"file\" \"varying color _scattering\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "_translucence"
-			+ ".tif" + "\" \"file\" \"varying color _translucence\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "_shadow"
-			+ ".tif" + "\" \"file\" \"varying color _shadow\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "_occlusion"
-			+ ".tif" + "\" \"file\" \"varying float _occlusion\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "_opacity"
-			+ ".tif" + "\" \"file\" \"varying color _opacity\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "_alpha"
-			+ ".tif" + "\" \"file\" \"varying float _alpha\" "
-			+ "\"quantize\" [0 255 0 255]\n";
-		file << "Display \"+" + TempDir + "/" + "_uv"
-			+ ".tif" + "\" \"file\" \"varying normal _uv\" "
-			+ "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "_color"
+			<< ".tif" << "\" \"file\" \"varying color _color\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "_ambient" << ".tif"
+			<< "\" \"file\" \"varying color _ambient\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "_diffuse" << ".tif"
+			<< "\" \"file\" \"varying color _diffuse\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "_specular" << ".tif"
+			<< "\" \"file\" \"varying color _specular\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "_reflect"
+			<< ".tif" << "\" \"file\" \"varying color _reflect\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "_refract"
+			<< ".tif" << "\" \"file\" \"varying color _refract\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "_rimlighting" << ".tif"
+			<< "\" \"file\" \"varying color _rimlighting\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "_scattering"
+			<< ".tif" << "\" \"file\" \"varying color _scattering\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "_translucence"
+			<< ".tif" << "\" \"file\" \"varying color _translucence\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "_shadow"
+			<< ".tif" << "\" \"file\" \"varying color _shadow\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "_occlusion"
+			<< ".tif" << "\" \"file\" \"varying float _occlusion\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "_opacity"
+			<< ".tif" << "\" \"file\" \"varying color _opacity\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "_alpha"
+			<< ".tif" << "\" \"file\" \"varying float _alpha\" "
+			<< "\"quantize\" [0 255 0 255]\n";
+		file << "Display \"+" << TempDir << "/" << "_uv"
+			<< ".tif" << "\" \"file\" \"varying normal _uv\" "
+			<< "\"quantize\" [0 255 0 255]\n";
 		
 	}
 
 	file << "# User set root block RIB statements\n";
-	file << m_general_statements << "\n";
+	file << Snapshot.general_statements << "\n";
 	file << "# Preview scene\n";
-	file << "Format " << prefs.m_output_width << " " << prefs.m_output_height << " 1\n";
-	file << "PixelSamples " << prefs.m_samples_x << " " << prefs.m_samples_y << "\n";
-	file << "ShadingRate " << prefs.m_shading_rate << "\n";
-	file << "PixelFilter \"" << prefs.m_pixel_filter << "\" " << prefs.m_filter_width_s << " " << prefs.m_filter_width_t <<"\n";
+	file << "Format " << prefs->m_output_width << " " << prefs->m_output_height << " 1\n";
+	file << "PixelSamples " << prefs->m_samples_x << " " << prefs->m_samples_y << "\n";
+	file << "ShadingRate " << prefs->m_shading_rate << "\n";
+	file << "PixelFilter \"" << prefs->m_pixel_filter << "\" " << prefs->m_filter_width_s << " " << prefs->m_filter_width_t <<"\n";
 	file << "Exposure 1 1\n";
 	file << "Quantize \"rgba\" 255 0 255 0.5\n";
 	file << "ShadingInterpolation \"smooth\"\n";
 	file << "Clipping 0.01 100\n";
 	file << "\n";
-	file << scene_template << std::endl;
+	write_template (file, scene_template, shader_variables);
+	file << "\n";
 
 	file.close();
 }
 
 
-void rib_root_block::write_scene_and_shaders (const std::string& Directory, command_list_t& CommandList)
+void rib_root_block::take_scene_snapshot (const std::string& Directory, scene_snapshot_t& Snapshot)
 {
-	const std::string shader_path = system_functions::get_absolute_path("./data/rib/shaders");
-
-	// compile the shaders from the template scene
-	general_options prefs;
-	prefs.load();
-	std::string scene_template (prefs.get_RIB_scene());
-
-	CommandList.push_back (parse_scene_shader (scene_template, shader_path, Directory, "Surface") );
-	CommandList.push_back (parse_scene_shader (scene_template, shader_path, Directory, "Displacement") );
-	CommandList.push_back (parse_scene_shader (scene_template, shader_path, Directory, "LightSource") );
-	CommandList.push_back (parse_scene_shader (scene_template, shader_path, Directory, "Atmosphere") );
-
-	// build the default shaders
-	CommandList.push_back( shader_compilation_command("ambientlight.sl", shader_path, "ambientlight", Directory, shader_path) );
-	CommandList.push_back( shader_compilation_command("distantlight.sl", shader_path, "distantlight", Directory, shader_path) );
-
-	// build Shrimp generated shaders
-	std::string surface_shader ("");
-	std::string displacement_shader ("");
-	std::string light_shader ("");
-	std::string atmosphere_shader ("");
-
+	// Shrimp generated shaders
+	shader_builds_t& shaders = Snapshot.shaders;
 	if (has_connected_parent ("Ci") || has_connected_parent ("Oi"))
 	{
 		// RenderMan surface shader
-		surface_shader = "preview_surface";
-		export_shader (SURFACE, surface_shader, Directory + '/' + surface_shader + ".sl");
-		CommandList.push_back( shader_compilation_command (surface_shader + ".sl", Directory, surface_shader, Directory, shader_path) );
-
-		// K-3D meta file
-		export_k3d_slmeta (SURFACE, surface_shader, Directory + '/' + surface_shader + ".sl");
+		add_shader_build (SURFACE, "preview_surface", shaders, Directory + "/preview_surface.sl");
 	}
 
 	if (has_connected_parent ("P") || has_connected_parent ("N"))
 	{
 		// RenderMan displacement shader
-		displacement_shader = "preview_displacement";
-		export_shader (DISPLACEMENT, displacement_shader, Directory + '/' + displacement_shader + ".sl");
-		CommandList.push_back( shader_compilation_command (displacement_shader + ".sl", Directory, displacement_shader, Directory, shader_path) );
-
-		// K-3D meta file
-		export_k3d_slmeta (DISPLACEMENT, displacement_shader, Directory + '/' + displacement_shader + ".sl");
+		add_shader_build (DISPLACEMENT, "preview_displacement", shaders, Directory + "/preview_displacement.sl");
 	}
 
 	if (has_connected_parent ("Cl") || has_connected_parent ("Ol"))
 	{
 		// RenderMan light shader
-		light_shader = "preview_light";
-		export_shader (LIGHT, light_shader, Directory + '/' + light_shader + ".sl");
-		CommandList.push_back( shader_compilation_command (light_shader + ".sl", Directory, light_shader, Directory, shader_path) );
-
-		// K-3D meta file
-		export_k3d_slmeta (LIGHT, light_shader, Directory + '/' + light_shader + ".sl");
+		add_shader_build (LIGHT, "preview_light", shaders, Directory + "/preview_light.sl");
 	}
 
 	if (has_connected_parent ("Cv") || has_connected_parent ("Ov"))
 	{
 		// RenderMan atmosphere shader
-		atmosphere_shader = "preview_atmosphere";
-		export_shader (VOLUME, atmosphere_shader, Directory + '/' + atmosphere_shader + ".sl");
-		CommandList.push_back( shader_compilation_command (atmosphere_shader + ".sl", Directory, atmosphere_shader, Directory, shader_path) );
+		add_shader_build (VOLUME, "preview_atmosphere", shaders, Directory + "/preview_atmosphere.sl");
+	}
+
+	take_shader_sources (shaders);
+
+	// scene statements
+	Snapshot.general_statements = m_general_statements;
+	Snapshot.imager_statement = trim (m_imager_statement);
+	Snapshot.AOV = get_AOV() && has_connected_parent ("AOV");
+}
+
+
+void rib_root_block::write_scene_and_shaders (const std::string& Directory, scene_snapshot_t& Snapshot, job_graph& Jobs, shader_cache* Cache, const bool Render, const bool ValuesInRIB) const
+{
+	const std::string shader_path = system_functions::get_absolute_path("./data/rib/shaders");
+
+	// shaders to compile (source directory by shader name), each one is compiled once
+	std::map<std::string, std::string> compilations;
+
+	// compile the shaders from the template scene
+	const std::shared_ptr<const general_options> prefs = general_options::current();
+	const std::string& scene_template = prefs->RIB_scene();
+
+	std::vector<std::string> scene_shaders;
+	parse_scene_shaders (scene_template, "Surface", scene_shaders);
+	parse_scene_shaders (scene_template, "Displacement", scene_shaders);
+	parse_scene_shaders (scene_template, "LightSource", scene_shaders);
+	parse_scene_shaders (scene_template, "Atmosphere", scene_shaders);
+	for (std::vector<std::string>::const_iterator shader = scene_shaders.begin(); shader != scene_shaders.end(); ++shader)
+	{
+		compilations[*shader] = shader_path;
+	}
+
+	// build the default shaders
+	compilations["ambientlight"] = shader_path;
+	compilations["distantlight"] = shader_path;
+
+	// build Shrimp generated shaders (sources taken with the scene)
+	shader_builds_t& shaders = Snapshot.shaders;
+	build_shaders (shaders, true);
+
+	std::string surface_shader ("");
+	std::string displacement_shader ("");
+	std::string light_shader ("");
+	std::string atmosphere_shader ("");
+	// generated shaders (already written) are identified by their structure when their parameter values are passed through RIB
+	std::map<std::string, std::string> structure_keys;
+	std::map<std::string, std::string> rib_parameters;
+	for (shader_builds_t::const_iterator shader = shaders.begin(); shader != shaders.end(); ++shader)
+	{
+		compilations[shader->name] = Directory;
+		if (ValuesInRIB)
+		{
+			structure_keys[shader->name] = shader->structure_key;
+		}
+		rib_parameters[shader->name] = shader->rib_parameters;
 
-		export_k3d_slmeta (VOLUME, atmosphere_shader, Directory + '/' + atmosphere_shader + ".sl");
+		// K-3D meta file
+		export_k3d_slmeta (shader->k3d_meta, shader->file);
+
+		switch (shader->type)
+		{
+			case SURFACE: surface_shader = shader->name; break;
+			case DISPLACEMENT: displacement_shader = shader->name; break;
+			case LIGHT: light_shader = shader->name; break;
+			case VOLUME: atmosphere_shader = shader->name; break;
+			default: break;
+		}
+	}
+
+	// compilation jobs are independent (cached shaders don't need any)
+	job_graph::job_ids_t compilation_jobs;
+	for (std::map<std::string, std::string>::const_iterator shader = compilations.begin(); shader != compilations.end(); ++shader)
+	{
+		const std::map<std::string, std::string>::const_iterator structure_key = structure_keys.find (shader->first);
+		const std::string command = shader_compilation_command (shader->first + ".sl", shader->second, shader->first, Directory, shader_path, Cache,
+			structure_key == structure_keys.end() ? "" : structure_key->second);
+		if (!command.empty())
+		{
+			const job_graph::job_id_t job = Jobs.add ("compile_" + shader->first, command);
+			compilation_jobs.push_back (job);
+
+			// the compiled shader is cached once this job succeeded
+			if (Cache)
+			{
+				Cache->set_compilation_job (Directory + '/' + shader->first + '.' + prefs->m_compiled_shader_extension, job);
+			}
+		}
 	}
 
 	// output scene
 	std::string rib_preview = Directory + '/' + "preview.rib";
 
-	write_RIB (rib_preview, Directory, surface_shader, displacement_shader, light_shader, atmosphere_shader);
+	write_RIB (rib_preview, Directory, Snapshot, surface_shader, displacement_shader, light_shader, atmosphere_shader, "", rib_parameters);
 
-	CommandList.push_back( scene_rendering_command (rib_preview, Directory) );
+	// the rendering waits for all the compilations
+	if (Render)
+	{
+		Jobs.add ("render", scene_rendering_command (rib_preview, Directory), compilation_jobs);
+	}
 }
 
 
-std::string rib_root_block::parse_scene_shader (const std::string& RIBscene, const std::string ShaderPath, const std::string& TempDir, const std::string ShaderType) {
-
-	std::string commands = "";
+void rib_root_block::parse_scene_shaders (const std::string& RIBscene, const std::string& ShaderType, std::vector<std::string>& ShaderNames) const {
 
 	// find shaders
 	size_t pos = 0;
@@ -1218,31 +1872,20 @@ std::string rib_root_block::parse_scene_shader (const std::string& RIBscene, con
 
 			if (name_start < name_end && name_end < RIBscene.size()) {
 
-				const std::string shader_name = RIBscene.substr (name_start + 1, name_end - name_start - 1);
-				std::string shader_compilation = shader_compilation_command (shader_name + ".sl", ShaderPath, shader_name, TempDir, ShaderPath);
-
-				if (!commands.empty())
-					commands += "; ";
-
-				commands += shader_compilation;
+				ShaderNames.push_back (RIBscene.substr (name_start + 1, name_end - name_start - 1));
 			}
 
 		}
 	}
 	while (pos != RIBscene.npos);
-
-	return commands;
 }
 
 
-void rib_root_block::write_command_list (const command_list_t& CommandList, const std::string& AbsoluteFileName) {
+void rib_root_block::write_command_list (const job_graph& Jobs, const std::string& AbsoluteFileName) const {
 
 	std::ofstream file (AbsoluteFileName.c_str());
 
-	for (command_list_t::const_iterator c = CommandList.begin(); c != CommandList.end(); ++c) {
-
-		file << *c << std::endl;
-	}
+	Jobs.write (file);
 
 	file.close();
 }
@@ -22,23 +22,41 @@
 #ifndef _rib_root_block_h_
 #define _rib_root_block_h_
 
+#include "code_writer.h"
+#include "preferences.h"
+#include "preview_runner.h"
 #include "shader_block.h"
+#include "shader_cache.h"
 #include "scene.h"
 
+#include "../miscellaneous/logging.h"
+
+#include <chrono>
+#include <map>
+#include <memory>
 
 class rib_root_block : public shader_block
 {
 public:
 	rib_root_block (const std::string& Name, scene* Scene);
 
-	std::string show_code();
+	// the code of the four shaders (built concurrently, or by the given number of threads)
+	std::string show_code (const unsigned int Threads = 0);
 
 
-	// show a preview of current scene
+	// show a preview of current scene (rendered in the background)
 	void show_preview (const std::string& Directory);
+	// return the preview's progress, starts a preview that superseded the previous one
+	// (to be called regularly while a preview runs)
+	preview_runner::status_t update_preview();
+
+	// compile the shaders in the background once the scene stopped changing, so that the next
+	// preview finds them in the shader cache (to be called regularly, when the application is idle)
+	void update_speculative_compilation (const std::string& Directory);
 
-	// export scene (RIB file and shaders)
-	void export_scene (const std::string& Directory);
+	// export scene (RIB file and shaders), and compile the shaders if asked
+	// (returns false when a compilation failed)
+	bool export_scene (const std::string& Directory, const bool Compile = false);
 
 	// the type of root block (constant: RIB)
 	const std::string root_type;
@@ -62,6 +80,21 @@ private:
 	// AOV output preview
 	bool m_AOV;
 
+	// preview running in the background, and directory of the preview superseding it
+	preview_runner m_preview;
+	std::string m_pending_preview;
+
+	// speculative compilation: last block revision seen and when it was first seen,
+	// last revision compiled, and whether the running preview is a speculative compilation
+	unsigned long m_observed_revision;
+	std::chrono::steady_clock::time_point m_observed_time;
+	unsigned long m_speculated_revision;
+	bool m_speculating;
+
+	// start a preview, or only compile its shaders (the scene is taken here, its files are
+	// written on the preview thread)
+	void start_preview (const std::string& Directory, const bool Render);
+
 	typedef enum
 	{
 		SURFACE,
@@ -71,34 +104,127 @@ private:
 		IMAGER,
 	} shader_t;
 
-	// write a RIB file for preview and image output
-	void write_RIB (const std::string& RIBFile, const std::string& TempDir, const std::string& SurfaceName = "", const std::string& DisplacementName = "", const std::string& LightName = "", const std::string& AtmosphereName = "", const std::string& ImagerName = "");
-
-	std::string shader_compilation_command (const std::string& Shader, const std::string& ShaderPath, const std::string& DestinationName, const std::string& DestinationPath, const std::string& IncludePath);
-	std::string scene_rendering_command (const std::string& RIBFile, const std::string& ShaderPath);
-
-	// parses a shader in the RIB scene and returns the shader compilation command
-	std::string parse_scene_shader (const std::string& RIBscene, const std::string ShaderPath, const std::string& TempDir, const std::string ShaderType);
-
-	// outputs scene and shader files, returns rendering command list
-	typedef std::vector <std::string> command_list_t;
-	void write_scene_and_shaders (const std::string& SceneDirectory, command_list_t& CommandList);
+	// a shader build, independent from the other ones (they can run concurrently)
+	struct shader_build_t
+	{
+		shader_t type;
+		std::string name;
+		// file the shader is written to, the shader is kept in code when empty
+		std::string file;
+
+		// what the shader is built from, taken from the scene (see take_shader_sources()):
+		// the code fragments of its blocks in a reproducible order and in the order their
+		// code is written, the root block's code, the scene information written in the
+		// shader's header, and the types of the blocks' properties when locals need them
+		typedef std::shared_ptr<const shader_block::code_fragment> fragment_t;
+		std::vector<fragment_t> fragments;
+		std::vector<fragment_t> code_fragments;
+		std::string root_code;
+		std::string scene_name;
+		std::string scene_authors;
+		std::string scene_description;
+		std::map<std::string, std::string> property_types;
+
+		// built shader and K-3D slmeta file
+		std::string code;
+		std::string k3d_meta;
+		// key of the shader without its constant parameter values, and these values as a RIB parameter list
+		std::string structure_key;
+		std::string rib_parameters;
+		// messages logged while building
+		log_messages_t log;
+	};
+	typedef std::vector<shader_build_t> shader_builds_t;
+
+	// add a shader to build (into a file when given)
+	void add_shader_build (const shader_t ShaderType, const std::string& ShaderName, shader_builds_t& Builds, const std::string& File = "");
+	// take what the shaders are built from, before they're built
+	void take_shader_sources (shader_builds_t& Builds);
+	// build shaders (and their K-3D slmeta files) on worker threads, one per shader unless
+	// a thread count is given (they don't read the scene: they can be built on any thread)
+	void build_shaders (shader_builds_t& Builds, const bool K3DMeta, const unsigned int Threads = 0) const;
+
+	// a scene to write, taken from the scene so that it can be written while the scene is edited
+	struct scene_snapshot_t
+	{
+		// the shaders of the blocks connected to the root block
+		shader_builds_t shaders;
+		// RIB scene statements, and whether the AOV preview is output
+		std::string general_statements;
+		std::string imager_statement;
+		bool AOV;
+	};
+	// take the scene to write in a directory
+	void take_scene_snapshot (const std::string& Directory, scene_snapshot_t& Snapshot);
+
+	// outputs scene and shader files, returns the shader compilation jobs and the rendering job
+	// that depends on them (without the compilation of shaders found in the cache, if one is given);
+	// generated shaders are cached by structure only when their parameter values are passed through RIB,
+	// otherwise by their whole source (which holds the values as parameter defaults)
+	void write_scene_and_shaders (const std::string& SceneDirectory, scene_snapshot_t& Snapshot, job_graph& Jobs, shader_cache* Cache, const bool Render = true, const bool ValuesInRIB = true) const;
+
+	// write a RIB file for preview and image output (with the RIB parameter lists of the shaders, by shader name)
+	void write_RIB (const std::string& RIBFile, const std::string& TempDir, const scene_snapshot_t& Snapshot, const std::string& SurfaceName = "", const std::string& DisplacementName = "", const std::string& LightName = "", const std::string& AtmosphereName = "", const std::string& ImagerName = "", const std::map<std::string, std::string>& ShaderParameters = std::map<std::string, std::string>()) const;
+
+	// returns the shader compilation command, an empty one when the compiled shader was found in the cache (if any),
+	// the identity replaces the shader source in the cache key when given
+	std::string shader_compilation_command (const std::string& Shader, const std::string& ShaderPath, const std::string& DestinationName, const std::string& DestinationPath, const std::string& IncludePath, shader_cache* Cache, const std::string& Identity = "") const;
+	std::string scene_rendering_command (const std::string& RIBFile, const std::string& ShaderPath) const;
+
+	// parses the shaders of a type in the RIB scene, returns their names
+	void parse_scene_shaders (const std::string& RIBscene, const std::string& ShaderType, std::vector<std::string>& ShaderNames) const;
 
 	// outputs rendering command list
-	void write_command_list (const command_list_t& CommandList, const std::string& AbsoluteFileName);
+	void write_command_list (const job_graph& Jobs, const std::string& AbsoluteFileName) const;
 
 	// export a shader to a RSL file
-	bool export_shader (const shader_t ShaderType, const std::string& ShaderName, const std::string& ShaderFile);
+	bool export_shader (const std::string& Shader, const std::string& ShaderFile) const;
 	// export a K-3D slmeta file
-	bool export_k3d_slmeta (const shader_t ShaderType, const std::string& ShaderName, const std::string& ShaderFile);
-
+	bool export_k3d_slmeta (const std::string& MetaFile, const std::string& ShaderFile) const;
 
-	// build a shader starting from he root block, returns the shader file content
-	std::string build_shader_file (const shader_t ShaderType, const std::string& ShaderName);
-	// recursively build the shader code ending at given block
-	void build_shader_code (shader_block* Block, std::string& ShaderCode, std::set<std::string>& LocalVariables);
+	// the blocks of a shader, kept until the scene's network changes
+	struct shader_layout_t
+	{
+		shader_layout_t() : network_revision (0) {}
+
+		// scene network revision the layout was made at (0 when it has to be made again)
+		unsigned long network_revision;
+		// the blocks composing the shader
+		shrimp::shader_blocks_t blocks;
+		// the blocks in a reproducible order (parents first, then by name)
+		std::vector<shader_block*> ordered_blocks;
+		// the blocks in the order their code is written
+		std::vector<shader_block*> code_blocks;
+	};
+	typedef std::map<shader_t, shader_layout_t> shader_layouts_t;
+	shader_layouts_t m_layouts;
+
+	// bring the layouts of the shaders to build and the code fragments of their blocks up to
+	// date: after a network change every block of a remade layout is checked, otherwise only
+	// the blocks listed in the scene's journal and their children (before shaders are built)
+	void update_shader_layouts (const shader_builds_t& Builds);
+	// make a shader's layout, returns false when the network has a cycle
+	bool build_shader_layout (const shader_t ShaderType, shader_layout_t& Layout);
+
+	// the root block's code in a shader
+	std::string build_root_code (const shader_t ShaderType);
+
+	// build a shader starting from he root block and write it, with the RIB parameter list
+	// of its constant values; returns false when there's no shader to build
+	bool build_shader_file (const shader_build_t& Build, const general_options::renderers_t& Renderers, code_writer& Output, std::string& RIBParameters) const;
+	// list the parents whose code has to be written before a block's code
+	void get_code_parents (shader_block* Block, std::vector<shader_block*>& Parents);
+	// order a shader's blocks reproducibly (parents first, then by name)
+	std::vector<shader_block*> order_blocks (const shrimp::shader_blocks_t& Blocks);
+	// list the blocks whose code ends at given block, in the order it's written (written blocks
+	// are skipped), returns false when a cycle was found
+	bool build_shader_code (shader_block* Block, shrimp::shader_blocks_t& WrittenBlocks, std::vector<shader_block*>& CodeBlocks);
+	// rebuild a block's code fragment when the block or one of its parents changed
+	void update_code_fragment (shader_block* Block);
+	// expand a block's code into its code fragment, with its declarations
+	void build_code_fragment (shader_block* Block);
 	// build the K-3D slmeta file for a shader
-	std::string build_k3d_meta_file (const shader_t ShaderType, const std::string& ShaderName);
+	std::string build_k3d_meta_file (const shader_build_t& Build) const;
 
 	// return the list of connected blocks that make the shader
 	shrimp::shader_blocks_t get_all_shader_blocks (const shader_t ShaderType);
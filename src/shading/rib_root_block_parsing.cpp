@@ -21,511 +21,479 @@
 
 #include "rib_root_block_parsing.h"
 
-#include "../miscellaneous/logging.h"
 #include "../miscellaneous/misc_string_functions.h"
 
-#include <map>
+#include <algorithm>
+#include <cctype>
+#include <vector>
 
 
-// poor man's parser to transform valued arrays
+// rewrites block code statement by statement: the current statement is kept
+// apart until its end, so that the variables it requires can be set before it
+namespace
+{
+
 typedef std::string::size_type string_pos;
+const string_pos none = std::string::npos;
 
-std::vector<std::string> new_code_lines;
-std::set<std::string> new_instanciations;
+std::string get_valued_variable_name (const std::string& Name)
+{
+	return "valued_variable_" + Name;
+}
 
 
-string_pos previous_line_start = 0;
+// split an array to its elements:
+//   { 0.1, color (.4, .5, .6), 3, 4 }
+// returns:
+//   0.1
+//   color (.4, .5, .6)
+//   3
+//   4
+std::vector<std::string> split_array (const std::string& Array)
+{
+	std::vector<std::string> elements;
 
+	unsigned int level = 0;
+	bool in_string = false;
 
-void new_code_line (string_pos n, std::string& new_code)
-{
-	if (new_instanciations.size() > 0)
+	string_pos element_start = 0;
+	for (string_pos n = 0; n < Array.size(); ++n)
 	{
-		for (std::set<std::string>::iterator i = new_instanciations.begin(); i != new_instanciations.end(); ++i)
+		const char c = Array[n];
+
+		if (in_string)
+		{
+			if (c == '\\')
+				++n;
+			else if (c == '"')
+				in_string = false;
+		}
+		else if (c == '"')
+		{
+			in_string = true;
+		}
+		else if (c == '(' || c == '{')
+		{
+			++level;
+		}
+		else if ((c == ')' || c == '}') && level > 0)
 		{
-			new_code_lines.push_back (*i);
+			--level;
+		}
+		else if (c == ',' && level == 0)
+		{
+			elements.push_back (trim (std::string (Array, element_start, n - element_start)));
+			element_start = n + 1;
 		}
 	}
 
-	new_code_lines.push_back (new_code);
-	new_code = "";
-
-	previous_line_start = n;
-	if (n > 0)
-		n--;
+	const std::string last_element = trim (std::string (Array, element_start));
+	if (!last_element.empty())
+	{
+		elements.push_back (last_element);
+	}
 
-	new_instanciations.clear();
+	return elements;
 }
 
-std::string get_valued_variable_name (std::string name)
-{
-	return "valued_variable_" + name;
-}
 
-void add_declaration (std::string name, std::set<std::string>& local_declarations)
+class array_rewriter
 {
-	std::string declaration = "$(" + name + ":type) " + get_valued_variable_name (name);
-	std::string instanciation = get_valued_variable_name (name) + " = $(" + name + ");\n";
+public:
+	array_rewriter (const std::string& Code, std::set<std::string>& LocalDeclarations) :
+		m_code (Code),
+		m_local_declarations (LocalDeclarations),
+		m_statement_code_start (none),
+		m_assignment (none),
+		m_array_start (none),
+		m_parenthesis_level (0),
+		m_brace_level (0),
+		m_previous_character (' '),
+		m_line_start (true)
+	{
+	}
 
-	local_declarations.insert (declaration);
-	new_instanciations.insert (instanciation);
-}
+	std::string rewrite();
 
+private:
+	const std::string& m_code;
+	std::set<std::string>& m_local_declarations;
 
+	// rewritten code, up to the current statement
+	std::string m_output;
 
-// Replace:
-//   $(nnn)[i]
-// with
-//   type nnn_i = $(nnn); // to prevent 'normalize(vvv)[i]'
-//   nnn_i[i]
-std::string create_array_value_variables (const std::string code, std::set<std::string>& local_declarations)
-{
-	new_code_lines.clear();
-	new_instanciations.clear();
+	// current statement, where its code starts, its (last) assignation
+	// and the start of its array value (if any)
+	std::string m_statement;
+	string_pos m_statement_code_start;
+	string_pos m_assignment;
+	string_pos m_array_start;
 
-	bool single_line_comment = false;
-	bool multi_line_comment = false;
-	bool preprocessor_directive = false;
-	bool in_shrimp_variable = false;
-	bool in_shrimp_variable_array_index = false;
+	// value variables to set before the current statement
+	std::set<std::string> m_instanciations;
 
-	string_pos shrimp_variable_real_start;
-	string_pos shrimp_variable_start;
-	string_pos shrimp_variable_end;
-	std::string shrimp_variable;
+	unsigned int m_parenthesis_level;
+	unsigned int m_brace_level;
+	char m_previous_character;
+	bool m_line_start;
 
-	unsigned int parenthesis_level = 0;
+	void append (const std::string& Text, const bool Code);
+	void append (const char C);
+	void end_statement();
+	std::string statement_separator() const;
+	void replace_array_assignation();
+	bool next_word_is (const string_pos Position, const std::string& Word) const;
+};
 
-	char previous_character = ' ';
 
-	std::string new_code;
-	for (std::string::size_type n = 0; n < code.size(); ++n)
+std::string array_rewriter::rewrite()
+{
+	string_pos n = 0;
+	while (n < m_code.size())
 	{
-		char c = code[n];
-		new_code += c;
-		if (c == ' '
-			|| c == '\n'
-			|| c == '\t'
-			|| c == '\r'
-			|| single_line_comment
-			|| multi_line_comment
-			)
+		const char c = m_code[n];
+		const char next = n + 1 < m_code.size() ? m_code[n + 1] : '\0';
+
+		// single line comment, ends the statement
+		if (c == '/' && next == '/')
 		{
-			if (single_line_comment)
-			{
-				if (c == '\n' && previous_character != '\\')
-				{
-					single_line_comment = false;
+			string_pos end = m_code.find ('\n', n);
+			end = (end == none) ? m_code.size() : end + 1;
 
-					// new code line
-					string_pos new_code_line_start = new_code.size();
+			append (m_code.substr (n, end - n), false);
+			end_statement();
 
-					string_pos p = n;
-					char next_c = code[p];
-					while ((p < code.size()) && (next_c == '\n' || next_c == '\r'))
-					{
-						++p;
-						++new_code_line_start;
+			n = end;
+			continue;
+		}
 
-						next_c = code[p];
-					}
+		// multi line comment
+		if (c == '/' && next == '*')
+		{
+			string_pos end = m_code.find ("*/", n + 2);
+			end = (end == none) ? m_code.size() : end + 2;
 
-					new_code_line (new_code_line_start, new_code);
-				}
-			}
+			append (m_code.substr (n, end - n), false);
 
-			if (multi_line_comment)
-			{
-				if (c == '/' && previous_character == '*')
-					multi_line_comment = false;
-			}
+			n = end;
+			continue;
+		}
 
-			if (preprocessor_directive)
-			{
-				if (c == '\n' && previous_character != '\\')
-				{
-					preprocessor_directive = false;
+		// preprocessor directive (with its escaped new lines), ends the statement
+		if (c == '#' && m_line_start)
+		{
+			string_pos end = n;
+			while (end < m_code.size() && !(m_code[end] == '\n' && m_code[end - 1] != '\\'))
+				++end;
+			end = (end == m_code.size()) ? end : end + 1;
 
-					// new code line
-					string_pos new_code_line_start = new_code.size();
+			append (m_code.substr (n, end - n), false);
+			end_statement();
 
-					string_pos p = n;
-					char next_c = code[p];
-					while ((p < code.size()) && (next_c == '\n' || next_c == '\r'))
-					{
-						++p;
-						++new_code_line_start;
+			n = end;
+			continue;
+		}
 
-						next_c = code[p];
-					}
+		// string
+		if (c == '"')
+		{
+			string_pos end = n + 1;
+			while (end < m_code.size() && m_code[end] != '"')
+				end += (m_code[end] == '\\') ? 2 : 1;
+			end = std::min (end + 1, m_code.size());
 
-					new_code_line (new_code_line_start, new_code);
-				}
-			}
+			append (m_code.substr (n, end - n), true);
+			m_previous_character = '"';
 
+			n = end;
 			continue;
 		}
 
-		if (c == '/' && previous_character == '/')
-		{
-			single_line_comment = true;
-		}
-		else if (c == '*' && previous_character == '/')
-		{
-			multi_line_comment = true;
-		}
-		else if (c == '#')
+		if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
 		{
-			preprocessor_directive = true;
+			append (c);
+
+			++n;
+			continue;
 		}
-		else if (c == ';')
+
+		// Shrimp variable, replaced with a valued variable when it's indexed
+		// (to prevent 'normalize(vvv)[i]')
+		if (c == '$' && next == '(')
 		{
-			if (parenthesis_level == 0)
+			const string_pos end = m_code.find (')', n);
+			if (end == none)
 			{
-				string_pos new_code_line_start = new_code.size();
+				append (m_code.substr (n), true);
+				break;
+			}
 
-				string_pos p = n;
-				char next_c = code[p];
-				while (next_c == '\n' || next_c == '\r')
-				{
-					++p;
-					++new_code_line_start;
+			string_pos index = end + 1;
+			while (index < m_code.size() && (m_code[index] == ' ' || m_code[index] == '\t' || m_code[index] == '\r' || m_code[index] == '\n'))
+				++index;
 
-					next_c = code[p];
-				}
+			if (index < m_code.size() && m_code[index] == '[')
+			{
+				const std::string name = trim (m_code.substr (n + 2, end - n - 2));
 
-				new_code_line (new_code_line_start, new_code);
-			}
-		}
-		else if (c == '(')
-		{
-			parenthesis_level++;
+				m_local_declarations.insert ("$(" + name + ":type) " + get_valued_variable_name (name));
+				m_instanciations.insert (get_valued_variable_name (name) + " = $(" + name + ");");
 
-			if (previous_character == '$' && !in_shrimp_variable_array_index)
-			{
-				in_shrimp_variable = true;
-				shrimp_variable_real_start = n - 1;
-				shrimp_variable_start = n + 1;
+				append (get_valued_variable_name (name), true);
 			}
-		}
-		else if (c == ')')
-		{
-			parenthesis_level--;
-
-			if (in_shrimp_variable)
+			else
 			{
-				in_shrimp_variable = false;
-				shrimp_variable_end = n - 1;
-				shrimp_variable = trim (std::string (code, shrimp_variable_start, shrimp_variable_end - shrimp_variable_start + 1));
+				append (m_code.substr (n, end + 1 - n), true);
 			}
-		}
-		else if (c == '[' && previous_character == ')' && !in_shrimp_variable_array_index)
-		{
-			in_shrimp_variable_array_index = true;
-		}
-		else if (c == ']')
-		{
-			if (in_shrimp_variable_array_index)
-			{
-				in_shrimp_variable_array_index = false;
 
-				// replace variable in new code
-				add_declaration (shrimp_variable, local_declarations);
-
-				string_pos replacement_start = new_code.size() - (n - shrimp_variable_real_start + 1);
-				string_pos replacement_size = shrimp_variable_end - shrimp_variable_real_start + 2;
-
-				new_code.replace (replacement_start, replacement_size, get_valued_variable_name (shrimp_variable));
-			}
+			m_previous_character = ')';
+			n = end + 1;
+			continue;
 		}
 
-		previous_character = c;
-	}
-
-	// build shader block
-	std::string shader_block = "";
-	for (std::vector<std::string>::iterator i = new_code_lines.begin(); i != new_code_lines.end(); ++i)
-	{
-		shader_block += "\t" + *i;
-	}
-
-	return shader_block;
-}
+		switch (c)
+		{
+			case '(':
+				++m_parenthesis_level;
+			break;
+
+			case ')':
+				if (m_parenthesis_level > 0)
+					--m_parenthesis_level;
+			break;
+
+			case '=':
+				// simple assignation (not a comparison or an operator assignation)
+				if (m_parenthesis_level == 0 && m_array_start == none && next != '='
+					&& std::string ("=!<>+-*/").find (m_previous_character) == none)
+				{
+					m_assignment = m_statement.size();
+				}
+			break;
 
+			case '{':
+				if (m_array_start != none)
+				{
+					++m_brace_level;
+				}
+				else if (m_previous_character == '=' && m_assignment != none)
+				{
+					// array initialization
+					append (c);
+					m_array_start = m_statement.size();
+					m_brace_level = 1;
 
+					++n;
+					continue;
+				}
+				else
+				{
+					// code block
+					append (c);
+					end_statement();
 
-// split an array to its elements:
-//   { 0.1, color (.4, .5, .6), 3, 4 }
-// returns:
-//   0.1
-//   color (.4, .5, .6)
-//   3
-//   4
-std::vector<std::string> split_array (const std::string array)
-{
-	std::vector<std::string> elements;
+					++n;
+					continue;
+				}
+			break;
 
-	unsigned int parenthesis_level = 0;
+			case '}':
+				if (m_array_start != none)
+				{
+					if (--m_brace_level == 0)
+					{
+						replace_array_assignation();
 
-	string_pos element_start = 0;
-	for (std::string::size_type n = 0; n < array.size(); ++n)
-	{
-		char c = array[n];
+						++n;
+						continue;
+					}
+				}
+				else if (!next_word_is (n + 1, "else"))
+				{
+					append (c);
+					end_statement();
 
-		if (c == ',')
-		{
-			if (parenthesis_level == 0)
-			{
-				string_pos element_end = n - 1;
-				std::string element = std::string (array, element_start, element_end - element_start + 1);
+					++n;
+					continue;
+				}
+			break;
 
-				elements.push_back (trim (element));
+			case ';':
+				// an 'if' statement goes on with its 'else'
+				if (m_parenthesis_level == 0 && m_array_start == none)
+				{
+					append (c);
+					if (next_word_is (n + 1, "else"))
+						m_assignment = none;
+					else
+						end_statement();
+
+					++n;
+					continue;
+				}
+			break;
 
-				element_start = n + 1;
-			}
-		}
-		else if (c == '(')
-		{
-			parenthesis_level++;
+			default:
+			break;
 		}
-		else if (c == ')')
-		{
-			parenthesis_level--;
-		}
-	}
 
-	string_pos element_end = array.size() - 1;
-	if (element_start < element_end)
-	{
-		std::string element = std::string (array, element_start, element_end);
-
-		elements.push_back (trim (element));
+		append (c);
+		++n;
 	}
 
-	return elements;
+	end_statement();
+
+	return m_output;
 }
 
 
-// Replace:
-//   array = { v1, v2, v3 };
-// with
-//   array[0] = v1;
-//   array[1] = v2;
-//   array[2] = v3;
-std::string replace_array_assignations (const std::string code, std::set<std::string>& local_declarations)
+void array_rewriter::append (const std::string& Text, const bool Code)
 {
-	new_code_lines.clear();
-	new_instanciations.clear();
-
-	bool single_line_comment = false;
-	bool multi_line_comment = false;
-	bool preprocessor_directive = false;
-	bool in_array_initialization = false;
+	if (Text.empty())
+		return;
 
-	string_pos lvalue_end;
-	string_pos current_code_line_start;
-	string_pos array_start;
+	if (Code && m_statement_code_start == none)
+		m_statement_code_start = m_statement.size();
 
-	unsigned int parenthesis_level = 0;
-
-	char previous_character = ' ';
+	m_statement += Text;
+	m_line_start = (Text[Text.size() - 1] == '\n');
+}
 
-	std::map<std::string, std::string> replacements;
-	std::map<std::string, std::string> replacement_lvalues;
 
-	std::string new_code;
-	for (std::string::size_type n = 0; n < code.size(); ++n)
+void array_rewriter::append (const char C)
+{
+	if (C == '\n')
 	{
-		char c = code[n];
-		new_code += c;
-		if (c == ' '
-			|| c == '\n'
-			|| c == '\t'
-			|| c == '\r'
-			|| single_line_comment
-			|| multi_line_comment
-			)
-		{
-			if (single_line_comment)
-			{
-				if (c == '\n' && previous_character != '\\')
-				{
-					single_line_comment = false;
-
-					// new code line
-					string_pos new_code_line_start = new_code.size();
-
-					string_pos p = n;
-					char next_c = code[p];
-					while ((p < code.size()) && (next_c == '\n' || next_c == '\r'))
-					{
-						++p;
-						++new_code_line_start;
-
-						next_c = code[p];
-					}
-
-					new_code_line (new_code_line_start, new_code);
-				}
-			}
-
-			if (multi_line_comment)
-			{
-				if (c == '/' && previous_character == '*')
-					multi_line_comment = false;
-			}
-
-			if (preprocessor_directive)
-			{
-				if (c == '\n' && previous_character != '\\')
-				{
-					preprocessor_directive = false;
-
-					// new code line
-					string_pos new_code_line_start = new_code.size();
-					current_code_line_start = new_code_line_start;
+		m_line_start = true;
+	}
+	else if (C != ' ' && C != '\t' && C != '\r')
+	{
+		if (m_statement_code_start == none)
+			m_statement_code_start = m_statement.size();
 
-					string_pos p = n;
-					char next_c = code[p];
-					while ((p < code.size()) && (next_c == '\n' || next_c == '\r'))
-					{
-						++p;
-						++new_code_line_start;
+		m_line_start = false;
+		m_previous_character = C;
+	}
 
-						next_c = code[p];
-					}
+	m_statement += C;
+}
 
-					new_code_line (new_code_line_start, new_code);
-				}
-			}
 
-			continue;
-		}
+void array_rewriter::end_statement()
+{
+	if (m_instanciations.empty())
+	{
+		m_output += m_statement;
+	}
+	else
+	{
+		// set the value variables before the statement
+		const string_pos code_start = (m_statement_code_start == none) ? m_statement.size() : m_statement_code_start;
+		const std::string separator = statement_separator();
 
-		if (c == '/' && previous_character == '/')
-		{
-			single_line_comment = true;
-		}
-		else if (c == '*' && previous_character == '/')
-		{
-			multi_line_comment = true;
-		}
-		else if (c == '#')
+		m_output.append (m_statement, 0, code_start);
+		for (std::set<std::string>::const_iterator i = m_instanciations.begin(); i != m_instanciations.end(); ++i)
 		{
-			preprocessor_directive = true;
+			m_output += *i + separator;
 		}
-		else if (c == ';')
-		{
-			if (parenthesis_level == 0)
-			{
-				string_pos new_code_line_start = new_code.size();
-				current_code_line_start = n + 1;
+		m_output.append (m_statement, code_start, none);
 
-				string_pos p = n;
-				char next_c = code[p];
-				while (next_c == '\n' || next_c == '\r')
-				{
-					++p;
-					++new_code_line_start;
+		m_instanciations.clear();
+	}
 
-					next_c = code[p];
-				}
+	m_statement.clear();
+	m_statement_code_start = none;
+	m_assignment = none;
+	m_array_start = none;
+	m_brace_level = 0;
+	m_parenthesis_level = 0;
+}
 
-				new_code_line (new_code_line_start, new_code);
-			}
-		}
-		else if (c == '=')
-		{
-			lvalue_end = n - 1;
-		}
-		else if (c == '(')
-		{
-			parenthesis_level++;
-		}
-		else if (c == ')')
-		{
-			parenthesis_level--;
-		}
-		else if (c == '{')
-		{
-			if (previous_character == '=')
-			{
-				// found array inialization
-				in_array_initialization = true;
-				array_start = n + 1;
-			}
-		}
-		else if (c == '}')
-		{
-			if (in_array_initialization)
-			{
-				// found array initialization's end
-				in_array_initialization = false;
 
-				// store l-value
-				std::string lvalue = std::string (code, current_code_line_start, lvalue_end - current_code_line_start + 1);
-				lvalue = trim (lvalue);
+// separator between statements added before the current one: the statement's indentation
+std::string array_rewriter::statement_separator() const
+{
+	const string_pos code_start = (m_statement_code_start == none) ? m_statement.size() : m_statement_code_start;
 
-				// put array in a string
-				string_pos array_end = n - 1;
-				std::string array = std::string (code, array_start, array_end - array_start + 1);
+	string_pos line_start = code_start;
+	while (line_start > 0 && (m_statement[line_start - 1] == ' ' || m_statement[line_start - 1] == '\t'))
+		--line_start;
 
-				string_pos replacement_start = current_code_line_start;
-				string_pos replacement_size = array_end - replacement_start + 2;
+	const bool new_line = (line_start > 0) ? (m_statement[line_start - 1] == '\n')
+		: (m_output.empty() || m_output[m_output.size() - 1] == '\n');
+	if (new_line)
+		return "\n" + m_statement.substr (line_start, code_start - line_start);
 
-				std::string replacement = std::string (code, replacement_start, replacement_size);
+	return " ";
+}
 
-				// save for later replacement
-				replacements[replacement] = array;
-				replacement_lvalues[replacement] = lvalue;
-			}
-		}
 
-		previous_character = c;
+// Replace:
+//   array = { v1, v2, v3 };
+// with
+//   array[0] = v1;
+//   array[1] = v2;
+//   array[2] = v3;
+// declarations are kept without their initialization:
+//   float array[3] = { v1, v2, v3 };  ->  float array[3]; array[0] = v1; ...
+void array_rewriter::replace_array_assignation()
+{
+	const std::string lvalue = trim (m_statement.substr (m_statement_code_start, m_assignment - m_statement_code_start));
+	const std::vector<std::string> values = split_array (m_statement.substr (m_array_start));
+	const std::string separator = statement_separator();
+
+	// a declaration's variable is its last word
+	string_pos variable_start = 0;
+	unsigned int level = 0;
+	for (string_pos c = 0; c < lvalue.size(); ++c)
+	{
+		if (lvalue[c] == '[' || lvalue[c] == '(')
+			++level;
+		else if ((lvalue[c] == ']' || lvalue[c] == ')') && level > 0)
+			--level;
+		else if (level == 0 && (lvalue[c] == ' ' || lvalue[c] == '\t' || lvalue[c] == '\r' || lvalue[c] == '\n'))
+			variable_start = c + 1;
 	}
 
-	// build shader block
-	std::string shader_block = "";
-	for (std::vector<std::string>::iterator i = new_code_lines.begin(); i != new_code_lines.end(); ++i)
+	std::string assignations;
+	std::string variable = lvalue;
+	if (variable_start > 0)
 	{
-		std::string line = *i;
+		assignations = lvalue + ";" + separator;
+		variable = lvalue.substr (variable_start, lvalue.find ('[', variable_start) - variable_start);
+	}
 
-		// quick'n'dirty replacements
-		for (std::map<std::string, std::string>::iterator repl = replacements.begin(); repl != replacements.end(); ++repl)
-		{
-			std::string orig = repl->first;
-			std::string array = repl->second;
-			std::string lvalue = replacement_lvalues[orig];
+	for (std::vector<std::string>::size_type v = 0; v < values.size(); ++v)
+	{
+		if (v > 0)
+			assignations += ";" + separator;
 
-			std::string::size_type repl_start = line.find (orig);
-			if (repl_start != std::string::npos)
-			{
-				// split array
-				std::vector<std::string> array_values = split_array (array);
+		assignations += variable + "[" + string_cast (v) + "] = " + values[v];
+	}
 
-				// build replacement
-				std::string new_array = "\n";
-				int array_index = 0;
-				for (std::vector<std::string>::const_iterator val = array_values.begin(); val != array_values.end(); ++val)
-				{
-					if (array_index > 0)
-					{
-						new_array += ";\n";
-					}
+	m_statement.replace (m_statement_code_start, none, assignations);
+	m_assignment = none;
+	m_array_start = none;
+	m_previous_character = '}';
+}
 
-					new_array += "\t" + lvalue + "[" + string_cast (array_index++) + "] = " + *val;
-				}
 
-				// replace
-				line.replace (repl_start, orig.size(), new_array);
-			}
-		}
+bool array_rewriter::next_word_is (const string_pos Position, const std::string& Word) const
+{
+	const string_pos word = m_code.find_first_not_of (" \t\r\n", Position);
+	if (word == none || m_code.compare (word, Word.size(), Word) != 0)
+		return false;
 
-		// save line
-		shader_block += "\t" + line;
-	}
+	const string_pos after = word + Word.size();
+	return after >= m_code.size() || !(isalnum (m_code[after]) || m_code[after] == '_');
+}
 
-	return shader_block;
 }
 
 
+std::string rewrite_arrays (const std::string& Code, std::set<std::string>& LocalDeclarations)
+{
+	array_rewriter rewriter (Code, LocalDeclarations);
+	return rewriter.rewrite();
+}
+
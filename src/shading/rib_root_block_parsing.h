@@ -25,9 +25,12 @@
 #include <set>
 #include <string>
 
-std::string create_array_value_variables (const std::string code, std::set<std::string>& local_variables);
-
-std::string replace_array_assignations (const std::string code, std::set<std::string>& local_variables);
+// Rewrite the arrays of a block's code that RSL doesn't accept, in a single pass:
+//   $(nnn)[i]             ->  valued_variable_nnn = $(nnn); ... valued_variable_nnn[i]
+//   array = { v1, v2 };   ->  array[0] = v1; array[1] = v2;
+// the declarations of the added variables are added to LocalDeclarations.
+// Doesn't use any global state (can be called from several threads).
+std::string rewrite_arrays (const std::string& Code, std::set<std::string>& LocalDeclarations);
 
 #endif
 
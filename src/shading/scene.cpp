@@ -20,14 +20,15 @@
 
 
 #include "scene.h"
+#include "block_cache.h"
 #include "rib_root_block.h"
 
 #include "preferences.h"
 
-#include <fltk/filename.h>
-
 #include "../miscellaneous/logging.h"
 #include "../miscellaneous/misc_string_functions.h"
+#include "../miscellaneous/misc_system_functions.h"
+#include "../miscellaneous/misc_thread_pool.h"
 #include "../miscellaneous/misc_xml.h"
 
 #include <fstream>
@@ -35,7 +36,9 @@
 
 
 scene::scene() :
-	m_file_name(std::string(""))
+	m_file_name(std::string("")),
+	m_blocks (1, static_cast<shader_block*> (0)),
+	m_block_count (0)
 {
 	unsigned long successful_blocks = 0;
 
@@ -44,6 +47,9 @@ scene::scene() :
 	root_node.node_path = "./blocks";
 	m_block_classification = root_node;
 
+	// keep end-of-lines when loading code
+	TiXmlBase::SetCondenseWhiteSpace (false);
+
 	log() << aspect << "Loading default Prawn blocks." << std::endl;
 	load_default_blocks (m_block_classification, successful_blocks);
 	log() << aspect << "Successfully loaded " << successful_blocks << " blocks." << std::endl;
@@ -54,6 +60,7 @@ scene::scene() :
 
 scene::~scene() {
 
+	release_block_prototypes();
 }
 
 
@@ -105,11 +112,15 @@ void scene::empty_scene() {
 	// delete blocks
 	for (shader_blocks_t::iterator block_i = m_blocks.begin(); block_i != m_blocks.end(); ++block_i) {
 
-		delete block_i->second;
+		delete *block_i;
 	}
 	//delete m_rib_root_block;
 
-	m_blocks.clear();
+	m_blocks.assign (1, static_cast<shader_block*> (0));
+	m_block_count = 0;
+	m_block_handles.clear();
+	m_unique_name_numbers.clear();
+	m_changes.changed_blocks.clear();
 }
 
 
@@ -126,105 +137,239 @@ void scene::new_scene() {
 	// create RIB root block
 	const std::string unique_name = get_unique_block_name ("Root block");
 	m_rib_root_block = new rib_root_block (unique_name, this);
-	m_blocks.insert (std::make_pair (unique_name, m_rib_root_block));
+	insert_block (m_rib_root_block);
 }
 
 
+// a directory of the block library, as listed by the loader
+struct scene::block_directory_t
+{
+	std::string path;
+	bool listed;
+
+	// subdirectory names and their index in the directory list
+	std::vector<std::string> directory_names;
+	std::vector<size_t> directories;
+
+	// XML files and their index in the block file list
+	std::vector<std::string> block_paths;
+	std::vector<size_t> blocks;
+};
+
+// a block file parsed by the loader
+struct scene::block_file_t
+{
+	std::string path;
+	shader_block* block;
+
+	// block cache key (absolute path) and file stamp
+	std::string cache_key;
+	block_cache::stamp_t stamp;
+	bool stamped;
+	// whether the block was created from the cache
+	bool cached;
+
+	// messages logged while parsing
+	log_messages_t log;
+};
+
+
 void scene::load_default_blocks (block_tree_node_t& RootNode, unsigned long& BlockCount) {
 
+	thread_pool pool (thread_pool::hardware_threads() * 2);
+
+	// blocks that didn't change since the last launch are read from the cache
+	block_cache cache (system_functions::get_shrimp_user_directory() + "/block_cache.bin");
+	const std::string library_path = system_functions::get_absolute_path (RootNode.node_path);
+
+	// list the library, one directory level at a time
+	std::vector<block_directory_t> directories (1);
+	directories[0].path = RootNode.node_path;
+
+	std::vector<block_file_t> block_files;
+
+	size_t level_start = 0;
+	while (level_start < directories.size()) {
+
+		const size_t level_end = directories.size();
+		for (size_t d = level_start; d < level_end; ++d) {
+
+			block_directory_t* directory = &directories[d];
+			pool.push ([directory] { list_block_directory (*directory); });
+		}
+		pool.wait();
+
+		// queue the subdirectories and block files that were found
+		for (size_t d = level_start; d < level_end; ++d) {
+
+			for (size_t s = 0; s < directories[d].directory_names.size(); ++s) {
+
+				block_directory_t sub_directory;
+				sub_directory.path = directories[d].path + "/" + directories[d].directory_names[s];
+				directories[d].directories.push_back (directories.size());
+				directories.push_back (sub_directory);
+			}
+
+			for (size_t b = 0; b < directories[d].block_paths.size(); ++b) {
+
+				block_file_t block_file;
+				block_file.path = directories[d].block_paths[b];
+				block_file.block = 0;
+				block_file.cache_key = library_path + block_file.path.substr (RootNode.node_path.size());
+				block_file.stamped = false;
+				block_file.cached = false;
+				directories[d].blocks.push_back (block_files.size());
+				block_files.push_back (block_file);
+			}
+		}
+
+		level_start = level_end;
+	}
+
+	// parse all the block files
+	for (std::vector<block_file_t>::iterator file_i = block_files.begin(); file_i != block_files.end(); ++file_i) {
+
+		block_file_t* block_file = &(*file_i);
+		pool.push ([block_file, &cache] {
+
+			log_capture capture;
+
+			block_file->stamped = block_cache::get_stamp (block_file->path, block_file->stamp);
+			if (block_file->stamped) {
+				block_file->block = cache.load_block (block_file->cache_key, block_file->stamp);
+				block_file->cached = (block_file->block != 0);
+			}
+
+			if (!block_file->cached) {
+				shader_block_builder builder;
+				block_file->block = builder.build_block (block_file->path);
+			}
+
+			block_file->log = capture.messages();
+		});
+	}
+	pool.wait();
+
+	// update the cache (blocks whose parsing logged messages aren't cached, to get the messages on each launch)
+	unsigned long cached_blocks = 0;
+	for (std::vector<block_file_t>::const_iterator file_i = block_files.begin(); file_i != block_files.end(); ++file_i) {
+
+		if (file_i->cached) {
+			cache.keep_block (file_i->cache_key);
+			++cached_blocks;
+		}
+		else if (file_i->block && file_i->stamped && file_i->log.empty()) {
+			cache.store_block (file_i->cache_key, file_i->stamp, *file_i->block);
+		}
+	}
+	cache.save();
+
+	log() << aspect << " " << cached_blocks << " of " << block_files.size() << " blocks read from the block cache" << std::endl;
+
+	// register the blocks in the same order as a sequential, depth-first load
+	register_default_blocks (RootNode, directories, 0, block_files, BlockCount);
+
+	// delete the blocks that weren't kept as prototypes
+	for (std::vector<block_file_t>::iterator file_i = block_files.begin(); file_i != block_files.end(); ++file_i) {
+
+		delete file_i->block;
+	}
+}
+
+
+void scene::list_block_directory (block_directory_t& Directory) {
+
 	// read directory content
-	dirent** block_files;
-	const int file_count = fltk::filename_list (RootNode.node_path.c_str(), &block_files);
+	std::vector<std::string> block_files;
+	Directory.listed = system_functions::list_directory (Directory.path, block_files);
 
 	// skip empty directories
-	if (file_count < 0) {
-		log() << error << "tried to load blocks from empty directory '" << RootNode.node_path << "'." << std::endl;
+	if (!Directory.listed) {
 		return;
 	}
 
 	// scan directory
-	typedef std::vector<std::string> names_t;
-	names_t file_paths;
-	names_t files;
-	names_t block_paths;
-
-	shader_block_builder builder;
-	int successful_block_count = 0;
-	for (int f = 0; f < file_count; ++f) {
+	for (std::vector<std::string>::const_iterator f = block_files.begin(); f != block_files.end(); ++f) {
 
-		const std::string file = std::string (block_files[f]->d_name);
-		const std::string file_path = RootNode.node_path + "/" + file;
-		if (fltk::filename_isdir (file_path.c_str())) {
+		const std::string& file = *f;
+		const std::string file_path = Directory.path + "/" + file;
+		if (system_functions::is_directory (file_path)) {
 
 			if (file[0] == '.') {
 				// skip default directories
 			}
 			else {
 				// save directory
-				file_paths.push_back (file_path);
-				files.push_back (file);
+				Directory.directory_names.push_back (file);
 			}
 		}
 		else {
-			const char* extension = fltk::filename_ext (file.c_str());
-			if (std::string (extension) == ".xml") {
+			if (system_functions::file_extension (file) == ".xml") {
 
 				// save XML file
-				block_paths.push_back (file_path);
+				Directory.block_paths.push_back (file_path);
 			}
 		}
-
-		free (block_files[f]);
 	}
+}
+
 
-	free (block_files);
+void scene::register_default_blocks (block_tree_node_t& Node, const std::vector<block_directory_t>& Directories, const size_t DirectoryIndex, std::vector<block_file_t>& BlockFiles, unsigned long& BlockCount) {
+
+	const block_directory_t& directory = Directories[DirectoryIndex];
+	if (!directory.listed) {
+		log() << error << "tried to load blocks from empty directory '" << Node.node_path << "'." << std::endl;
+		return;
+	}
 
 	// process subdirectories
-	names_t::iterator path_i = file_paths.begin();
-	names_t::iterator file_i = files.begin();
-	for (; path_i != file_paths.end(); ++path_i, ++file_i) {
+	for (size_t s = 0; s < directory.directories.size(); ++s) {
 
 		block_tree_node_t sub_node;
-		sub_node.node_name = *file_i;
-		sub_node.node_path = RootNode.node_path + "/" + *file_i;
-		RootNode.child_nodes.push_back (sub_node);
+		sub_node.node_name = directory.directory_names[s];
+		sub_node.node_path = Node.node_path + "/" + directory.directory_names[s];
+		Node.child_nodes.push_back (sub_node);
 
 		// load blocks from the subdirectory
-		load_default_blocks (RootNode.child_nodes.back(), BlockCount);
+		register_default_blocks (Node.child_nodes.back(), Directories, directory.directories[s], BlockFiles, BlockCount);
 	}
 
 	// process blocks
-	for (names_t::iterator path_i = block_paths.begin(); path_i != block_paths.end(); ++path_i) {
+	for (std::vector<size_t>::const_iterator file_i = directory.blocks.begin(); file_i != directory.blocks.end(); ++file_i) {
 
-		// try loading the block
-		shader_block* new_block = builder.build_block (*path_i);
-		if (new_block) {
+		block_file_t& block_file = BlockFiles[*file_i];
+		replay_log (block_file.log);
 
-			successful_block_count++;
+		const shader_block* new_block = block_file.block;
+		if (new_block) {
 
 			if (m_default_blocks.find (new_block->name()) != m_default_blocks.end()) {
 
 				// duplicate name
-				log() << error << "couldn't load " << *path_i << " : a block named '" << new_block->name() << "' already exists." << std::endl;
+				log() << error << "couldn't load " << block_file.path << " : a block named '" << new_block->name() << "' already exists." << std::endl;
 			}
 			else {
 
 				default_block_t block_info;
 				block_info.name = new_block->name();
-				block_info.path = *path_i;
+				block_info.path = block_file.path;
 				m_default_blocks.insert (std::make_pair (new_block->name(), block_info));
 				++BlockCount;
 
+				// keep the parsed block as prototype
+				m_block_prototypes.insert (std::make_pair (new_block->name(), new_block));
+				block_file.block = 0;
+
 				// save block
-				RootNode.blocks.push_back (block_info);
+				Node.blocks.push_back (block_info);
 			}
 		}
 		else {
-			log() << error << "couldn't load " << *path_i << std::endl;
+			log() << error << "couldn't load " << block_file.path << std::endl;
 		}
 	}
 
-	log() << aspect << " loaded " << RootNode.blocks.size() << " blocks from " << RootNode.node_path << std::endl;
+	log() << aspect << " loaded " << Node.blocks.size() << " blocks from " << Node.node_path << std::endl;
 }
 
 
@@ -234,10 +379,10 @@ block_tree_node_t scene::get_block_hierarchy() const {
 }
 
 
-std::string scene::get_shader_code() {
+std::string scene::get_shader_code (const unsigned int Threads) {
 
 	if (rib_root_block* rib_block = dynamic_cast<rib_root_block*>(m_rib_root_block)) {
-		return rib_block->show_code();
+		return rib_block->show_code (Threads);
 	}
 
 	return "";
@@ -253,33 +398,74 @@ void scene::show_preview (const std::string& TempDir) {
 }
 
 
-void scene::export_scene (const std::string& Directory) {
+preview_runner::status_t scene::update_preview() {
 
 	if (rib_root_block* rib_block = dynamic_cast<rib_root_block*>(m_rib_root_block)) {
-		rib_block->export_scene (Directory);
+		return rib_block->update_preview();
 	}
 
+	preview_runner::status_t status;
+	status.state = preview_runner::IDLE;
+	status.finished_jobs = 0;
+	status.jobs = 0;
+	return status;
 }
 
 
-shader_block* scene::get_parent (const std::string& BlockName, const std::string& Input, std::string& ParentOutput) const {
+void scene::update_speculative_compilation (const std::string& TempDir) {
+
+	if (rib_root_block* rib_block = dynamic_cast<rib_root_block*>(m_rib_root_block)) {
+		rib_block->update_speculative_compilation (TempDir);
+	}
+}
 
-	const shrimp::io_t input (BlockName, Input);
 
-	for (shrimp::dag_t::const_iterator connection = m_dag.begin(); connection != m_dag.end(); ++connection) {
+bool scene::export_scene (const std::string& Directory, const bool Compile) {
 
-		const shrimp::io_t to = connection->first;
+	if (rib_root_block* rib_block = dynamic_cast<rib_root_block*>(m_rib_root_block)) {
+		return rib_block->export_scene (Directory, Compile);
+	}
+
+	return false;
+}
 
-		if (to == input) {
 
-			const shrimp::io_t from = connection->second;
-			shader_blocks_t::const_iterator block = m_blocks.find(from.first);
-			ParentOutput = from.second;
-			return block->second;
-		}
+shader_block* scene::get_parent (const shader_block* Block, const property& Input, std::string& ParentOutput) const {
+
+	const shrimp::dag_t::const_iterator connection = m_dag.find (get_pad (Block, Input));
+	if (connection == m_dag.end()) {
+		return 0;
+	}
+
+	ParentOutput = shrimp::name_string (connection->second.pad);
+	return get_block (connection->second.block);
+}
+
+
+shader_block* scene::get_parent (const shader_block* Block, const std::string& Input, std::string& ParentOutput) const {
+
+	const property* input = Block->m_inputs.find (Input);
+	if (!input) {
+		return 0;
 	}
 
-	return 0;
+	return get_parent (Block, *input, ParentOutput);
 }
 
 
+shader_block* scene::get_parent (const std::string& BlockName, const std::string& Input, std::string& ParentOutput) const {
+
+	block_handles_t::const_iterator handle = m_block_handles.find (BlockName);
+	if (handle == m_block_handles.end()) {
+		return 0;
+	}
+
+	return get_parent (get_block (handle->second), Input, ParentOutput);
+}
+
+
+const shrimp::dag_t::pads_t& scene::get_children (const shrimp::pad_t& Output) const {
+
+	return m_dag.children (Output);
+}
+
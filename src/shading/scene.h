@@ -22,6 +22,7 @@
 #ifndef _scene_h_
 #define _scene_h_
 
+#include "preview_runner.h"
 #include "shader_block.h"
 #include "shrimp_public_structures.h"
 
@@ -42,7 +43,7 @@ public:
 	shrimp::dag_t m_dag;
 
 	//////////// Copy,paste data structures
-	shrimp::dag_t m_dag_copy;
+	shrimp::io_connections_t m_dag_copy;
 
 
 	//////////// Functions
@@ -74,12 +75,16 @@ public:
 	shader_block* add_predefined_block (const std::string& BlockName);
 	// add a new (empty) block to the scene
 	shader_block* add_custom_block (const std::string& Name = "New block", const bool RootBlock = false);
+	// free the library block prototypes (they're parsed again when needed)
+	void release_block_prototypes();
 	// remove a block from the network and delete it
 	void delete_block (const std::string& BlockName);
 	void delete_group (const int Group);
 
 	// get a block's pointer from its name
 	shader_block* get_block (const std::string& Name);
+	// get a block's pointer from its handle, 0 if the block was deleted
+	shader_block* get_block (const shrimp::block_handle_t Handle) const { return Handle < m_blocks.size() ? m_blocks[Handle] : 0; }
 	// find the root block
 	shader_block* get_root_block();
 	// make a block name unique in the scene
@@ -89,17 +94,38 @@ public:
 
 	// get all scene blocks
 	shrimp::shader_blocks_t get_scene_blocks();
+	// number of blocks in the scene
+	unsigned long block_count() const { return m_block_count; }
+
+	// height of a block's body in the network view (at least MinimumHeight)
+	double get_block_height (const shader_block* Block, const double MinimumHeight) const;
+	// find an ungrouped block whose body contains a network position (the last one added when they overlap), 0 if none
+	shader_block* get_block_at (const double X, const double Y, const double MinimumBlockHeight);
 
 	// connect two blocks
 	void connect (const shrimp::io_t& Input, const shrimp::io_t& Output);
 	// disconnect an input or output from the network
 	void disconnect (const shrimp::io_t& IO);
+	void disconnect (const shrimp::pad_t& Pad);
 	// tell whether an input is connected to an output
 	bool is_connected (const shrimp::io_t& Input);
+	bool is_connected (const shader_block* Block, const property& Input) const;
+
+	// the pad of a block's property, and pad <-> name conversions for the user interface
+	// (find_pad returns false when there's no such block)
+	shrimp::pad_t get_pad (const shader_block* Block, const property& Property) const { return shrimp::pad_t (Block->handle(), Property.pad_name()); }
+	bool find_pad (const shrimp::io_t& IO, shrimp::pad_t& Pad) const;
+	shrimp::io_t get_io (const shrimp::pad_t& Pad) const;
 
 	// list of upward blocks in the DAG (parents + parents' parents + etc)
 	void upward_blocks (shader_block* StartingBlock, shrimp::shader_blocks_t& List);
 
+	// revision of the latest network change: blocks added or removed, connections,
+	// names and properties (see shader_block::touch_network())
+	unsigned long network_revision() const { return m_changes.network_revision; }
+	// take the handles of the blocks touched since the list was last taken
+	void take_changed_blocks (std::vector<shrimp::block_handle_t>& Blocks);
+
 
 	//////////// Serialization
 
@@ -147,16 +173,25 @@ public:
 	const std::string get_group_name (const int Group) const;
 	void set_group_name (const int Group, const std::string& Name);
 
-	std::string get_shader_code();
+	// the scene's shader code (the shaders are built concurrently, or by the given number of threads)
+	std::string get_shader_code (const unsigned int Threads = 0);
 	void show_preview (const std::string& TempDir);
+	preview_runner::status_t update_preview();
+	void update_speculative_compilation (const std::string& TempDir);
 
-	// save current scene's RIB and shader files to a directory
-	void export_scene (const std::string& Directory);
+	// save current scene's RIB and shader files to a directory, and compile the shaders if asked
+	// (returns false when there's no root block or a compilation failed)
+	bool export_scene (const std::string& Directory, const bool Compile = false);
 
 
 	//////////// Misc
 
+	// block and output connected to a block's input, 0 if the input isn't connected
+	shader_block* get_parent (const shader_block* Block, const property& Input, std::string& ParentOutput) const;
+	shader_block* get_parent (const shader_block* Block, const std::string& Input, std::string& ParentOutput) const;
 	shader_block* get_parent (const std::string& BlockName, const std::string& Input, std::string& ParentOutput) const;
+	// inputs connected to a block's output
+	const shrimp::dag_t::pads_t& get_children (const shrimp::pad_t& Output) const;
 
 
 private:
@@ -175,12 +210,26 @@ private:
 
 	rib_root_block* m_rib_root_block;
 
-	// the list of blocks
-	typedef std::map<std::string, shader_block*> shader_blocks_t;
+	// the list of blocks, indexed by handle (the first slot is unused,
+	// deleted blocks leave an empty slot until the scene is emptied)
+	typedef std::vector<shader_block*> shader_blocks_t;
 	shader_blocks_t m_blocks;
+	unsigned long m_block_count;
+	// block handles by name, for the user interface and scene files
+	typedef std::map<std::string, shrimp::block_handle_t> block_handles_t;
+	block_handles_t m_block_handles;
+
+	// give a block a handle and add it to the lists
+	void insert_block (shader_block* Block);
+	// changes noted by the blocks
+	shader_block::change_journal m_changes;
+
+	// first number to try when making a name unique, by name (cleared when names are freed)
+	mutable std::map<std::string, int> m_unique_name_numbers;
 
 	//////////// group data structures
-	shrimp::groups_t m_groups;
+	typedef std::map<shrimp::block_handle_t, int> block_groups_t;
+	block_groups_t m_groups;
 	typedef std::map<int, std::string> group_names_t;
 	group_names_t m_group_names;
 
@@ -190,9 +239,21 @@ private:
 	typedef std::map <std::string, default_block_t> default_blocks_t;
 	default_blocks_t m_default_blocks;
 
-	// load predefined Shrimp blocks
+	// parsed default blocks, new scene blocks are copies of them
+	typedef std::map <std::string, const shader_block*> block_prototypes_t;
+	block_prototypes_t m_block_prototypes;
+
+	// return a default block's prototype, parsing the block if it isn't loaded
+	const shader_block* get_block_prototype (const default_block_t& Block);
+
+	// load predefined Shrimp blocks (directories are listed and blocks parsed in parallel)
 	void load_default_blocks (block_tree_node_t& RootPath, unsigned long& BlockCount);
 
+	struct block_directory_t;
+	struct block_file_t;
+	static void list_block_directory (block_directory_t& Directory);
+	void register_default_blocks (block_tree_node_t& Node, const std::vector<block_directory_t>& Directories, const size_t DirectoryIndex, std::vector<block_file_t>& BlockFiles, unsigned long& BlockCount);
+
 	// block hierarchy, contains the root block
 	block_tree_node_t m_block_classification;
 
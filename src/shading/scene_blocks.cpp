@@ -21,6 +21,7 @@
 
 #include "scene.h"
 #include "rib_root_block.h"
+#include <algorithm>
 #include <iostream>
 
 #include "../miscellaneous/logging.h"
@@ -31,7 +32,20 @@ void scene::add_block (const std::string& BlockId, const std::string& BlockFile,
 
 	const std::string unique_name = get_unique_block_name (BlockId);
 	Block->set_name (unique_name);
-	m_blocks.insert (std::make_pair (unique_name, Block));
+	insert_block (Block);
+}
+
+
+void scene::insert_block (shader_block* Block) {
+
+	const shrimp::block_handle_t handle = static_cast<shrimp::block_handle_t> (m_blocks.size());
+	Block->set_handle (handle, &m_changes);
+
+	m_blocks.push_back (Block);
+	m_block_handles.insert (std::make_pair (Block->name(), handle));
+	++m_block_count;
+
+	Block->touch_network();
 }
 
 
@@ -50,21 +64,58 @@ shader_block* scene::add_predefined_block (const std::string& BlockName) {
 		return 0;
 	}
 
-	shader_block_builder builder;
-	shader_block* block = builder.build_block (block_i->second.path);
+	// clone the block's prototype
+	const shader_block* prototype = get_block_prototype (block_i->second);
+	if (!prototype) {
+		return 0;
+	}
+
+	shader_block* block = new shader_block (*prototype);
 	add_block (BlockName, block_i->second.path, block);
 
 	return block;
 }
 
 
+const shader_block* scene::get_block_prototype (const default_block_t& Block) {
+
+	block_prototypes_t::const_iterator prototype_i = m_block_prototypes.find (Block.name);
+	if (prototype_i != m_block_prototypes.end()) {
+		return prototype_i->second;
+	}
+
+	// the prototype was released, parse the block again
+	shader_block_builder builder;
+	shader_block* prototype = builder.build_block (Block.path);
+	if (!prototype) {
+
+		log() << error << "couldn't load block '" << Block.name << "' from " << Block.path << std::endl;
+		return 0;
+	}
+
+	m_block_prototypes.insert (std::make_pair (Block.name, prototype));
+	return prototype;
+}
+
+
+void scene::release_block_prototypes() {
+
+	for (block_prototypes_t::iterator prototype_i = m_block_prototypes.begin(); prototype_i != m_block_prototypes.end(); ++prototype_i) {
+
+		delete prototype_i->second;
+	}
+
+	m_block_prototypes.clear();
+}
+
+
 shader_block* scene::add_custom_block (const std::string& Name, const bool RootBlock) {
 
 	const std::string unique_name = get_unique_block_name (Name);
 
 	shader_block* block = new shader_block (unique_name, "", RootBlock);
 	block->set_name (unique_name);
-	m_blocks.insert (std::make_pair (unique_name, block));
+	insert_block (block);
 
 	return block;
 }
@@ -85,7 +136,7 @@ void scene::delete_block (const std::string& BlockName)
 	{
 		if (block->m_inputs.size())
 		{
-			disconnect (shrimp::io_t (BlockName, input->m_name));
+			disconnect (get_pad (block, *input));
 		}
 	}
 	for (shader_block::properties_t::const_iterator output = block->m_outputs.begin();
@@ -93,12 +144,17 @@ void scene::delete_block (const std::string& BlockName)
 	{
 		if (block->m_outputs.size())
 		{
-			disconnect (shrimp::io_t (BlockName, output->m_name));
+			disconnect (get_pad (block, *output));
 		}
 	}
 
 	// safely remove it from the network
-	m_blocks.erase (BlockName);
+	block->touch_network();
+	m_blocks[block->handle()] = 0;
+	--m_block_count;
+	m_block_handles.erase (block->name());
+	m_groups.erase (block->handle());
+	m_unique_name_numbers.clear();
 
 	// finally delete it
 	delete block;
@@ -107,9 +163,13 @@ void scene::delete_block (const std::string& BlockName)
 
 void scene::delete_group (const int Group)
 {
+	// deleted blocks only empty their slot, the list can be walked while deleting
 	for (scene:: shader_blocks_t::const_iterator block_i = m_blocks.begin(); block_i != m_blocks.end(); ++block_i)
 	{
-		const shader_block* blockSel = block_i->second;
+		const shader_block* blockSel = *block_i;
+		if (!blockSel)
+			continue;
+
 		int groupSel = get_block_group(blockSel);
 
 		if (groupSel==Group)
@@ -130,11 +190,11 @@ void scene::delete_group (const int Group)
 
 shader_block* scene::get_block (const std::string& Name)
 {
-	shader_blocks_t::const_iterator block = m_blocks.find (Name);
-	if (m_blocks.end() == block)
+	block_handles_t::const_iterator handle = m_block_handles.find (Name);
+	if (m_block_handles.end() == handle)
 		return 0;
 
-	return block->second;
+	return m_blocks[handle->second];
 }
 
 
@@ -142,8 +202,8 @@ shader_block* scene::get_root_block() {
 
 	for (shader_blocks_t::iterator block = m_blocks.begin(); block != m_blocks.end(); ++block) {
 
-		if (block->second->m_root_block)
-			return block->second;
+		if (*block && (*block)->m_root_block)
+			return *block;
 	}
 
 	log() << error << "couldn't find root block." << std::endl;
@@ -154,16 +214,18 @@ shader_block* scene::get_root_block() {
 
 std::string scene::get_unique_block_name (const std::string& Name) const {
 
-	if (m_blocks.find (Name) == m_blocks.end())
+	if (m_block_handles.find (Name) == m_block_handles.end())
 		// name is already unique
 		return Name;
 
-	// append a number to make it unique
-	for (int i = 2; ; i++) {
+	// append a number to make it unique (numbers below the last one given are taken,
+	// unless a name was freed since)
+	int& number = m_unique_name_numbers.insert (std::make_pair (Name, 2)).first->second;
+	for (; ; number++) {
 
-		const std::string new_name = Name + "_" + string_cast (i);
+		const std::string new_name = Name + "_" + string_cast (number);
 
-		if (m_blocks.find (new_name) == m_blocks.end())
+		if (m_block_handles.find (new_name) == m_block_handles.end())
 			return new_name;
 	}
 }
@@ -174,44 +236,10 @@ void scene::set_block_name (shader_block* Block, const std::string& NewName) {
 	const std::string old_name = Block->name();
 	const std::string new_name = get_unique_block_name (NewName);
 
-	// update DAG
-	shrimp::dag_t new_dag;
-	for (shrimp::dag_t::iterator d = m_dag.begin(); d != m_dag.end(); ++d) {
-
-		if (d->first.first == old_name) {
-
-			// block was the input
-			shrimp::io_t input (new_name, d->first.second);
-			shrimp::io_t output = d->second;
-			new_dag.insert (std::make_pair (input, output));
-
-		} else if (d->second.first == old_name) {
-
-			// block was the output
-			shrimp::io_t input (d->first);
-			shrimp::io_t output (new_name, d->second.second);
-			new_dag.insert (std::make_pair (input, output));
-
-		} else {
-
-			// another block
-			new_dag.insert (*d);
-		}
-	}
-
-	m_dag = new_dag;
-
-	// update the block list
-	m_blocks.erase (old_name);
-	m_blocks.insert (std::make_pair(new_name, Block));
-
-	// update group (if any)
-	shrimp::groups_t::iterator block_group = m_groups.find (old_name);
-	if (block_group != m_groups.end())
-	{
-		m_groups.insert (std::make_pair(new_name, block_group->second));
-		m_groups.erase (old_name);
-	}
+	// update the name list (connections and groups use the block's handle)
+	m_block_handles.erase (old_name);
+	m_unique_name_numbers.clear();
+	m_block_handles.insert (std::make_pair(new_name, Block->handle()));
 
 	// we can now safely rename the block
 	Block->set_name (new_name);
@@ -224,32 +252,72 @@ shrimp::shader_blocks_t scene::get_scene_blocks()
 
 	for (scene::shader_blocks_t::const_iterator block_i = m_blocks.begin(); block_i != m_blocks.end(); ++block_i)
 	{
-		blocks.insert (block_i->second);
+		if (*block_i)
+			blocks.insert (*block_i);
 	}
 
 	return blocks;
 }
 
 
+double scene::get_block_height (const shader_block* Block, const double MinimumHeight) const {
+
+	// rolled blocks are square, others grow with their properties
+	const double width = Block->m_width;
+	const unsigned long max_properties = std::max (Block->input_count(), static_cast<unsigned long> (Block->m_outputs.size()));
+	const double height = Block->is_rolled() ? width : (width * (1.0 / 3.7) * static_cast<double> (max_properties));
+
+	return std::max (height, MinimumHeight);
+}
+
+
+shader_block* scene::get_block_at (const double X, const double Y, const double MinimumBlockHeight) {
+
+	shader_block* found = 0;
+	for (shader_blocks_t::const_iterator block_i = m_blocks.begin(); block_i != m_blocks.end(); ++block_i) {
+
+		shader_block* block = *block_i;
+
+		// grouped blocks are drawn as their group
+		if (!block || get_block_group (block)) {
+			continue;
+		}
+
+		const double height = get_block_height (block, MinimumBlockHeight);
+		if (X >= block->m_position_x && X <= block->m_position_x + block->m_width && Y <= block->m_position_y && Y >= block->m_position_y - height) {
+			found = block;
+		}
+	}
+
+	return found;
+}
+
+
 
 void scene::connect (const shrimp::io_t& Input, const shrimp::io_t& Output) {
 
 	shader_block* input_block = get_block (Input.first);
 	shader_block* output_block = get_block (Output.first);
 
-	if ((input_block && output_block) ||(m_dag == m_dag_copy)) {
+	if (input_block && output_block) {
 
 		if ((input_block->is_input (Input.second) && output_block->is_output (Output.second))) {
 
+			const shrimp::pad_t input (input_block->handle(), shrimp::intern (Input.second));
+			const shrimp::pad_t output (output_block->handle(), shrimp::intern (Output.second));
+
 			if (input_block->is_input_multi_operator (Input.second)) {
 
 				// special case : multi-inputs
 
+				// the input block code changes with its connections
+				input_block->touch_network();
+
 				// check whether it's already connected
-				if (m_dag.find (Input) == m_dag.end()) {
+				if (m_dag.find (input) == m_dag.end()) {
 
 					// not connected, connect it
-					m_dag.insert (std::make_pair (Input, Output));
+					m_dag.insert (std::make_pair (input, output));
 				} else {
 
 					// make sure this output is not connected to one of the 'multi' inputs
@@ -258,21 +326,20 @@ void scene::connect (const shrimp::io_t& Input, const shrimp::io_t& Output) {
 					// add a 'child' input
 					const std::string new_input = input_block->add_multi_input (Input.second);
 					// connect to that new input
-					m_dag.insert (std::make_pair (shrimp::io_t (Input.first, new_input), Output));
+					m_dag.insert (std::make_pair (shrimp::pad_t (input_block->handle(), shrimp::intern (new_input)), output));
 				}
 
 				return;
 			} else {
 
 				// normal block connection
+				input_block->touch_network();
 
 				// remove existing connection if any
-				if (m_dag.find (Input) != m_dag.end()) {
-					m_dag.erase (Input);
-				}
+				m_dag.erase (input);
 
 				// connect the blocks
-				m_dag.insert (std::make_pair (Input, Output));
+				m_dag.insert (std::make_pair (input, output));
 
 				// change the parent's output type to the input's one (except with shader outputs)
 				if (!output_block->is_shader_output (Output.second)) {
@@ -300,43 +367,72 @@ void scene::connect (const shrimp::io_t& Input, const shrimp::io_t& Output) {
 
 void scene::disconnect (const shrimp::io_t& IO) {
 
-	// check whether IO is an input
-	shrimp::dag_t::const_iterator connection = m_dag.find (IO);
+	shrimp::pad_t pad;
+	if (find_pad (IO, pad)) {
+		disconnect (pad);
+	}
+}
+
+
+void scene::disconnect (const shrimp::pad_t& Pad) {
+
+	// check whether the pad is an input
+	shrimp::dag_t::const_iterator connection = m_dag.find (Pad);
 	if (connection != m_dag.end()) {
 
 		// remove the connection
-		m_dag.erase (IO);
+		m_dag.erase (Pad);
+
+		if (shader_block* block = get_block (Pad.block)) {
+			block->touch_network();
+		}
 
 		return;
 	}
 
-	// remove all connections containing IO as output
-	shrimp::dag_t new_dag;
-	for (shrimp::dag_t::const_iterator connection = m_dag.begin(); connection != m_dag.end(); ++connection) {
+	// the code of the blocks connected to the output changes
+	const shrimp::dag_t::pads_t children = m_dag.children (Pad);
+	for (shrimp::dag_t::pads_t::const_iterator child = children.begin(); child != children.end(); ++child) {
 
-		if (connection->second != IO) {
-
-			new_dag.insert (*connection);
+		if (shader_block* block = get_block (child->block)) {
+			block->touch_network();
 		}
 	}
 
-	if (new_dag.size() < m_dag.size()) {
-
-		// at least one connection was removed
-		m_dag = new_dag;
-	} else {
-		//log() << warning << "no connection contains " << IO.first << "::" << IO.second << " as input or output." << std::endl;
-	}
+	// remove all connections containing the pad as output
+	m_dag.erase_output (Pad);
 }
 
 
 bool scene::is_connected (const shrimp::io_t& Input) {
 
-	if (m_dag.find (Input) != m_dag.end()) {
-		return true;
+	shrimp::pad_t input;
+	return find_pad (Input, input) && m_dag.find (input) != m_dag.end();
+}
+
+
+bool scene::is_connected (const shader_block* Block, const property& Input) const {
+
+	return m_dag.find (get_pad (Block, Input)) != m_dag.end();
+}
+
+
+bool scene::find_pad (const shrimp::io_t& IO, shrimp::pad_t& Pad) const {
+
+	block_handles_t::const_iterator handle = m_block_handles.find (IO.first);
+	if (handle == m_block_handles.end()) {
+		return false;
 	}
 
-	return false;
+	Pad.block = handle->second;
+	return shrimp::find_name (IO.second, Pad.pad);
+}
+
+
+shrimp::io_t scene::get_io (const shrimp::pad_t& Pad) const {
+
+	const shader_block* block = get_block (Pad.block);
+	return shrimp::io_t (block ? block->name() : "", shrimp::name_string (Pad.pad));
 }
 
 
@@ -349,27 +445,46 @@ void scene::upward_blocks (shader_block* StartingBlock, shrimp::shader_blocks_t&
 
 	List.insert (StartingBlock);
 
-	for (shader_block::properties_t::const_iterator input = StartingBlock->m_inputs.begin();
-		input != StartingBlock->m_inputs.end(); ++input)
+	// blocks whose parents are still to be listed (an explicit stack, networks can be very deep)
+	std::vector<shader_block*> pending (1, StartingBlock);
+	while (!pending.empty())
 	{
-		// get input's parent
-		std::string output_name;
-		shader_block* new_block = get_parent (StartingBlock->name(), input->m_name, output_name);
+		shader_block* block = pending.back();
+		pending.pop_back();
 
-		// add the parent (except for shader outputs)
-		if (new_block && !new_block->is_shader_output (output_name)) {
+		for (shader_block::properties_t::const_iterator input = block->m_inputs.begin();
+			input != block->m_inputs.end(); ++input)
+		{
+			// get input's parent
+			std::string output_name;
+			shader_block* new_block = get_parent (block, *input, output_name);
 
-			// check whether it's already in the list
-			if (List.find (new_block) == List.end()) {
+			// add the parent (except for shader outputs), unless it's already in the list
+			if (new_block && !new_block->is_shader_output (output_name)) {
 
-				List.insert (new_block);
-				upward_blocks (new_block, List);
+				if (List.insert (new_block).second) {
+					pending.push_back (new_block);
+				}
 			}
 		}
 	}
 }
 
 
+void scene::take_changed_blocks (std::vector<shrimp::block_handle_t>& Blocks) {
+
+	Blocks.clear();
+	Blocks.swap (m_changes.changed_blocks);
+
+	for (std::vector<shrimp::block_handle_t>::const_iterator handle = Blocks.begin(); handle != Blocks.end(); ++handle) {
+
+		if (shader_block* block = get_block (*handle)) {
+			block->clear_journaled();
+		}
+	}
+}
+
+
 bool scene::is_rolled (const shader_block* Block) const {
 
 	return Block->is_rolled();
@@ -382,7 +497,7 @@ int scene::rolled_block_count() {
 
 	for (shader_blocks_t::iterator block = m_blocks.begin(); block != m_blocks.end(); ++block) {
 
-		if (block->second->is_rolled())
+		if (*block && (*block)->is_rolled())
 			++rolled_block_count;
 	}
 
@@ -394,7 +509,8 @@ void scene::unroll_all_blocks() {
 
 	for (shader_blocks_t::iterator block = m_blocks.begin(); block != m_blocks.end(); ++block) {
 
-		block->second->roll (false);
+		if (*block)
+			(*block)->roll (false);
 	}
 }
 
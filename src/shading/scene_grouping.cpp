@@ -27,7 +27,7 @@
 shrimp::group_set_t scene::group_list() {
 
 	shrimp::group_set_t groups;
-	for (shrimp::groups_t::const_iterator g = m_groups.begin(); g != m_groups.end(); ++g) {
+	for (block_groups_t::const_iterator g = m_groups.begin(); g != m_groups.end(); ++g) {
 		groups.insert(g->second);
 	}
 
@@ -37,14 +37,18 @@ shrimp::group_set_t scene::group_list() {
 
 void scene::add_to_group (const std::string& Block, const int Group) {
 
-	if (Block.size() && Group)
-		m_groups.insert (std::make_pair(Block, Group));
+	if (!Group)
+		return;
+
+	block_handles_t::const_iterator handle = m_block_handles.find (Block);
+	if (handle != m_block_handles.end())
+		m_groups.insert (std::make_pair(handle->second, Group));
 }
 
 
 int scene::get_block_group (const shader_block* Block) {
 
-	shrimp::groups_t::const_iterator g = m_groups.find(Block->name());
+	block_groups_t::const_iterator g = m_groups.find(Block->handle());
 	if(g == m_groups.end())
 		return 0;
 
@@ -54,8 +58,8 @@ int scene::get_block_group (const shader_block* Block) {
 
 void scene::ungroup (const int Group) {
 
-	shrimp::groups_t groups2;
-	for (shrimp::groups_t::iterator g = m_groups.begin(); g != m_groups.end(); ++g) {
+	block_groups_t groups2;
+	for (block_groups_t::iterator g = m_groups.begin(); g != m_groups.end(); ++g) {
 
 		if (g->second != Group) {
 
@@ -73,7 +77,7 @@ void scene::group_blocks (const shrimp::shader_blocks_t& Blocks)
 {
 	// find the next group number
 	int max = 0;
-	for (shrimp::groups_t::const_iterator g = m_groups.begin(); g != m_groups.end(); ++g)
+	for (block_groups_t::const_iterator g = m_groups.begin(); g != m_groups.end(); ++g)
 	{
 		if(g->second > max)
 			max = g->second;
@@ -83,7 +87,7 @@ void scene::group_blocks (const shrimp::shader_blocks_t& Blocks)
 	// store new group
 	for (shrimp::shader_blocks_t::const_iterator block_i = Blocks.begin(); block_i != Blocks.end(); ++block_i)
 	{
-		m_groups.insert(std::make_pair((*block_i)->name(), max));
+		m_groups.insert(std::make_pair((*block_i)->handle(), max));
 	}
 }
 
@@ -92,7 +96,7 @@ shrimp::shader_blocks_t scene::get_group_blocks (const int Group)
 {
 	shrimp::shader_blocks_t blocks;
 
-	for (shrimp::groups_t::const_iterator block_i = m_groups.begin(); block_i != m_groups.end(); ++block_i)
+	for (block_groups_t::const_iterator block_i = m_groups.begin(); block_i != m_groups.end(); ++block_i)
 	{
 		if (block_i->second == Group)
 		{
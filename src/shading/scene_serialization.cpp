@@ -24,8 +24,7 @@
 
 #include "../miscellaneous/logging.h"
 #include "../miscellaneous/misc_string_functions.h"
-
-#include <fltk/filename.h>
+#include "../miscellaneous/misc_system_functions.h"
 
 #include <fstream>
 
@@ -297,8 +296,7 @@ bool scene::save_as (const std::string& ShaderFile) {
 
 	// automatically add the .xml extension
 	m_file_name = ShaderFile;
-	const char* extension = fltk::filename_ext (m_file_name.c_str());
-	if (std::string (extension) != ".xml")
+	if (system_functions::file_extension (m_file_name) != ".xml")
 		m_file_name += ".xml";
 
 	// save the file
@@ -317,15 +315,18 @@ xml::element scene::xml_network() {
 
 	for (shader_blocks_t::const_iterator b = m_blocks.begin(); b != m_blocks.end(); ++b) {
 
-		xml::element xml_block ("block");
+		shader_block* block = *b;
+		if (!block) {
+			continue;
+		}
 
-		shader_block* block = b->second;
+		xml::element xml_block ("block");
 
 		// block attributes
 		xml_block.push_attribute ("id", block->name());
 		xml_block.push_attribute ("position_x", block->m_position_x);
 		xml_block.push_attribute ("position_y", block->m_position_y);
-		xml_block.push_attribute ("author", block->m_author);
+		xml_block.push_attribute ("author", block->m_author.str());
 		if (is_rolled (block)) {
 			xml_block.push_attribute ("rolled", std::string ("1"));
 		}
@@ -383,12 +384,12 @@ xml::element scene::xml_network() {
 			}
 
 			// store connection, if any
-			shrimp::dag_t::const_iterator connection = m_dag.find (shrimp::io_t (block->name(), input->m_name));
+			shrimp::dag_t::const_iterator connection = m_dag.find (get_pad (block, *input));
 			if (connection != m_dag.end()) {
 
 				xml::element xml_connection ("connection");
-				xml_connection.push_attribute ("parent", connection->second.first);
-				xml_connection.push_attribute ("output", connection->second.second);
+				xml_connection.push_attribute ("parent", get_block (connection->second.block)->name());
+				xml_connection.push_attribute ("output", shrimp::name_string (connection->second.pad));
 				xml_input.push_child (xml_connection);
 			}
 
@@ -443,12 +444,12 @@ xml::element scene::xml_network() {
 		xml::element xml_group ("group");
 		xml_group.push_attribute ("id", *g);
 		xml_group.push_attribute ("name", get_group_name(*g));
-		for (shrimp::groups_t::const_iterator i = m_groups.begin(); i != m_groups.end(); ++i) {
+		for (block_groups_t::const_iterator i = m_groups.begin(); i != m_groups.end(); ++i) {
 
 			if (i->second == *g) {
 
 				xml::element block ("block");
-				block.push_attribute ("name", i->first);
+				block.push_attribute ("name", get_block (i->first)->name());
 
 				xml_group.push_child (block);
 			}
@@ -22,9 +22,12 @@
 #include "shader_block.h"
 
 #include "../miscellaneous/logging.h"
+#include "../miscellaneous/misc_binary_stream.h"
 #include "../miscellaneous/misc_string_functions.h"
 #include "../miscellaneous/misc_xml.h"
 
+#include <atomic>
+#include <cstdlib>
 #include <iostream>
 #include <vector>
 
@@ -34,10 +37,15 @@ property::property (const std::string& Name, const std::string& Description) :
 	m_description (Description),
 	m_multi_operator (""),
 	m_multi_operator_parent_name (""),
+	m_shader_parameter (false),
 	m_shader_output (false),
+	m_current_type (FLOAT),
+	m_current_type_extension (UNKNOWN),
+	m_current_type_extension_size (0),
 	m_current_storage (VARYING),
 	m_type_parent (""),
-	m_value ("")
+	m_value (""),
+	m_pad_name (shrimp::intern (Name))
 {
 }
 
@@ -344,6 +352,85 @@ std::string property::value_as_sl_string() const {
 }
 
 
+bool property::value_as_rib_values (std::string& Values) const {
+
+	if (STRING == m_current_type) {
+
+		// a plain string constant is passed as is
+		if (m_value.size() < 2 || m_value[0] != '"' || m_value[m_value.size() - 1] != '"')
+			return false;
+		if (m_value.find_first_of ("\"\\", 1) != m_value.size() - 1)
+			return false;
+
+		Values = m_value;
+		return true;
+	}
+
+	unsigned int expected = 0;
+	switch (m_current_type) {
+
+		case FLOAT:
+			expected = 1;
+			break;
+
+		case COLOR:
+			expected = 3;
+			break;
+
+		default:
+			// the renderer transforms RIB point, vector, normal and matrix values from the space
+			// current at the shader call, unlike the shader's defaults: they stay in the shader
+			// (as do arrays)
+			return false;
+	}
+
+	// drop the type constructor, e.g. "color (1, 0, 0)"
+	std::string v = m_value;
+	const std::string type = convert_type (m_current_type);
+	const std::string::size_type start = v.find_first_not_of (" \t");
+	if (start != std::string::npos && v.compare (start, type.size(), type) == 0)
+		v.erase (0, start + type.size());
+
+	for (std::string::iterator c = v.begin(); c != v.end(); ++c) {
+		if ('(' == *c || ')' == *c || '{' == *c || '}' == *c || ',' == *c)
+			*c = ' ';
+	}
+
+	// every token has to be a number, anything else (variables, expressions,
+	// space names) needs the shader code
+	std::vector<double> numbers;
+	std::istringstream str (v);
+	std::string token;
+	while (str >> token) {
+
+		char* end = 0;
+		const double number = strtod (token.c_str(), &end);
+		if (end == token.c_str() || *end != '\0')
+			return false;
+
+		numbers.push_back (number);
+	}
+
+	if (1 == numbers.size() && 3 == expected) {
+		// a single number sets the three components
+		numbers.resize (3, numbers[0]);
+	}
+
+	if (numbers.size() != expected)
+		return false;
+
+	std::ostringstream buffer;
+	for (std::vector<double>::const_iterator n = numbers.begin(); n != numbers.end(); ++n) {
+		if (n != numbers.begin())
+			buffer << ' ';
+		buffer << *n;
+	}
+
+	Values = buffer.str();
+	return true;
+}
+
+
 property::variable_t property::convert_type (const std::string& Type) {
 
 	const std::string type_l = Type; // strtolower ?
@@ -438,6 +525,87 @@ std::string property::get_type_parent() const {
 }
 
 
+void property::write_binary (binary::writer& Writer) const {
+
+	Writer.write_string (m_name);
+	Writer.write_string (m_description);
+	Writer.write_string (m_multi_operator);
+	Writer.write_string (m_multi_operator_parent_name);
+	Writer.write_bool (m_shader_parameter);
+	Writer.write_bool (m_shader_output);
+
+	Writer.write_uint32 (m_current_type);
+	Writer.write_uint32 (m_possible_types.size());
+	for (std::set<variable_t>::const_iterator t = m_possible_types.begin(); t != m_possible_types.end(); ++t) {
+		Writer.write_uint32 (*t);
+	}
+
+	Writer.write_uint32 (m_current_type_extension);
+	Writer.write_uint32 (m_current_type_extension_size);
+
+	Writer.write_uint32 (m_current_storage);
+	Writer.write_uint32 (m_possible_storages.size());
+	for (std::set<storage_t>::const_iterator s = m_possible_storages.begin(); s != m_possible_storages.end(); ++s) {
+		Writer.write_uint32 (*s);
+	}
+
+	Writer.write_string (m_type_parent);
+	Writer.write_string (m_value);
+}
+
+
+bool property::read_binary (binary::reader& Reader) {
+
+	uint32_t value = 0;
+	uint32_t count = 0;
+
+	if (!Reader.read_string (m_name) || !Reader.read_string (m_description)
+		|| !Reader.read_string (m_multi_operator) || !Reader.read_string (m_multi_operator_parent_name)
+		|| !Reader.read_bool (m_shader_parameter) || !Reader.read_bool (m_shader_output)) {
+		return false;
+	}
+	m_pad_name = shrimp::intern (m_name);
+
+	if (!Reader.read_uint32 (value) || value > ARRAY)
+		return false;
+	m_current_type = variable_t (value);
+
+	if (!Reader.read_uint32 (count))
+		return false;
+	m_possible_types.clear();
+	for (uint32_t t = 0; t < count; ++t) {
+
+		if (!Reader.read_uint32 (value) || value > ARRAY)
+			return false;
+		m_possible_types.insert (variable_t (value));
+	}
+
+	if (!Reader.read_uint32 (value) || value > ARRAY)
+		return false;
+	m_current_type_extension = variable_t (value);
+
+	if (!Reader.read_uint32 (value))
+		return false;
+	m_current_type_extension_size = int (value);
+
+	if (!Reader.read_uint32 (value) || value > UNIFORM)
+		return false;
+	m_current_storage = storage_t (value);
+
+	if (!Reader.read_uint32 (count))
+		return false;
+	m_possible_storages.clear();
+	for (uint32_t s = 0; s < count; ++s) {
+
+		if (!Reader.read_uint32 (value) || value > UNIFORM)
+			return false;
+		m_possible_storages.insert (storage_t (value));
+	}
+
+	return Reader.read_string (m_type_parent) && Reader.read_string (m_value);
+}
+
+
 types_t get_property_types() {
 
 	types_t list;
@@ -479,23 +647,44 @@ types_t get_array_types() {
 }
 
 
+namespace
+{
+
+// block revisions, taken from a single counter so they can be compared between blocks
+std::atomic<unsigned long> revision_counter (0);
+
+unsigned long next_revision() {
+
+	return ++revision_counter;
+}
+
+}
+
+
 shader_block::shader_block (const std::string& Name, const std::string& Description, const bool RootBlock) :
 
 	m_name (Name),
+	m_handle (0),
 	m_description (Description),
 	m_author (""),
 	m_root_block (RootBlock),
+	m_revision (next_revision()),
+	m_journal (0),
+	m_journaled (false),
 	m_position_x (0),
 	m_position_y (0),
 	m_width (1.25),
 	m_height (1),
-	m_rolled (false) {
+	m_rolled (false),
+	m_code_fragment (std::make_shared<code_fragment>()) {
 
 }
 
 
 void shader_block::add_input (const std::string& Name, const std::string& Type, const std::string& TypeExtension, const std::string& Storage, const std::string& Description, const std::string& DefaultValue, const std::string& Multi, const bool ShaderParameter) {
 
+	touch_network();
+
 	bool ok = true;
 
 	property p (Name, Description);
@@ -541,6 +730,8 @@ std::string shader_block::add_multi_input (const std::string& ParentName) {
 
 void shader_block::add_output (const std::string& Name, const std::string& Type, const std::string& TypeExtension, const std::string& Storage, const std::string& Description, const bool ShaderOutput) {
 
+	touch_network();
+
 	bool ok = true;
 
 	property p (Name, Description);
@@ -565,28 +756,72 @@ void shader_block::add_output (const std::string& Name, const std::string& Type,
 
 void shader_block::set_includes (const std::string& File) {
 
-	if (!m_includes.empty()) {
+	std::string includes = m_includes;
+	if (!includes.empty()) {
 
 		// TODO : CR/LF depending on the system
-		m_includes += "\n";
+		includes += "\n";
 	}
 
-	m_includes += File;
+	includes += File;
+	m_includes = shared_string::intern (includes);
 }
 
 
 void shader_block::set_code (const std::string& Code) {
 
-	m_code = Code;
+	m_code = shared_string::intern (Code);
+	m_code_template = code_template::get (m_code);
+	touch();
 }
 
 
-std::string shader_block::get_code() const {
+const std::string& shader_block::get_code() const {
 
 	return m_code;
 }
 
 
+const code_template& shader_block::get_code_template() const {
+
+	// the code may have been assigned directly (when copying a block)
+	if (!m_code_template || !m_code_template->code().shares_text_with (m_code)) {
+		m_code_template = code_template::get (m_code);
+	}
+
+	return *m_code_template;
+}
+
+
+void shader_block::touch() {
+
+	m_revision = next_revision();
+
+	// list the block in its scene's journal
+	if (m_journal && !m_journaled) {
+
+		m_journaled = true;
+		m_journal->changed_blocks.push_back (m_handle);
+	}
+}
+
+
+void shader_block::touch_network() {
+
+	touch();
+
+	if (m_journal) {
+		m_journal->network_revision = m_revision;
+	}
+}
+
+
+unsigned long shader_block::current_revision() {
+
+	return revision_counter;
+}
+
+
 std::string shader_block::name() const {
 
 	return m_name;
@@ -604,24 +839,32 @@ std::string shader_block::sl_name() const {
 
 void shader_block::set_name (const std::string& Name) {
 
+	// names break ties in the order of the shader blocks
+	touch_network();
+
 	m_name = Name;
 }
 
 
+void shader_block::set_handle (const shrimp::block_handle_t Handle, change_journal* Journal) {
+
+	m_handle = Handle;
+	m_journal = Journal;
+	m_journaled = false;
+}
+
+
 void shader_block::set_usage (const std::string& Usage) {
 
-	m_usage = Usage;
+	m_usage = shared_string::intern (Usage);
 }
 
 
 std::string shader_block::input_type (const std::string& Name) const {
 
-	for (properties_t::const_iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
-
-		if (i->m_name == Name) {
+	if (const property* i = m_inputs.find (Name)) {
 
-			return i->get_type();
-		}
+		return i->get_type();
 	}
 
 	log() << warning << "unknown input : " << Name << std::endl;
@@ -631,12 +874,9 @@ std::string shader_block::input_type (const std::string& Name) const {
 
 std::string shader_block::input_storage (const std::string& Name) const {
 
-	for (properties_t::const_iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
-
-		if (i->m_name == Name) {
+	if (const property* i = m_inputs.find (Name)) {
 
-			return i->get_storage();
-		}
+		return i->get_storage();
 	}
 
 	log() << warning << "unknown input : " << Name << std::endl;
@@ -646,12 +886,9 @@ std::string shader_block::input_storage (const std::string& Name) const {
 
 std::string shader_block::output_type (const std::string& Name) const {
 
-	for (properties_t::const_iterator o = m_outputs.begin(); o != m_outputs.end(); ++o) {
-
-		if (o->m_name == Name) {
+	if (const property* o = m_outputs.find (Name)) {
 
-			return o->get_type();
-		}
+		return o->get_type();
 	}
 
 	log() << warning << "unknown output : " << Name << std::endl;
@@ -661,12 +898,9 @@ std::string shader_block::output_type (const std::string& Name) const {
 
 std::string shader_block::output_storage (const std::string& Name) const {
 
-	for (properties_t::const_iterator o = m_outputs.begin(); o != m_outputs.end(); ++o) {
-
-		if (o->m_name == Name) {
+	if (const property* o = m_outputs.find (Name)) {
 
-			return o->get_storage();
-		}
+		return o->get_storage();
 	}
 
 	log() << warning << "unknown output : " << Name << std::endl;
@@ -676,41 +910,24 @@ std::string shader_block::output_storage (const std::string& Name) const {
 
 bool shader_block::is_input (const std::string& Name) const {
 
-	for (properties_t::const_iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
-
-		if (i->m_name == Name) {
-
-			return true;
-		}
-	}
-
-	return false;
+	return m_inputs.find (Name) != 0;
 }
 
 
 bool shader_block::is_output (const std::string& Name) const {
 
-	for (properties_t::const_iterator o = m_outputs.begin(); o != m_outputs.end(); ++o) {
-
-		if (o->m_name == Name) {
-
-			return true;
-		}
-	}
-
-	return false;
+	return m_outputs.find (Name) != 0;
 }
 
 
 void shader_block::set_input_value (const std::string& Name, const std::string& Value) {
 
-	for (properties_t::iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
+	touch();
 
-		if (i->m_name == Name) {
+	if (property* i = m_inputs.find (Name)) {
 
-			i->set_value (Value);
-			return;
-		}
+		i->set_value (Value);
+		return;
 	}
 
 	log() << error << "unmatched shader block input '" << Name << "' in " << name() << std::endl;
@@ -719,12 +936,9 @@ void shader_block::set_input_value (const std::string& Name, const std::string&
 
 std::string shader_block::get_input_value (const std::string& Name) const {
 
-	for (properties_t::const_iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
-
-		if (i->m_name == Name) {
+	if (const property* i = m_inputs.find (Name)) {
 
-			return i->get_value();
-		}
+		return i->get_value();
 	}
 
 	log() << error << "unmatched shader block input '" << Name << "' in " << name() << std::endl;
@@ -735,12 +949,9 @@ std::string shader_block::get_input_value (const std::string& Name) const {
 
 std::string shader_block::get_input_value_as_sl_string (const std::string& Name) const {
 
-	for (properties_t::const_iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
-
-		if (i->m_name == Name) {
+	if (const property* i = m_inputs.find (Name)) {
 
-			return i->value_as_sl_string();
-		}
+		return i->value_as_sl_string();
 	}
 
 	log() << error << "Unmatched shader block input '" << Name << "' in " << name() << std::endl;
@@ -751,12 +962,11 @@ std::string shader_block::get_input_value_as_sl_string (const std::string& Name)
 
 bool shader_block::set_input_type (const std::string& Name, const std::string& Type) {
 
-	for (properties_t::iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
+	touch();
 
-		if (i->m_name == Name) {
+	if (property* i = m_inputs.find (Name)) {
 
-			return i->set_type (Type);
-		}
+		return i->set_type (Type);
 	}
 
 	log() << error << "unmatched shader block input '" << Name << "' in " << name() << std::endl;
@@ -766,12 +976,9 @@ bool shader_block::set_input_type (const std::string& Name, const std::string& T
 
 std::string shader_block::get_input_type (const std::string& Name) const {
 
-	for (properties_t::const_iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
-
-		if (i->m_name == Name) {
+	if (const property* i = m_inputs.find (Name)) {
 
-			return i->get_type();
-		}
+		return i->get_type();
 	}
 
 	log() << error << "unmatched shader block input '" << Name << "' in " << name() << std::endl;
@@ -782,12 +989,11 @@ std::string shader_block::get_input_type (const std::string& Name) const {
 
 bool shader_block::set_input_type_extension (const std::string& Name, const std::string& TypeExtension) {
 
-	for (properties_t::iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
+	touch();
 
-		if (i->m_name == Name) {
+	if (property* i = m_inputs.find (Name)) {
 
-			return i->set_type_extension (TypeExtension);
-		}
+		return i->set_type_extension (TypeExtension);
 	}
 
 	log() << error << "unmatched shader block input '" << Name << "' in " << name() << std::endl;
@@ -797,12 +1003,9 @@ bool shader_block::set_input_type_extension (const std::string& Name, const std:
 
 std::string shader_block::get_input_type_extension (const std::string& Name) const {
 
-	for (properties_t::const_iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
-
-		if (i->m_name == Name) {
+	if (const property* i = m_inputs.find (Name)) {
 
-			return i->get_type_extension();
-		}
+		return i->get_type_extension();
 	}
 
 	log() << error << "unmatched shader block input '" << Name << "' in " << name() << std::endl;
@@ -813,12 +1016,9 @@ std::string shader_block::get_input_type_extension (const std::string& Name) con
 
 int shader_block::get_input_type_extension_size (const std::string& Name) const {
 
-	for (properties_t::const_iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
-
-		if (i->m_name == Name) {
+	if (const property* i = m_inputs.find (Name)) {
 
-			return i->get_type_extension_size();
-		}
+		return i->get_type_extension_size();
 	}
 
 	log() << error << "unmatched shader block input '" << Name << "' in " << name() << std::endl;
@@ -829,12 +1029,11 @@ int shader_block::get_input_type_extension_size (const std::string& Name) const
 
 bool shader_block::set_input_storage (const std::string& Name, const std::string& Storage) {
 
-	for (properties_t::iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
+	touch();
 
-		if (i->m_name == Name) {
+	if (property* i = m_inputs.find (Name)) {
 
-			return i->set_storage (Storage);
-		}
+		return i->set_storage (Storage);
 	}
 
 	log() << error << "unmatched shader block input '" << Name << "' in " << name() << std::endl;
@@ -844,12 +1043,9 @@ bool shader_block::set_input_storage (const std::string& Name, const std::string
 
 std::string shader_block::get_input_storage (const std::string& Name) const {
 
-	for (properties_t::const_iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
-
-		if (i->m_name == Name) {
+	if (const property* i = m_inputs.find (Name)) {
 
-			return i->get_storage();
-		}
+		return i->get_storage();
 	}
 
 	log() << error << "unmatched shader block input '" << Name << "' in " << name() << std::endl;
@@ -860,13 +1056,12 @@ std::string shader_block::get_input_storage (const std::string& Name) const {
 
 void shader_block::set_input_parent (const std::string& Name, const std::string& Parent) {
 
-	for (properties_t::iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
+	touch_network();
 
-		if (i->m_name == Name) {
+	if (property* i = m_inputs.find (Name)) {
 
-			i->m_multi_operator_parent_name = Parent;
-			return;
-		}
+		i->m_multi_operator_parent_name = Parent;
+		return;
 	}
 
 	log() << error << "unmatched shader block input '" << Name << "' in " << name() << std::endl;
@@ -875,12 +1070,9 @@ void shader_block::set_input_parent (const std::string& Name, const std::string&
 
 std::string shader_block::get_input_parent (const std::string& Name) const {
 
-	for (properties_t::const_iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
-
-		if (i->m_name == Name) {
+	if (const property* i = m_inputs.find (Name)) {
 
-			return i->m_multi_operator_parent_name;
-		}
+		return i->m_multi_operator_parent_name;
 	}
 
 	log() << error << "shader block input '" << Name << "' in " << name() << " has no parent." << std::endl;
@@ -890,13 +1082,12 @@ std::string shader_block::get_input_parent (const std::string& Name) const {
 
 void shader_block::set_input_type_parent (const std::string& Name, const std::string& Parent) {
 
-	for (properties_t::iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
+	touch();
 
-		if (i->m_name == Name) {
+	if (property* i = m_inputs.find (Name)) {
 
-			i->set_type_parent (Parent);
-			return;
-		}
+		i->set_type_parent (Parent);
+		return;
 	}
 
 	log() << error << "unmatched shader block input '" << Name << "' in " << name() << std::endl;
@@ -905,38 +1096,37 @@ void shader_block::set_input_type_parent (const std::string& Name, const std::st
 
 bool shader_block::set_output_type (const std::string& Name, const std::string& Type) {
 
+	touch();
+
 	bool answer = true;
 
 	// look for the output and set its type
-	for (properties_t::iterator i = m_outputs.begin(); i != m_outputs.end(); ++i) {
-
-		if (i->m_name == Name) {
+	if (property* i = m_outputs.find (Name)) {
 
-			// change the type children (if any)
-			for (properties_t::iterator j = m_inputs.begin(); j != m_inputs.end(); ++j) {
+		// change the type children (if any)
+		for (properties_t::iterator j = m_inputs.begin(); j != m_inputs.end(); ++j) {
 
-				const std::string parent = j->get_type_parent();
-				if (!parent.empty() && (parent == Name)) {
+			const std::string parent = j->get_type_parent();
+			if (!parent.empty() && (parent == Name)) {
 
-					answer &= j->set_type (Type);
+				answer &= j->set_type (Type);
 
-					// if it's a multi-input, change the children's type
-					if (j->is_multi_operator()) {
+				// if it's a multi-input, change the children's type
+				if (j->is_multi_operator()) {
 
-						// get list of child inputs
-						std::vector<std::string> children;
-						get_multi_input_child_list (j->m_name, children);
+					// get list of child inputs
+					std::vector<std::string> children;
+					get_multi_input_child_list (j->m_name, children);
 
-						for (std::vector<std::string>::const_iterator c = children.begin(); c != children.end(); ++c) {
+					for (std::vector<std::string>::const_iterator c = children.begin(); c != children.end(); ++c) {
 
-							set_input_type (*c, Type);
-						}
+						set_input_type (*c, Type);
 					}
 				}
 			}
-
-			return answer && i->set_type (Type);
 		}
+
+		return answer && i->set_type (Type);
 	}
 
 	log() << error << "unmatched shader block output '" << Name << "' in " << name() << std::endl;
@@ -946,12 +1136,9 @@ bool shader_block::set_output_type (const std::string& Name, const std::string&
 
 std::string shader_block::get_output_type (const std::string& Name) const {
 
-	for (properties_t::const_iterator i = m_outputs.begin(); i != m_outputs.end(); ++i) {
-
-		if (i->m_name == Name) {
+	if (const property* i = m_outputs.find (Name)) {
 
-			return i->get_type();
-		}
+		return i->get_type();
 	}
 
 	log() << error << "unmatched shader block output '" << Name << "' in " << name() << std::endl;
@@ -962,12 +1149,11 @@ std::string shader_block::get_output_type (const std::string& Name) const {
 
 bool shader_block::set_output_type_extension (const std::string& Name, const std::string& TypeExtension) {
 
-	for (properties_t::iterator o = m_outputs.begin(); o != m_outputs.end(); ++o) {
+	touch();
 
-		if (o->m_name == Name) {
+	if (property* o = m_outputs.find (Name)) {
 
-			return o->set_type_extension (TypeExtension);
-		}
+		return o->set_type_extension (TypeExtension);
 	}
 
 	log() << error << "unmatched shader block output '" << Name << "' in " << name() << std::endl;
@@ -977,12 +1163,9 @@ bool shader_block::set_output_type_extension (const std::string& Name, const std
 
 std::string shader_block::get_output_type_extension (const std::string& Name) const {
 
-	for (properties_t::const_iterator o = m_outputs.begin(); o != m_outputs.end(); ++o) {
-
-		if (o->m_name == Name) {
+	if (const property* o = m_outputs.find (Name)) {
 
-			return o->get_type_extension();
-		}
+		return o->get_type_extension();
 	}
 
 	log() << error << "unmatched shader block output '" << Name << "' in " << name() << std::endl;
@@ -993,12 +1176,9 @@ std::string shader_block::get_output_type_extension (const std::string& Name) co
 
 int shader_block::get_output_type_extension_size (const std::string& Name) const {
 
-	for (properties_t::const_iterator o = m_outputs.begin(); o != m_outputs.end(); ++o) {
-
-		if (o->m_name == Name) {
+	if (const property* o = m_outputs.find (Name)) {
 
-			return o->get_type_extension_size();
-		}
+		return o->get_type_extension_size();
 	}
 
 	log() << error << "unmatched shader block output '" << Name << "' in " << name() << std::endl;
@@ -1009,13 +1189,12 @@ int shader_block::get_output_type_extension_size (const std::string& Name) const
 
 bool shader_block::set_output_storage (const std::string& Name, const std::string& Storage) {
 
-	// look for the output and set its storage
-	for (properties_t::iterator i = m_outputs.begin(); i != m_outputs.end(); ++i) {
+	touch();
 
-		if (i->m_name == Name) {
+	// look for the output and set its storage
+	if (property* i = m_outputs.find (Name)) {
 
-			return i->set_storage (Storage);
-		}
+		return i->set_storage (Storage);
 	}
 
 	log() << error << "unmatched shader block output '" << Name << "' in " << name() << std::endl;
@@ -1025,12 +1204,9 @@ bool shader_block::set_output_storage (const std::string& Name, const std::strin
 
 std::string shader_block::get_output_storage (const std::string& Name) const {
 
-	for (properties_t::const_iterator i = m_outputs.begin(); i != m_outputs.end(); ++i) {
+	if (const property* i = m_outputs.find (Name)) {
 
-		if (i->m_name == Name) {
-
-			return i->get_storage();
-		}
+		return i->get_storage();
 	}
 
 	log() << error << "unmatched shader block output '" << Name << "' in " << name() << std::endl;
@@ -1039,12 +1215,9 @@ std::string shader_block::get_output_storage (const std::string& Name) const {
 }
 bool shader_block::is_shader_output (const std::string& Name) const {
 
-	for (properties_t::const_iterator i = m_outputs.begin(); i != m_outputs.end(); ++i) {
-
-		if (i->m_name == Name) {
+	if (const property* i = m_outputs.find (Name)) {
 
-			return i->m_shader_output;
-		}
+		return i->m_shader_output;
 	}
 
 	log() << error << "unmatched shader block output '" << Name << "' in " << name() << std::endl;
@@ -1055,13 +1228,12 @@ bool shader_block::is_shader_output (const std::string& Name) const {
 
 void shader_block::set_shader_output (const std::string& Name, const bool State) {
 
-	for (properties_t::iterator i = m_outputs.begin(); i != m_outputs.end(); ++i) {
+	touch_network();
 
-		if (i->m_name == Name) {
+	if (property* i = m_outputs.find (Name)) {
 
-			i->m_shader_output = State;
-			return;
-		}
+		i->m_shader_output = State;
+		return;
 	}
 
 	log() << error << "unmatched shader block output '" << Name << "' in " << name() << std::endl;
@@ -1070,12 +1242,9 @@ void shader_block::set_shader_output (const std::string& Name, const bool State)
 
 bool shader_block::is_shader_parameter (const std::string& Name) const {
 
-	for (properties_t::const_iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
-
-		if (i->m_name == Name) {
+	if (const property* i = m_inputs.find (Name)) {
 
-			return i->m_shader_parameter;
-		}
+		return i->m_shader_parameter;
 	}
 
 	log() << error << "unmatched shader block input '" << Name << "' in " << name() << std::endl;
@@ -1086,13 +1255,12 @@ bool shader_block::is_shader_parameter (const std::string& Name) const {
 
 void shader_block::set_shader_parameter (const std::string& Name, const bool State) {
 
-	for (properties_t::iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
+	touch();
 
-		if (i->m_name == Name) {
+	if (property* i = m_inputs.find (Name)) {
 
-			i->m_shader_parameter = State;
-			return;
-		}
+		i->m_shader_parameter = State;
+		return;
 	}
 
 	log() << error << "unmatched shader block input '" << Name << "' in " << name() << std::endl;
@@ -1101,12 +1269,9 @@ void shader_block::set_shader_parameter (const std::string& Name, const bool Sta
 
 bool shader_block::is_input_multi_operator (const std::string& Name) const {
 
-	for (properties_t::const_iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
-
-		if (i->m_name == Name) {
+	if (const property* i = m_inputs.find (Name)) {
 
-			return i->is_multi_operator();
-		}
+		return i->is_multi_operator();
 	}
 
 	log() << error << "unmatched shader block input '" << Name << "' in " << name() << std::endl;
@@ -1117,13 +1282,12 @@ bool shader_block::is_input_multi_operator (const std::string& Name) const {
 
 bool shader_block::set_input_multi_operator_parent (const std::string& Name, const std::string& Parent) {
 
-	for (properties_t::iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
+	touch_network();
 
-		if (i->m_name == Name) {
+	if (property* i = m_inputs.find (Name)) {
 
-			i->m_multi_operator_parent_name = Parent;
-			return true;
-		}
+		i->m_multi_operator_parent_name = Parent;
+		return true;
 	}
 
 	log() << error << "unmatched shader block input '" << Name << "' in " << name() << std::endl;
@@ -1160,10 +1324,12 @@ std::string shader_block::get_unique_input_name (const std::string& Name) const
 		// name is already unique
 		return Name;
 
-	// append a number to make it unique
-	for (int i = 2; ; i++) {
+	// append a number to make it unique (numbers below the last one given are taken,
+	// unless inputs were removed since)
+	int& number = m_unique_input_numbers.insert (std::make_pair (Name, 2)).first->second;
+	for (; ; number++) {
 
-		const std::string new_name = Name + "_" + string_cast (i);
+		const std::string new_name = Name + "_" + string_cast (number);
 
 		if (!is_input (new_name))
 			return new_name;
@@ -1261,7 +1427,10 @@ void shader_block::dump_structure() const {
 bool shader_block::load_from_xml (TiXmlNode& XML) {
 
 	// keep end-of-lines when loading code
-	XML.SetCondenseWhiteSpace (false);
+	// (the library loader sets it before parsing in parallel, don't write it again)
+	if (TiXmlBase::IsWhiteSpaceCondensed()) {
+		XML.SetCondenseWhiteSpace (false);
+	}
 
 	// get block information
 	for (TiXmlAttribute* a = XML.ToElement()->FirstAttribute(); a; a = a->Next()) {
@@ -1277,11 +1446,11 @@ bool shader_block::load_from_xml (TiXmlNode& XML) {
 		}
 		else if (name == "description") {
 
-			m_description = a->Value();
+			m_description = shared_string::intern (a->Value());
 		}
 		else if (name == "author") {
 
-			m_author = a->Value();
+			m_author = shared_string::intern (a->Value());
 		}
 		else if (name == "rolled") {
 
@@ -1450,6 +1619,80 @@ bool shader_block::load_from_xml (TiXmlNode& XML) {
 }
 
 
+void shader_block::write_binary (binary::writer& Writer) const {
+
+	Writer.write_string (m_name);
+	Writer.write_string (m_description);
+	Writer.write_string (m_author);
+	Writer.write_string (m_usage);
+	Writer.write_double (m_rolled);
+
+	Writer.write_uint32 (m_inputs.size());
+	for (properties_t::const_iterator i = m_inputs.begin(); i != m_inputs.end(); ++i) {
+		i->write_binary (Writer);
+	}
+
+	Writer.write_uint32 (m_outputs.size());
+	for (properties_t::const_iterator o = m_outputs.begin(); o != m_outputs.end(); ++o) {
+		o->write_binary (Writer);
+	}
+
+	Writer.write_string (m_includes);
+	Writer.write_string (m_code);
+}
+
+
+bool shader_block::read_binary (binary::reader& Reader) {
+
+	std::string description;
+	std::string author;
+	std::string usage;
+	if (!Reader.read_string (m_name) || !Reader.read_string (description)
+		|| !Reader.read_string (author) || !Reader.read_string (usage)
+		|| !Reader.read_double (m_rolled)) {
+		return false;
+	}
+
+	m_description = shared_string::intern (description);
+	m_author = shared_string::intern (author);
+	m_usage = shared_string::intern (usage);
+
+	uint32_t count = 0;
+	if (!Reader.read_uint32 (count))
+		return false;
+	m_inputs.clear();
+	m_unique_input_numbers.clear();
+	for (uint32_t i = 0; i < count; ++i) {
+
+		property p ("");
+		if (!p.read_binary (Reader))
+			return false;
+		m_inputs.push_back (p);
+	}
+
+	if (!Reader.read_uint32 (count))
+		return false;
+	m_outputs.clear();
+	for (uint32_t o = 0; o < count; ++o) {
+
+		property p ("");
+		if (!p.read_binary (Reader))
+			return false;
+		m_outputs.push_back (p);
+	}
+
+	std::string includes;
+	std::string code;
+	if (!Reader.read_string (includes) || !Reader.read_string (code))
+		return false;
+
+	m_includes = shared_string::intern (includes);
+	m_code = shared_string::intern (code);
+	m_code_template = code_template::get (m_code);
+	return true;
+}
+
+
 shader_block* shader_block_builder::build_block (const std::string& FilePath) {
 
 	// open block file
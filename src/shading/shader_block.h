@@ -22,12 +22,25 @@
 #ifndef _shader_block_h_
 #define _shader_block_h_
 
+#include "code_template.h"
+#include "shrimp_handles.h"
+
+#include "../miscellaneous/misc_shared_string.h"
 #include "../miscellaneous/misc_xml.h"
 
+#include <map>
+#include <memory>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+namespace binary
+{
+	class reader;
+	class writer;
+}
+
 
 // a block property : input or output
 class property
@@ -79,10 +92,20 @@ public:
 	void set_value (const std::string& Value);
 	std::string get_value() const;
 	std::string value_as_sl_string() const;
+	// the value as RIB parameter values, false when it isn't a float, color or string constant
+	bool value_as_rib_values (std::string& Values) const;
 
 	void set_type_parent (const std::string& Parent);
 	std::string get_type_parent() const;
 
+	// the name as an interned pad name (connections are looked up with it)
+	shrimp::name_t pad_name() const { return m_pad_name; }
+
+	// binary representation, for the block library cache (its cache_version
+	// must be incremented when the layout changes)
+	void write_binary (binary::writer& Writer) const;
+	bool read_binary (binary::reader& Reader);
+
 private:
 	// variable type
 	variable_t m_current_type;
@@ -108,6 +131,58 @@ private:
 
 	// value
 	std::string m_value;
+
+	shrimp::name_t m_pad_name;
+};
+
+
+// block properties, in declaration order and indexed by name
+// (property names mustn't be changed once in the table)
+class property_table
+{
+public:
+	typedef std::vector<property> properties_t;
+	typedef properties_t::value_type value_type;
+	typedef properties_t::iterator iterator;
+	typedef properties_t::const_iterator const_iterator;
+
+	iterator begin() { return m_properties.begin(); }
+	iterator end() { return m_properties.end(); }
+	const_iterator begin() const { return m_properties.begin(); }
+	const_iterator end() const { return m_properties.end(); }
+
+	size_t size() const { return m_properties.size(); }
+	bool empty() const { return m_properties.empty(); }
+
+	void push_back (const property& Property) {
+
+		// when names are duplicated, the first property is the one found
+		m_index.insert (std::make_pair (Property.m_name, m_properties.size()));
+		m_properties.push_back (Property);
+	}
+
+	void clear() {
+
+		m_properties.clear();
+		m_index.clear();
+	}
+
+	// return the property with the given name, 0 if there's none
+	property* find (const std::string& Name) {
+
+		std::unordered_map<std::string, size_t>::const_iterator i = m_index.find (Name);
+		return i == m_index.end() ? 0 : &m_properties[i->second];
+	}
+
+	const property* find (const std::string& Name) const {
+
+		std::unordered_map<std::string, size_t>::const_iterator i = m_index.find (Name);
+		return i == m_index.end() ? 0 : &m_properties[i->second];
+	}
+
+private:
+	properties_t m_properties;
+	std::unordered_map<std::string, size_t> m_index;
 };
 
 
@@ -138,22 +213,62 @@ public:
 private:
 	// name and description
 	std::string m_name;
+	// handle in the scene
+	shrimp::block_handle_t m_handle;
 
 public:
-	std::string m_description;
-	std::string m_author;
+	// text shared by the instances of a library block (see shared_string)
+	shared_string m_description;
+	shared_string m_author;
 	const bool m_root_block;
 
-	std::string m_usage;
+	shared_string m_usage;
+
+	// block revision, renewed by anything that changes the block's code
+	// (revisions come from a single counter, the latest is the most recent)
+	unsigned long revision() const { return m_revision; }
+	void touch();
+	// renew the revision when the block's place in the network changes: its connections,
+	// name, properties, or which of its outputs are shader outputs (the scene's network
+	// revision is renewed with it)
+	void touch_network();
+	static unsigned long current_revision();
+
+	// changes of a scene's blocks, noted by the blocks as they're touched
+	struct change_journal
+	{
+		change_journal() : network_revision (0) {}
+
+		// revision of the latest network change (see touch_network())
+		unsigned long network_revision;
+		// handles of the blocks touched since the list was taken, each listed once
+		std::vector<shrimp::block_handle_t> changed_blocks;
+	};
+
+private:
+	unsigned long m_revision;
+	// journal of the block's scene (0 out of a scene), and whether the block is listed in it
+	change_journal* m_journal;
+	bool m_journaled;
+
+	// first number to try when making an input name unique, by name (cleared when inputs are removed)
+	mutable std::map<std::string, int> m_unique_input_numbers;
+
+public:
 
 	std::string name() const;
 	// return the block's name as a valid SL name
 	std::string sl_name() const;
 	void set_name (const std::string& Name);
+	// the block's handle in its scene, 0 when it isn't in a scene (set by the scene, with its journal)
+	shrimp::block_handle_t handle() const { return m_handle; }
+	void set_handle (const shrimp::block_handle_t Handle, change_journal* Journal);
+	// forget that the block is listed in the journal (once the scene's list was taken)
+	void clear_journaled() { m_journaled = false; }
 	void set_usage (const std::string& Usage);
 
 	// input and output properties
-	typedef std::vector<property> properties_t;
+	typedef property_table properties_t;
 	properties_t m_inputs;
 	properties_t m_outputs;
 
@@ -225,16 +340,52 @@ public:
 	void roll (const bool Roll);
 	bool is_rolled() const;
 
-	// shader code
-	std::string m_includes;
-	std::string m_code;
-	bool m_code_written;
+	// shader code, shared until an instance's code is edited
+	shared_string m_includes;
+	shared_string m_code;
+
+	// block code as output in shaders, kept until the block or one of its parents changes
+	// (a fragment isn't modified once built: shaders can be written from it on other threads
+	// while a newer one replaces it)
+	struct code_fragment
+	{
+		code_fragment() : revision (0), untyped_locals (false) {}
+
+		// latest block revision when the fragment was built (0 if never built)
+		unsigned long revision;
+		std::string code;
+		// local variables required by the code, their types resolved (except the types of
+		// other blocks' properties, when there are such locals)
+		std::set<std::string> locals;
+		bool untyped_locals;
+
+		// the block's declarations in the shader: includes, parameters (inputs that aren't
+		// connected, their constant values are also passed through RIB), the local variables
+		// of its outputs and its shader outputs
+		struct parameter
+		{
+			std::string declaration;
+			std::string value;
+			bool rib_value;
+			std::string rib_values;
+		};
+		std::set<std::string> includes;
+		std::vector<parameter> parameters;
+		std::vector<std::string> output_locals;
+		std::string shader_outputs;
+		// the parameters and shader outputs as K-3D slmeta arguments
+		std::string k3d_parameters;
+		std::string k3d_outputs;
+	};
+	std::shared_ptr<const code_fragment> m_code_fragment;
+
+	// code prepared for generation, remade when the code changes
+	mutable std::shared_ptr<const code_template> m_code_template;
 
 	void set_includes (const std::string& File);
 	void set_code (const std::string& Code);
-	void reset_code_written() { m_code_written = false; }
-	std::string get_code() const;
-	bool code_written() const { return m_code_written; }
+	const std::string& get_code() const;
+	const code_template& get_code_template() const;
 
 	// return shader parameters and local values
 	void get_includes (std::set<std::string>& includes);
@@ -244,6 +395,12 @@ public:
 
 	// load information from an XML block pointer
 	bool load_from_xml (TiXmlNode& XML);
+
+	// binary representation of a library block, for the block library cache
+	// (the scene-related state: position, size, code written flag, isn't saved;
+	// the cache_version must be incremented when the layout changes)
+	void write_binary (binary::writer& Writer) const;
+	bool read_binary (binary::reader& Reader);
 };
 
 
@@ -0,0 +1,277 @@
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "shader_cache.h"
+
+#include "../miscellaneous/logging.h"
+#include "../miscellaneous/misc_content_hash.h"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#include <sys/stat.h>
+#if defined _WIN32
+# include <process.h>
+# define getpid _getpid
+#else
+# include <unistd.h>
+#endif
+
+
+namespace
+{
+
+// temporary file next to a cache entry, unique among the threads and processes storing entries
+std::string temporary_file_of (const std::string& File)
+{
+	static std::atomic<unsigned long> count (0);
+
+	std::ostringstream file;
+	file << File << '.' << getpid() << '.' << ++count << ".tmp";
+	return file.str();
+}
+
+
+bool read_file (const std::string& File, std::string& Content)
+{
+	std::ifstream file (File.c_str(), std::ios::in | std::ios::binary);
+	if (!file.good()) {
+		return false;
+	}
+
+	Content.assign (std::istreambuf_iterator<char> (file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+
+bool copy_file (const std::string& From, const std::string& To)
+{
+	std::ifstream from (From.c_str(), std::ios::in | std::ios::binary);
+	if (!from.good()) {
+		return false;
+	}
+
+	std::ofstream to (To.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!to.good()) {
+		return false;
+	}
+
+	to << from.rdbuf();
+	to.close();
+
+	return !to.fail();
+}
+
+
+std::string directory_of (const std::string& File)
+{
+	const std::string::size_type slash = File.rfind ('/');
+	return slash == std::string::npos ? "." : File.substr (0, slash);
+}
+
+
+// list the files included by a shader ('#include "file"' or '#include <file>')
+void get_included_files (const std::string& Source, std::vector<std::string>& Files)
+{
+	std::string::size_type line_start = 0;
+	while (line_start < Source.size()) {
+
+		std::string::size_type line_end = Source.find ('\n', line_start);
+		if (line_end == std::string::npos) {
+			line_end = Source.size();
+		}
+
+		std::string::size_type p = Source.find_first_not_of (" \t", line_start);
+		if (p < line_end && Source[p] == '#') {
+
+			p = Source.find_first_not_of (" \t", p + 1);
+			if (p < line_end && Source.compare (p, 7, "include") == 0) {
+
+				p = Source.find_first_not_of (" \t", p + 7);
+				if (p < line_end && (Source[p] == '"' || Source[p] == '<')) {
+
+					const char closing = Source[p] == '"' ? '"' : '>';
+					const std::string::size_type name_end = Source.find (closing, p + 1);
+					if (name_end < line_end) {
+						Files.push_back (Source.substr (p + 1, name_end - p - 1));
+					}
+				}
+			}
+		}
+
+		line_start = line_end + 1;
+	}
+}
+
+}
+
+
+shader_cache::shader_cache (const std::string& Directory) :
+	m_directory (Directory),
+	m_hits (0),
+	m_misses (0)
+{
+#if defined _WIN32
+	mkdir (m_directory.c_str());
+#else
+	mkdir (m_directory.c_str(), 0777);
+#endif
+}
+
+
+std::string shader_cache::compilation_key (const std::string& ShaderFile, const std::string& IncludePath, const std::string& RendererCode, const std::string& CompilerCommand, const std::string& Identity)
+{
+	content_hash hash;
+	hash.add (RendererCode);
+	hash.add (CompilerCommand);
+
+	std::string source;
+	if (!read_file (ShaderFile, source)) {
+		return "";
+	}
+
+	// the shader's name, as the compiled shader is named after it
+	const std::string::size_type slash = ShaderFile.rfind ('/');
+	hash.add (slash == std::string::npos ? ShaderFile : ShaderFile.substr (slash + 1));
+	hash.add (Identity.empty() ? source : Identity);
+
+	// add the included files, once each
+	std::set<std::string> visited;
+	std::vector<std::pair<std::string, std::string> > pending;
+	std::vector<std::string> included;
+	get_included_files (source, included);
+	for (std::vector<std::string>::const_iterator i = included.begin(); i != included.end(); ++i) {
+		pending.push_back (std::make_pair (directory_of (ShaderFile), *i));
+	}
+
+	while (!pending.empty()) {
+
+		const std::string directory = pending.back().first;
+		const std::string name = pending.back().second;
+		pending.pop_back();
+
+		hash.add (name);
+
+		std::string file = directory + '/' + name;
+		std::string content;
+		if (!read_file (file, content)) {
+
+			file = IncludePath + '/' + name;
+			if (!read_file (file, content)) {
+				// a renderer header, covered by the renderer code
+				continue;
+			}
+		}
+
+		if (!visited.insert (file).second) {
+			continue;
+		}
+
+		hash.add (content);
+
+		included.clear();
+		get_included_files (content, included);
+		for (std::vector<std::string>::const_iterator i = included.begin(); i != included.end(); ++i) {
+			pending.push_back (std::make_pair (directory_of (file), *i));
+		}
+	}
+
+	return hash.hex();
+}
+
+
+std::string shader_cache::cache_file (const std::string& Key, const std::string& CompiledShader) const
+{
+	// keep the compiled shader's extension
+	const std::string::size_type dot = CompiledShader.rfind ('.');
+	const std::string::size_type slash = CompiledShader.rfind ('/');
+	const std::string extension = (dot == std::string::npos || (slash != std::string::npos && dot < slash)) ? "" : CompiledShader.substr (dot);
+
+	return m_directory + '/' + Key + extension;
+}
+
+
+bool shader_cache::fetch (const std::string& Key, const std::string& CompiledShader)
+{
+	if (!Key.empty() && copy_file (cache_file (Key, CompiledShader), CompiledShader)) {
+
+		log() << aspect << "shader cache hit: " << CompiledShader << std::endl;
+		++m_hits;
+		return true;
+	}
+
+	++m_misses;
+	if (!Key.empty()) {
+		// remove a previous compiled shader, it mustn't be stored if the compilation fails
+		std::remove (CompiledShader.c_str());
+
+		pending_shader_t& pending = m_pending[CompiledShader];
+		pending.key = Key;
+		pending.has_job = false;
+		pending.job = 0;
+	}
+
+	return false;
+}
+
+
+void shader_cache::set_compilation_job (const std::string& CompiledShader, const job_graph::job_id_t Job)
+{
+	pending_t::iterator pending = m_pending.find (CompiledShader);
+	if (pending != m_pending.end()) {
+
+		pending->second.has_job = true;
+		pending->second.job = Job;
+	}
+}
+
+
+void shader_cache::store_compiled_shaders (const job_graph& Jobs)
+{
+	for (pending_t::const_iterator shader = m_pending.begin(); shader != m_pending.end() && !Jobs.cancelled(); ++shader) {
+
+		// only what a successful compilation wrote
+		const pending_shader_t& pending = shader->second;
+		if (!pending.has_job || pending.job >= Jobs.jobs().size() || Jobs.jobs()[pending.job].status != job_graph::SUCCEEDED) {
+			continue;
+		}
+
+		// write a temporary file first, so that a partly written entry is never read
+		const std::string file = cache_file (pending.key, shader->first);
+		const std::string temporary_file = temporary_file_of (file);
+		if (copy_file (shader->first, temporary_file)) {
+
+			if (std::rename (temporary_file.c_str(), file.c_str()) != 0) {
+				log() << error << "couldn't store " << shader->first << " in the shader cache" << std::endl;
+				std::remove (temporary_file.c_str());
+			}
+		} else {
+			// the compiled shader wasn't written
+			std::remove (temporary_file.c_str());
+		}
+	}
+
+	m_pending.clear();
+}
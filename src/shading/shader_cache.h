@@ -0,0 +1,75 @@
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _shader_cache_h_
+#define _shader_cache_h_
+
+#include "../miscellaneous/misc_job_graph.h"
+
+#include <map>
+#include <string>
+
+// Cache of compiled shaders, addressed by content:
+// a compiled shader is stored under a key made from the shader source, the files
+// it includes, the renderer code and the compiler command line, so that
+// an unchanged shader isn't compiled again
+class shader_cache
+{
+public:
+	// use (and create if needed) the given cache directory
+	shader_cache (const std::string& Directory);
+
+	// return the key of a shader compilation, empty if the shader can't be read
+	// (included files are searched in the shader's directory, then in the include path);
+	// a non-empty identity stands for the shader source, e.g. the key of a generated shader's structure
+	static std::string compilation_key (const std::string& ShaderFile, const std::string& IncludePath, const std::string& RendererCode, const std::string& CompilerCommand, const std::string& Identity = "");
+
+	// copy the cached compiled shader of the given key, returns false when it isn't cached:
+	// the compiled shader is then stored by store_compiled_shaders() once its compilation job is given
+	bool fetch (const std::string& Key, const std::string& CompiledShader);
+	void set_compilation_job (const std::string& CompiledShader, const job_graph::job_id_t Job);
+
+	// store the missed shaders whose compilation job succeeded (none when the jobs were cancelled:
+	// a killed compiler can leave a partly written file)
+	void store_compiled_shaders (const job_graph& Jobs);
+
+	unsigned long hits() const { return m_hits; }
+	unsigned long misses() const { return m_misses; }
+
+private:
+	std::string m_directory;
+
+	// compiled shaders to store, by compiled shader file
+	struct pending_shader_t
+	{
+		std::string key;
+		bool has_job;
+		job_graph::job_id_t job;
+	};
+	typedef std::map<std::string, pending_shader_t> pending_t;
+	pending_t m_pending;
+
+	unsigned long m_hits;
+	unsigned long m_misses;
+
+	std::string cache_file (const std::string& Key, const std::string& CompiledShader) const;
+};
+
+#endif // _shader_cache_h_
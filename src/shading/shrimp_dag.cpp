@@ -0,0 +1,150 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "shrimp_dag.h"
+
+
+namespace shrimp
+{
+
+namespace
+{
+	const dag_t::pads_t no_pads;
+}
+
+
+void dag_t::clear() {
+
+	m_connections.clear();
+	m_children.clear();
+	m_block_inputs.clear();
+	m_block_outputs.clear();
+}
+
+
+std::pair<dag_t::const_iterator, bool> dag_t::insert (const value_type& Connection) {
+
+	std::pair<connections_t::iterator, bool> result = m_connections.insert (Connection);
+	if (result.second) {
+
+		const pad_t& input = Connection.first;
+		const pad_t& output = Connection.second;
+
+		m_children[output].insert (input);
+		m_block_inputs[input.block].insert (input);
+		m_block_outputs[output.block].insert (output);
+	}
+
+	return std::pair<const_iterator, bool> (result.first, result.second);
+}
+
+
+size_t dag_t::erase (const pad_t& Input) {
+
+	connections_t::iterator connection = m_connections.find (Input);
+	if (connection == m_connections.end()) {
+		return 0;
+	}
+
+	const pad_t input = connection->first;
+	const pad_t output = connection->second;
+	m_connections.erase (connection);
+
+	remove_pad (m_block_inputs, input);
+
+	// forget the output once it has no more children
+	children_t::iterator children = m_children.find (output);
+	children->second.erase (input);
+	if (children->second.empty()) {
+
+		m_children.erase (children);
+		remove_pad (m_block_outputs, output);
+	}
+
+	return 1;
+}
+
+
+size_t dag_t::erase_output (const pad_t& Output) {
+
+	children_t::const_iterator children = m_children.find (Output);
+	if (children == m_children.end()) {
+		return 0;
+	}
+
+	// the last erase removes the output's entry
+	const pads_t inputs = children->second;
+	for (pads_t::const_iterator input = inputs.begin(); input != inputs.end(); ++input) {
+		erase (*input);
+	}
+
+	return inputs.size();
+}
+
+
+const dag_t::pads_t& dag_t::children (const pad_t& Output) const {
+
+	children_t::const_iterator children = m_children.find (Output);
+	if (children == m_children.end()) {
+		return no_pads;
+	}
+
+	return children->second;
+}
+
+
+const dag_t::pads_t& dag_t::block_inputs (const block_handle_t Block) const {
+
+	block_pads_t::const_iterator pads = m_block_inputs.find (Block);
+	if (pads == m_block_inputs.end()) {
+		return no_pads;
+	}
+
+	return pads->second;
+}
+
+
+const dag_t::pads_t& dag_t::block_outputs (const block_handle_t Block) const {
+
+	block_pads_t::const_iterator pads = m_block_outputs.find (Block);
+	if (pads == m_block_outputs.end()) {
+		return no_pads;
+	}
+
+	return pads->second;
+}
+
+
+void dag_t::remove_pad (block_pads_t& Pads, const pad_t& Pad) {
+
+	block_pads_t::iterator pads = Pads.find (Pad.block);
+	if (pads == Pads.end()) {
+		return;
+	}
+
+	pads->second.erase (Pad);
+	if (pads->second.empty()) {
+		Pads.erase (pads);
+	}
+}
+
+} // namespace shrimp
+
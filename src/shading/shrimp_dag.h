@@ -0,0 +1,91 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _shrimp_dag_h_
+#define _shrimp_dag_h_
+
+#include "shrimp_handles.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+
+namespace shrimp
+{
+	// store connections as a directed acyclic graph, Output -> Input,
+	// an input receives only one output.
+	// Pads are stored as block handles and interned pad names (the scene turns names into
+	// pads), iterating goes through <input, output> pairs;
+	// outputs and blocks are indexed too, so that child lookups and output disconnection
+	// only cost the number of connections involved
+	class dag_t
+	{
+	public:
+		typedef std::map <pad_t, pad_t> connections_t;
+		typedef connections_t::value_type value_type;
+		typedef connections_t::const_iterator const_iterator;
+		typedef connections_t::const_iterator iterator;
+
+		typedef std::set<pad_t> pads_t;
+
+		const_iterator begin() const { return m_connections.begin(); }
+		const_iterator end() const { return m_connections.end(); }
+		size_t size() const { return m_connections.size(); }
+		bool empty() const { return m_connections.empty(); }
+		void clear();
+
+		// return the connection of an input
+		const_iterator find (const pad_t& Input) const { return m_connections.find (Input); }
+
+		// add an <input, output> connection, unless the input is already connected
+		std::pair<const_iterator, bool> insert (const value_type& Connection);
+		// remove an input's connection, returns the number of removed connections
+		size_t erase (const pad_t& Input);
+		// remove all connections from an output
+		size_t erase_output (const pad_t& Output);
+
+		// inputs connected to an output
+		const pads_t& children (const pad_t& Output) const;
+		// connected inputs and outputs of a block
+		const pads_t& block_inputs (const block_handle_t Block) const;
+		const pads_t& block_outputs (const block_handle_t Block) const;
+
+		bool operator== (const dag_t& Other) const { return m_connections == Other.m_connections; }
+		bool operator!= (const dag_t& Other) const { return m_connections != Other.m_connections; }
+
+	private:
+		// input -> output
+		connections_t m_connections;
+		// output -> inputs
+		typedef std::map <pad_t, pads_t> children_t;
+		children_t m_children;
+		// block -> connected pads
+		typedef std::map <block_handle_t, pads_t> block_pads_t;
+		block_pads_t m_block_inputs;
+		block_pads_t m_block_outputs;
+
+		static void remove_pad (block_pads_t& Pads, const pad_t& Pad);
+	};
+}
+
+#endif // _shrimp_dag_h_
+
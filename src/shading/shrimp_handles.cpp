@@ -0,0 +1,129 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "shrimp_handles.h"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+
+namespace shrimp
+{
+
+namespace
+{
+
+struct name_table_t
+{
+	std::mutex mutex;
+	// names by value
+	std::unordered_map<std::string, name_t> ids;
+
+	// names by index, in fixed-size chunks that never move: a name is stored before its
+	// index is handed out, so name_string() reads it without locking
+	enum { chunk_size = 4096, max_chunks = 65536 };
+	std::unique_ptr<std::string[]> chunks[max_chunks];
+	name_t count;
+
+	name_table_t() :
+		count (1) {
+		ids.insert (std::make_pair (std::string(), 0));
+		chunks[0].reset (new std::string[chunk_size]);
+	}
+};
+
+name_table_t& name_table() {
+
+	static name_table_t table;
+	return table;
+}
+
+}
+
+
+name_t intern (const std::string& Name) {
+
+	if (Name.empty()) {
+		return 0;
+	}
+
+	name_table_t& table = name_table();
+	std::lock_guard<std::mutex> lock (table.mutex);
+
+	std::unordered_map<std::string, name_t>::const_iterator id = table.ids.find (Name);
+	if (id != table.ids.end()) {
+		return id->second;
+	}
+
+	const name_t new_id = table.count;
+	std::unique_ptr<std::string[]>& chunk = table.chunks[new_id / name_table_t::chunk_size];
+	if (!chunk) {
+		chunk.reset (new std::string[name_table_t::chunk_size]);
+	}
+	chunk[new_id % name_table_t::chunk_size] = Name;
+
+	table.ids.insert (std::make_pair (Name, new_id));
+	++table.count;
+
+	return new_id;
+}
+
+
+bool find_name (const std::string& Name, name_t& Id) {
+
+	if (Name.empty()) {
+		Id = 0;
+		return true;
+	}
+
+	// names never leave the table nor change their number, so each thread keeps the ones
+	// it found and only locks the table for names it hasn't seen yet
+	thread_local std::unordered_map<std::string, name_t> found_names;
+
+	std::unordered_map<std::string, name_t>::const_iterator found = found_names.find (Name);
+	if (found != found_names.end()) {
+
+		Id = found->second;
+		return true;
+	}
+
+	name_table_t& table = name_table();
+	std::lock_guard<std::mutex> lock (table.mutex);
+
+	std::unordered_map<std::string, name_t>::const_iterator id = table.ids.find (Name);
+	if (id == table.ids.end()) {
+		return false;
+	}
+
+	Id = id->second;
+	found_names.insert (*id);
+	return true;
+}
+
+
+const std::string& name_string (const name_t Name) {
+
+	return name_table().chunks[Name / name_table_t::chunk_size][Name % name_table_t::chunk_size];
+}
+
+} // namespace shrimp
+
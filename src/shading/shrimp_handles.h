@@ -0,0 +1,80 @@
+
+/*
+    Copyright 2011, Ted Gocek, Romain Behar <romainbehar@users.sourceforge.net>
+
+    This file is part of Prawn 2.1.1a.
+
+    Prawn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Prawn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Prawn.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _shrimp_handles_h_
+#define _shrimp_handles_h_
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+namespace shrimp
+{
+	// definition of a pad, as a pair of strings:
+	// the first is the block name, the second is the pad name
+	typedef std::pair <std::string, std::string> io_t;
+
+	// interned name: each distinct block or pad name gets a small integer,
+	// 0 being the empty name (the table is shared by all scenes and threads)
+	typedef unsigned int name_t;
+
+	name_t intern (const std::string& Name);
+	// look a name up without adding it to the table, returns false if it was never interned
+	// (names that were already looked up by the calling thread are found without locking the table)
+	bool find_name (const std::string& Name, name_t& Id);
+	// an interned name's text (doesn't lock the table)
+	const std::string& name_string (const name_t Name);
+
+	// block handle: blocks are numbered when they're added to a scene, 0 being no block
+	// (handles don't change when blocks are renamed)
+	typedef unsigned int block_handle_t;
+
+	// a pad as a block handle and an interned pad name
+	struct pad_t
+	{
+		block_handle_t block;
+		name_t pad;
+
+		pad_t() :
+			block (0),
+			pad (0) {
+		}
+
+		pad_t (const block_handle_t Block, const name_t Pad) :
+			block (Block),
+			pad (Pad) {
+		}
+
+		bool operator< (const pad_t& Other) const { return block < Other.block || (block == Other.block && pad < Other.pad); }
+		bool operator== (const pad_t& Other) const { return block == Other.block && pad == Other.pad; }
+		bool operator!= (const pad_t& Other) const { return !(*this == Other); }
+	};
+
+	struct pad_hash
+	{
+		size_t operator() (const pad_t& Pad) const {
+			return (static_cast<size_t> (Pad.block) * 2654435761u) ^ Pad.pad;
+		}
+	};
+}
+
+#endif // _shrimp_handles_h_
+
@@ -25,6 +25,7 @@
 // Structures that need to be accessed from outside the core
 
 #include "shader_block.h"
+#include "shrimp_dag.h"
 
 #include <string>
 #include <vector>
@@ -32,17 +33,15 @@
 
 namespace shrimp
 {
-	// definition of a pad, as a pair of strings:
-	// the first is the block name, the second is the pad name
-	typedef std::pair <std::string, std::string> io_t;
-	// store connections as a directed acyclic graph, Output -> Input,
-	// in a map as <input, output>, an input receives only one output
-	typedef std::map <io_t, io_t> dag_t;
+	// pads (io_t, pad_t) and names are defined in shrimp_handles.h,
+	// connections (dag_t) in shrimp_dag.h
 
 	typedef std::set<shader_block*> shader_blocks_t;
 	// group structures
 	typedef std::set<int> group_set_t;
 	typedef std::map<std::string, int> groups_t;
+	// connections by pad names (for blocks that aren't in a scene)
+	typedef std::map<io_t, io_t> io_connections_t;
 }
 
 